@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace RUBY
+{
+	// Scoped CPU zones written to per-thread ring buffers. Each thread owns its buffer, so recording is a
+	// clock read plus a store, only registering a new thread takes a lock. Use the RUBY_PROFILE_* macros,
+	// they compile to nothing unless RUBY_ENABLE_PROFILER is defined.
+	class CpuProfiler
+	{
+	public:
+		static constexpr uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+		static CpuProfiler& Get();
+
+		static int64_t Now();
+
+		// Zone names are stored as pointers, they must outlive the profiler. Intern() keeps a copy alive.
+		const char* Intern(const std::string& name);
+
+		void Record(const char* name, int64_t beginNanoseconds, int64_t endNanoseconds);
+		void SetThreadName(const std::string& name);
+
+		// Chrome trace-event JSON, open with chrome://tracing or ui.perfetto.dev
+		void WriteChromeTrace(const std::string& path);
+
+	private:
+		struct Event
+		{
+			const char* name;
+			int64_t begin;
+			int64_t end;
+		};
+
+		struct ThreadBuffer
+		{
+			uint32_t threadId{};
+			std::string threadName;
+			std::unique_ptr<Event[]> events{ std::make_unique<Event[]>(EVENTS_PER_THREAD) };
+			std::atomic<uint64_t> writeCount{ 0 };
+		};
+
+		CpuProfiler() = default;
+
+		ThreadBuffer& GetThreadBuffer();
+
+		std::mutex m_Mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> m_ThreadBuffers;
+		std::unordered_set<std::string> m_InternedNames;
+	};
+
+	class CpuProfileZone
+	{
+	public:
+		explicit CpuProfileZone(const char* name) : m_Name(name), m_Begin(CpuProfiler::Now()) {}
+		~CpuProfileZone() { CpuProfiler::Get().Record(m_Name, m_Begin, CpuProfiler::Now()); }
+
+		CpuProfileZone(const CpuProfileZone&) = delete;
+		CpuProfileZone& operator=(const CpuProfileZone&) = delete;
+
+	private:
+		const char* m_Name;
+		int64_t m_Begin;
+	};
+}
+
+#ifdef RUBY_ENABLE_PROFILER
+#define RUBY_PROFILE_CONCAT_INNER(a, b) a##b
+#define RUBY_PROFILE_CONCAT(a, b) RUBY_PROFILE_CONCAT_INNER(a, b)
+#define RUBY_PROFILE_SCOPE(name) ::RUBY::CpuProfileZone RUBY_PROFILE_CONCAT(rubyProfileZone, __LINE__){ name }
+#define RUBY_PROFILE_SCOPE_DYNAMIC(nameString) ::RUBY::CpuProfileZone RUBY_PROFILE_CONCAT(rubyProfileZone, __LINE__){ ::RUBY::CpuProfiler::Get().Intern(nameString) }
+#define RUBY_PROFILE_FUNCTION() RUBY_PROFILE_SCOPE(__func__)
+// A zone name for RUBY_PROFILE_SCOPE that stays valid, nullptr without the profiler
+#define RUBY_PROFILE_INTERN(nameString) ::RUBY::CpuProfiler::Get().Intern(nameString)
+#define RUBY_PROFILE_THREAD_NAME(nameString) ::RUBY::CpuProfiler::Get().SetThreadName(nameString)
+#define RUBY_PROFILE_DUMP(path) ::RUBY::CpuProfiler::Get().WriteChromeTrace(path)
+#else
+#define RUBY_PROFILE_SCOPE(name)
+#define RUBY_PROFILE_SCOPE_DYNAMIC(nameString)
+#define RUBY_PROFILE_FUNCTION()
+#define RUBY_PROFILE_INTERN(nameString) nullptr
+#define RUBY_PROFILE_THREAD_NAME(nameString)
+#define RUBY_PROFILE_DUMP(path)
+#endif
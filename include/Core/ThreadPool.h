@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RUBY
+{
+	// Fixed set of worker threads pulling jobs from one queue. Every worker has a stable index in
+	// [0, GetWorkerCount()) so callers can keep per-thread resources such as command pools.
+	class ThreadPool
+	{
+	public:
+		static constexpr uint32_t INVALID_WORKER = ~0u;
+
+		// 0 picks one worker per hardware thread, minus the one driving the frame. Threads are profiled as "<name> <index>".
+		explicit ThreadPool(uint32_t workerCount = 0, std::string name = "Worker");
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) = delete;
+
+		uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+
+		// Index of the calling worker, INVALID_WORKER when called from a thread outside the pool
+		static uint32_t GetCurrentWorkerIndex();
+
+		template<typename Fn>
+		auto Submit(Fn&& fn) -> std::future<decltype(fn())>
+		{
+			using Result = decltype(fn());
+			auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Fn>(fn));
+			std::future<Result> future = task->get_future();
+			Enqueue([task]() { (*task)(); });
+			return future;
+		}
+
+		// Runs fn(index, workerIndex) for every index in [0, count) and blocks until all of them returned.
+		// Must not be called from inside a worker, the caller only waits.
+		void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t workerIndex)>& fn);
+
+	private:
+		void Enqueue(std::function<void()>&& job);
+		void WorkerLoop(uint32_t workerIndex);
+
+		std::string m_Name;
+		std::vector<std::thread> m_Workers;
+		std::deque<std::function<void()>> m_Jobs;
+
+		std::mutex m_Mutex;
+		std::condition_variable m_JobAvailable;
+		bool m_IsStopping{ false };
+	};
+}
@@ -1,10 +1,22 @@
 #pragma once
+#include <memory>
 #include <vector>
 
+#include "Core/ThreadPool.h"
 #include "Vulkan/CommandPool.h"
+#include "Vulkan/DescriptorAllocator.h"
+#include "Vulkan/DescriptorBuffer.h"
 //#include "Vulkan/IBasePass.h"
 #include "Vulkan/Device.h"
+#include "Vulkan/FrameContext.h"
+#include "Vulkan/FrameRingBuffer.h"
+#include "Vulkan/GpuProfiler.h"
+#include "Vulkan/ParallelCommandRecorder.h"
+#include "Vulkan/PipelineRegistry.h"
+#include "Vulkan/RenderGraph.h"
 #include "Vulkan/SwapChain.h"
+#include "Vulkan/TimelineSemaphore.h"
+#include "Vulkan/UploadManager.h"
 
 namespace RUBY
 {
@@ -12,14 +24,32 @@ namespace RUBY
 	class RUBY
 	{
 	public:
-		RUBY(IRubyWindow* pWindow);
+		RUBY(IRubyWindow* pWindow, uint32_t framesInFlight = 2, DescriptorBackend descriptorBackend = DescriptorBackend::Pools);
 		~RUBY();
 
 		Device& GetDevice() { return m_Device; }
 		SwapChain& GetSwapChain() { return m_SwapChain; }
 		CommandPool& GetCommandPool() { return m_CommandPool; }
+		RenderGraph& GetRenderGraph() { return m_RenderGraph; }
+		ThreadPool& GetThreadPool() { return m_ThreadPool; }
+		// For PipelineBuilder::BuildAsync, long compiles on the frame pool would stall ParallelFor behind them
+		ThreadPool& GetCompileThreadPool() { return m_CompileThreadPool; }
+		ParallelCommandRecorder& GetCommandRecorder() { return m_CommandRecorder; }
+		GpuProfiler& GetGpuProfiler() { return m_GpuProfiler; }
+		UploadManager& GetUploadManager() { return m_UploadManager; }
+		FrameRingBuffer& GetFrameRing() { return m_FrameRing; }
+		DescriptorAllocator& GetDescriptorAllocator() { return m_DescriptorAllocator; }
+		PipelineRegistry& GetPipelineRegistry() { return m_PipelineRegistry; }
 
 		uint32_t GetCurrentFrame() const { return m_CurrentFrame; }
+		FrameContext& GetCurrentFrameContext() { return *m_FrameContexts[m_CurrentFrame]; }
+
+		// Between FrameContext::MIN_FRAMES_IN_FLIGHT and MAX_FRAMES_IN_FLIGHT, drains the GPU when changed
+		uint32_t GetFramesInFlight() const { return static_cast<uint32_t>(m_FrameContexts.size()); }
+		void SetFramesInFlight(uint32_t framesInFlight);
+
+		// Timeline value signaled by the most recently submitted frame, poll it with Device::GetTimeline().IsComplete
+		uint64_t GetLastFrameTimelineValue() const { return m_LastFrameTimelineValue; }
 
 		bool BeginFrame(uint32_t& outImageIndex);
 		void RecordPasses(VkCommandBuffer& cmd, uint32_t& img);
@@ -39,11 +69,29 @@ namespace RUBY
 		Device m_Device{ m_pWindow };
 		CommandPool m_CommandPool{ &m_Device };
 		SwapChain m_SwapChain{ m_pWindow, &m_Device, &m_CommandPool };
+		UploadManager m_UploadManager{ &m_Device };
+		PipelineRegistry m_PipelineRegistry{ &m_Device };
+
+		static constexpr uint32_t COMPILE_WORKER_COUNT = 2;
+
+		ThreadPool m_ThreadPool{};
+		ThreadPool m_CompileThreadPool{ COMPILE_WORKER_COUNT, "Pipeline Compiler" };
+		ParallelCommandRecorder m_CommandRecorder{ &m_Device, &m_ThreadPool };
+
+		// One slot per possible frame in flight, indexed by m_CurrentFrame
+		GpuProfiler m_GpuProfiler{ &m_Device, FrameContext::MAX_FRAMES_IN_FLIGHT };
+		FrameRingBuffer m_FrameRing{ &m_Device, FrameContext::MAX_FRAMES_IN_FLIGHT };
+		DescriptorAllocator m_DescriptorAllocator{ &m_Device, FrameContext::MAX_FRAMES_IN_FLIGHT };
+
+		std::vector<std::unique_ptr<FrameContext>> m_FrameContexts;
+
+		RenderGraph m_RenderGraph{ &m_Device, &m_CommandPool };
 
 		std::unique_ptr<DemoPass> m_TrianglePass;
 
 		bool m_FramebufferResized = false;
 		uint32_t m_CurrentFrame = 0;
+		uint64_t m_LastFrameTimelineValue = 0;
 
 		int frameCount = 0;
 	};
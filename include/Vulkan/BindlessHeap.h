@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/DescriptorBuffer.h"
+
+namespace RUBY
+{
+	class Device;
+
+	enum class BindlessType : uint32_t
+	{
+		SampledImage = 0,
+		StorageImage,
+		StorageBuffer,
+		Sampler,
+		Count
+	};
+
+	// One update-after-bind descriptor set holding every registered resource of the device, bound once per
+	// command buffer instead of per draw. Shaders index the arrays by the slot the resource was registered at:
+	//   layout(set = N, binding = 0) uniform texture2D textures[];
+	//   layout(set = N, binding = 1) uniform image2D images[];
+	//   layout(set = N, binding = 2) buffer Buffers { uint data[]; } buffers[];
+	//   layout(set = N, binding = 3) uniform sampler samplers[];
+	// Buffers and Images only take slots when asked to (RegisterBindless), so a full heap never fails their creation.
+	// Freed slots are recycled once the frame that may still read them retired (Device::DeferDestroy).
+	// With the descriptor buffer backend the set lives in the persistent region of the DescriptorBuffer.
+	class BindlessHeap
+	{
+	public:
+		static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+		explicit BindlessHeap(Device* pDevice);
+		~BindlessHeap();
+
+		BindlessHeap(const BindlessHeap&) = delete;
+		BindlessHeap(BindlessHeap&&) = delete;
+		BindlessHeap& operator=(const BindlessHeap&) = delete;
+		BindlessHeap& operator=(BindlessHeap&&) = delete;
+
+		// Thread safe. Sampled images are expected in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, storage images in GENERAL.
+		// The descriptor buffer backend needs an explicit storage buffer range.
+		uint32_t RegisterSampledImage(VkImageView imageView);
+		uint32_t RegisterStorageImage(VkImageView imageView);
+		uint32_t RegisterStorageBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+		uint32_t RegisterSampler(VkSampler sampler);
+		void Release(BindlessType type, uint32_t index);
+		// Thread safe. Points a registered slot at another resource and keeps its index, for relocated resources.
+		// The slot is rewritten right away, no pending command buffer may read it.
+		void UpdateSampledImage(uint32_t index, VkImageView imageView);
+		void UpdateStorageImage(uint32_t index, VkImageView imageView);
+		void UpdateStorageBuffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+		void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t setIndex) const;
+
+		VkDescriptorSetLayout GetSetLayout() const { return m_SetLayout; }
+		// VK_NULL_HANDLE with the descriptor buffer backend
+		VkDescriptorSet GetSet() const { return m_Set; }
+		uint32_t GetCapacity(BindlessType type) const { return m_Slots[static_cast<uint32_t>(type)].capacity; }
+		uint32_t GetUsedCount(BindlessType type) const;
+
+	private:
+		struct SlotAllocator
+		{
+			uint32_t capacity{ 0 };
+			uint32_t next{ 0 };
+			std::vector<uint32_t> freeSlots;
+		};
+
+		uint32_t AllocateSlot(BindlessType type);
+		void Write(BindlessType type, uint32_t index, const VkDescriptorImageInfo* pImageInfo, const VkDescriptorBufferInfo* pBufferInfo);
+
+		Device* m_pDevice{};
+
+		VkDescriptorSetLayout m_SetLayout{ VK_NULL_HANDLE };
+		VkDescriptorPool m_Pool{ VK_NULL_HANDLE };
+		VkDescriptorSet m_Set{ VK_NULL_HANDLE };
+		DescriptorBuffer* m_pDescriptorBuffer{};
+		DescriptorBufferSet m_DescriptorBufferSet{};
+
+		mutable std::mutex m_Mutex;
+		std::array<SlotAllocator, static_cast<size_t>(BindlessType::Count)> m_Slots{};
+	};
+}
@@ -4,9 +4,11 @@
 
 class VmaAllocation_T;
 using VmaAllocation = VmaAllocation_T*;
+struct VmaAllocationCreateInfo;
 
 namespace RUBY
 {
+	class Defragmenter;
 
 	enum class HostAccess { None, Sequential, Random };
 
@@ -16,6 +18,8 @@ namespace RUBY
 
 		Buffer() = default;
 		Buffer(Device* pDevice, CommandPool* pCommandPool, const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags properties, HostAccess hostAcces);
+		// Full control over the allocation, VMA_ALLOCATION_CREATE_MAPPED_BIT keeps it mapped for its whole lifetime
+		Buffer(Device* pDevice, CommandPool* pCommandPool, const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocInfo);
 		~Buffer();
 
 		Buffer(Buffer&) = delete;
@@ -25,16 +29,56 @@ namespace RUBY
 
 		VkBuffer GetBuffer() const { return m_Buffer; }
 		VmaAllocation GetBufferAllocation() const { return m_BufferAllocation; }
+		VkDeviceSize GetSize() const { return m_Size; }
 
+		// nullptr unless the buffer was created persistently mapped
+		void* GetMappedData() const { return m_pMappedData; }
+		VkMemoryPropertyFlags GetMemoryProperties() const { return m_MemoryProperties; }
+		// Slot in the device BindlessHeap, BindlessHeap::INVALID_INDEX until RegisterBindless
+		uint32_t GetBindlessIndex() const { return m_BindlessIndex; }
+		// Opt-in, takes a storage buffer slot for buffers with STORAGE_BUFFER usage and hands it back on destruction.
+		// Does nothing when already registered, throws when the heap is full.
+		void RegisterBindless();
+
+		// Debug name of the VkBuffer and name of its allocation in the MemoryTracker, defaults to one derived from the usage
+		void SetName(const std::string& name) const;
+
+		// Lets the Defragmenter move the buffer, GetBuffer changes when it does while the bindless index stays.
+		// Needs TRANSFER_SRC and TRANSFER_DST usage and memory that is not host visible.
+		void SetRelocatable(bool relocatable);
+		bool IsRelocatable() const { return m_IsRelocatable; }
+
+		// Submits and waits on its own, ImmediateContext::CopyBuffer batches instead
 		void CopyBuffer(VkBuffer srcBuffer, VkDeviceSize size) const;
-		void CopyMemory(void* data, const VkDeviceSize& size, int offset = 0) const;
+		// Only records, srcBuffer has to outlive the command buffer's execution
+		void CopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkDeviceSize size) const;
+		void CopyMemory(const void* data, const VkDeviceSize& size, int offset = 0) const;
+
+		// Queue family ownership transfer of the whole buffer, see Image::ReleaseOwnership
+		void ReleaseOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+			VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess) const;
+		void AcquireOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+			VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess) const;
 
 	private:
+		friend class Defragmenter;
+
 		Device* m_pDevice{};
 		CommandPool* m_pCommandPool{};
 
 		VkBuffer m_Buffer{};
 		VmaAllocation m_BufferAllocation{};
 		VkDeviceSize m_Size{ 0 };
+		void* m_pMappedData{ nullptr };
+		VkMemoryPropertyFlags m_MemoryProperties{ 0 };
+		uint32_t m_BindlessIndex{ UINT32_MAX };
+		// What the buffer was created with, recreating it during relocation needs it
+		VkBufferCreateInfo m_CreateInfo{};
+		bool m_IsRelocatable{ false };
+
+		void ReleaseBindless();
+		// Swaps in a buffer bound to the new memory, returns the old one
+		VkBuffer Relocate(VkBuffer newBuffer);
+		void CreateBuffer(const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocInfo);
 	};
 }
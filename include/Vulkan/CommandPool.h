@@ -1,29 +1,82 @@
 #pragma once
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
 #include <vulkan/vulkan.h>
 #include "Device.h"
 
 namespace RUBY
 {
+	class Buffer;
+
 	class CommandPool
 	{
 	public:
-		CommandPool(Device* pDevice);
+		CommandPool(Device* pDevice,
+			uint32_t commandBufferCount = 0,
+			VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+			const std::string& debugName = "Main Command Pool",
+			QueueType queueType = QueueType::Graphics);
 		~CommandPool();
 
+		CommandPool(const CommandPool&) = delete;
+		CommandPool(CommandPool&&) = delete;
+		CommandPool& operator=(const CommandPool&) = delete;
+		CommandPool& operator=(CommandPool&&) = delete;
+
+		// Recycles every command buffer allocated from this pool at once
+		void Reset();
+
+		// Buffers that stay valid until the next Reset(), allocated once and reused afterwards
+		VkCommandBuffer AcquirePrimaryCommandBuffer();
+		VkCommandBuffer AcquireSecondaryCommandBuffer();
+
+		QueueType GetQueueType() const { return m_QueueType; }
+
+		// Always a separate command buffer, submitted and waited on by End, open ImmediateContexts don't change that
 		VkCommandBuffer BeginSingleTimeCommands() const;
 		void EndSingleTimeCommands(VkCommandBuffer commandBuffer) const;
+		bool HasImmediateContext() const { return m_ImmediateDepth > 0; }
 
 		VkCommandPool GetCommandPool() const { return m_CommandPool; }
 		std::vector<VkCommandBuffer>& GetCommandBuffers() { return m_CommandBuffers; }
 
 	private:
+		friend class ImmediateContext;
+
+		struct ImmediateBatch
+		{
+			VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+			uint64_t timelineValue{ 0 };
+			std::vector<std::unique_ptr<Buffer>> stagingBuffers;	// released once timelineValue completed
+		};
+
+		VkCommandBuffer BeginImmediate();
+		uint64_t EndImmediate(bool wait);
+		Buffer& AllocateImmediateStaging(VkDeviceSize size);
+		Buffer& AdoptImmediateStaging(std::unique_ptr<Buffer> pBuffer);
+		bool OwnsImmediateStaging(const Buffer& buffer) const;
+
 		Device* m_pDevice;
+		QueueType m_QueueType;
+
+		std::deque<ImmediateBatch> m_ImmediateBatches;	// oldest first, the back one is recording while depth > 0
+		uint32_t m_ImmediateDepth{ 0 };
+		bool m_CanResetCommandBuffers;
 
 		VkCommandPool m_CommandPool;
 		std::vector<VkCommandBuffer> m_CommandBuffers;
 
-		void CreateCommandPool();
-		void CreateCommandBuffers();
+		std::vector<VkCommandBuffer> m_PrimaryCommandBuffers;
+		uint32_t m_PrimaryInUse{ 0 };
+		std::vector<VkCommandBuffer> m_SecondaryCommandBuffers;
+		uint32_t m_SecondaryInUse{ 0 };
+
+		VkCommandBuffer AcquireCommandBuffer(VkCommandBufferLevel level, std::vector<VkCommandBuffer>& buffers, uint32_t& inUse);
+
+		void CreateCommandPool(VkCommandPoolCreateFlags flags, const std::string& debugName);
+		void CreateCommandBuffers(uint32_t count);
 
 	};
 }
\ No newline at end of file
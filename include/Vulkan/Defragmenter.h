@@ -0,0 +1,140 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/CommandPool.h"
+
+class VmaAllocation_T;
+using VmaAllocation = VmaAllocation_T*;
+class VmaDefragmentationContext_T;
+using VmaDefragmentationContext = VmaDefragmentationContext_T*;
+struct VmaDefragmentationPassMoveInfo;
+
+namespace RUBY
+{
+	class Buffer;
+	class Device;
+	class Image;
+
+	struct DefragmentationStats
+	{
+		VkDeviceSize bytesMoved{ 0 };
+		VkDeviceSize bytesFreed{ 0 };
+		uint32_t allocationsMoved{ 0 };
+		uint32_t deviceMemoryBlocksFreed{ 0 };
+	};
+
+	// Incremental VMA defragmentation, owned by the Device and driven by Update once per frame before the frame
+	// is recorded. Each pass moves at most a byte budget worth of allocations. Every move VMA plans is recorded, the
+	// time the passes take decides how many moves the next run plans per pass. Moved resources get a new
+	// VkBuffer/VkImage bound to the new memory, the copy runs on the graphics queue ahead of the frame and the owner
+	// switches to the new handle right away, so everything recorded afterwards uses it. Old handles and memory are
+	// released once the copy retired.
+	//
+	// Only Buffers and Images marked with SetRelocatable are moved. Their handles and views change, their bindless
+	// indices don't: the slots are rewritten in place, so a pass first drains the graphics and compute queues on the
+	// CPU, which stalls for up to a frame. Keep the fragmentation threshold high or Start it on loading screens.
+	// Reference them through the BindlessHeap, per-frame sets or DescriptorAllocator::GetOrCreate (which forgets the
+	// old handles through a relocation listener), never from long lived descriptor sets of your own.
+	// Destinations of queue family ownership transfers are skipped while marked busy (UploadManager does that).
+	class Defragmenter
+	{
+	public:
+		static constexpr VkDeviceSize DEFAULT_MAX_BYTES_PER_FRAME = 16ull * 1024 * 1024;
+		static constexpr std::chrono::microseconds DEFAULT_MAX_TIME_PER_FRAME{ 500 };
+		static constexpr uint32_t MAX_MOVES_PER_PASS = 64;
+		// Update checks the fragmentation every this many frames and starts on its own above the threshold
+		static constexpr uint32_t CHECK_INTERVAL = 600;
+		static constexpr float DEFAULT_FRAGMENTATION_THRESHOLD = 0.25f;
+
+		explicit Defragmenter(Device* pDevice);
+		~Defragmenter();
+
+		Defragmenter(const Defragmenter&) = delete;
+		Defragmenter(Defragmenter&&) = delete;
+		Defragmenter& operator=(const Defragmenter&) = delete;
+		Defragmenter& operator=(Defragmenter&&) = delete;
+
+		void SetFrameBudget(VkDeviceSize maxBytes, std::chrono::microseconds maxTime);
+		// 0 disables the automatic start, Start still works
+		void SetFragmentationThreshold(float threshold) { m_FragmentationThreshold = threshold; }
+
+		void Start();
+		bool IsRunning() const { return m_Context != nullptr; }
+		// Main thread, after FrameContext::Begin and before anything of the frame is submitted
+		void Update();
+
+		// Unused fraction of the memory blocks VMA allocated
+		float GetFragmentation() const;
+		// Accumulated over every finished run
+		const DefragmentationStats& GetStats() const { return m_Stats; }
+
+		// Called by Buffer/Image when they become relocatable or move to another object
+		void Register(VmaAllocation allocation, Buffer* pBuffer);
+		void Register(VmaAllocation allocation, Image* pImage);
+		void Unregister(VmaAllocation allocation);
+		// Called by owners right before freeing an allocation. Returns true when the allocation is part of the running
+		// pass: the caller must not free it then, destroyHandle and the memory are released once the pass ended.
+		bool ReleaseAllocation(VmaAllocation allocation, std::function<void()>&& destroyHandle);
+
+		// Thread safe and counted, allocations stay unmovable until every AddBusy was matched by a RemoveBusy
+		void AddBusy(VmaAllocation allocation);
+		void RemoveBusy(VmaAllocation allocation);
+
+		// Called with the old VkBuffer and VkImageView handles of every pass once its moves are recorded, so caches
+		// keyed on handles can forget them before the next frame records. Returns the id for RemoveRelocationListener.
+		uint32_t AddRelocationListener(std::function<void(const std::vector<uint64_t>& oldHandles)>&& listener);
+		void RemoveRelocationListener(uint32_t id);
+
+	private:
+		struct Owner
+		{
+			Buffer* pBuffer{ nullptr };
+			Image* pImage{ nullptr };
+		};
+
+		// Everything below expects m_Mutex to be held
+		void BeginDefragmentation();
+		void BeginPass();
+		void EndPass();
+		void Finish();
+		// False when the owner can't be moved, the move is ignored then
+		bool RecordBufferMove(VkCommandBuffer commandBuffer, Buffer& buffer, VmaAllocation dstAllocation);
+		bool RecordImageMove(VkCommandBuffer commandBuffer, Image& image, VmaAllocation dstAllocation,
+			std::vector<VkImageMemoryBarrier2>& outAfterBarriers);
+		void Submit(VkCommandBuffer commandBuffer);
+
+		Device* m_pDevice{};
+		CommandPool m_CommandPool;
+
+		VkDeviceSize m_MaxBytesPerFrame{ DEFAULT_MAX_BYTES_PER_FRAME };
+		std::chrono::microseconds m_MaxTimePerFrame{ DEFAULT_MAX_TIME_PER_FRAME };
+		float m_FragmentationThreshold{ DEFAULT_FRAGMENTATION_THRESHOLD };
+		uint32_t m_FramesSinceCheck{ 0 };
+		// maxAllocationsPerPass of the next run, lowered when a pass overran the time budget
+		uint32_t m_MovesPerPass{ MAX_MOVES_PER_PASS };
+
+		std::mutex m_Mutex;
+		std::unordered_map<VmaAllocation, Owner> m_Owners;
+		std::unordered_map<VmaAllocation, uint32_t> m_BusyCounts;
+		std::vector<std::pair<uint32_t, std::function<void(const std::vector<uint64_t>&)>>> m_RelocationListeners;
+		uint32_t m_NextListenerId{ 0 };
+
+		VmaDefragmentationContext m_Context{ nullptr };
+		std::unique_ptr<VmaDefragmentationPassMoveInfo> m_pPass;
+		bool m_IsPassOpen{ false };
+		uint64_t m_PassValue{ 0 };
+		// Old handles of moved resources and handles of owners freed during the pass
+		std::vector<std::function<void()>> m_PassDestroys;
+		std::vector<uint64_t> m_PassOldHandles;
+
+		DefragmentationStats m_Stats{};
+	};
+}
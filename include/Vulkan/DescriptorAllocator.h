@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace RUBY
+{
+	class Device;
+
+	// Collects the writes of one descriptor set, doubles as the cache key of DescriptorAllocator::GetOrCreate
+	class DescriptorWriter
+	{
+	public:
+		DescriptorWriter& WriteBuffer(uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& bufferInfo, uint32_t arrayElement = 0);
+		DescriptorWriter& WriteImage(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo, uint32_t arrayElement = 0);
+
+		void Update(VkDevice device, VkDescriptorSet set) const;
+		// Writes the set inline into the command buffer, for push descriptor layouts
+		void Push(const Device& device, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set) const;
+		uint64_t GetHash() const;
+		void Clear() { m_Writes.clear(); }
+
+		bool operator==(const DescriptorWriter& other) const;
+
+		struct Write
+		{
+			uint32_t binding{};
+			uint32_t arrayElement{};
+			VkDescriptorType type{};
+			VkDescriptorBufferInfo bufferInfo{};
+			VkDescriptorImageInfo imageInfo{};
+		};
+		const std::vector<Write>& GetWrites() const { return m_Writes; }
+
+		static bool IsImageType(VkDescriptorType type);
+
+	private:
+		std::vector<VkWriteDescriptorSet> BuildWrites(VkDescriptorSet set) const;
+
+		std::vector<Write> m_Writes;
+	};
+
+	// Chains descriptor pools instead of failing once one runs out. Transient sets come from per-frame pools that
+	// are reset as a whole by BeginFrame (after FrameContext::Begin), so a per-draw set costs a pool bump and is
+	// never freed individually. GetOrCreate hands out long lived sets, shared between identical writes.
+	// The VkDescriptorSet entry points need the Pools backend, BindTransient works with either.
+	class DescriptorAllocator
+	{
+	public:
+		// Share of each descriptor type per set in a pool, e.g. 2 uniform buffers for every set
+		struct PoolSizeRatio
+		{
+			VkDescriptorType type;
+			float ratio;
+		};
+
+		static constexpr uint32_t INITIAL_SETS_PER_POOL = 64;
+		static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+		DescriptorAllocator(Device* pDevice, uint32_t frameCount, const std::vector<PoolSizeRatio>& ratios = GetDefaultRatios());
+		~DescriptorAllocator();
+
+		DescriptorAllocator(const DescriptorAllocator&) = delete;
+		DescriptorAllocator(DescriptorAllocator&&) = delete;
+		DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+		DescriptorAllocator& operator=(DescriptorAllocator&&) = delete;
+
+		void BeginFrame(uint32_t frameIndex);
+
+		// Thread safe. Valid until the current frame retires.
+		VkDescriptorSet Allocate(VkDescriptorSetLayout layout);
+		VkDescriptorSet Allocate(VkDescriptorSetLayout layout, const DescriptorWriter& writer);
+
+		// Thread safe. Allocates, writes and binds a set for the current frame on whichever backend the device uses,
+		// lock free with descriptor buffers (bound with DescriptorBuffer::BindBuffer first).
+		void BindTransient(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex,
+			VkDescriptorSetLayout setLayout, const DescriptorWriter& writer);
+
+		// Thread safe. Allocated and written once per distinct layout and writes, valid until ClearCache.
+		// The key holds raw handles: clear the cache when resources it references are destroyed. Handles the
+		// Defragmenter relocates are forgotten automatically.
+		VkDescriptorSet GetOrCreate(VkDescriptorSetLayout layout, const DescriptorWriter& writer);
+		void ClearCache();
+		// Drops cached sets referencing any of the buffer, image view or sampler handles, their memory is only
+		// reclaimed by ClearCache
+		void Invalidate(const std::vector<uint64_t>& handles);
+
+		uint32_t GetPoolCount() const;
+		size_t GetCachedSetCount() const;
+		uint64_t GetCacheHits() const { return m_CacheHits.load(std::memory_order_relaxed); }
+		uint64_t GetCacheMisses() const { return m_CacheMisses.load(std::memory_order_relaxed); }
+
+		static std::vector<PoolSizeRatio> GetDefaultRatios();
+
+	private:
+		struct PoolChain
+		{
+			VkDescriptorPool current{ VK_NULL_HANDLE };
+			std::vector<VkDescriptorPool> full;
+		};
+
+		struct CachedSet
+		{
+			VkDescriptorSetLayout layout;
+			DescriptorWriter writer;
+			VkDescriptorSet set;
+		};
+
+		VkDescriptorSet AllocateFromChain(PoolChain& chain, VkDescriptorSetLayout layout);
+		void CheckPoolBackend() const;
+		VkDescriptorPool AcquirePool();
+
+		Device* m_pDevice{};
+		std::vector<PoolSizeRatio> m_Ratios;
+		uint32_t m_SetsPerPool{ INITIAL_SETS_PER_POOL };
+
+		mutable std::mutex m_Mutex;
+		std::vector<PoolChain> m_FrameChains;
+		uint32_t m_FrameIndex{ 0 };
+		std::vector<VkDescriptorPool> m_FreePools;
+		uint32_t m_PoolCount{ 0 };
+
+		uint32_t m_RelocationListener{ 0 };
+
+		PoolChain m_PersistentChain;
+		std::unordered_map<uint64_t, std::vector<CachedSet>> m_Cache;
+		size_t m_CachedSetCount{ 0 };
+		std::atomic<uint64_t> m_CacheHits{ 0 };
+		std::atomic<uint64_t> m_CacheMisses{ 0 };
+	};
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+namespace RUBY
+{
+	class Buffer;
+	class DescriptorWriter;
+	class Device;
+
+	// Descriptor set living at an offset of the DescriptorBuffer, written with WriteDescriptor/Write
+	struct DescriptorBufferSet
+	{
+		VkDescriptorSetLayout layout{ VK_NULL_HANDLE };
+		VkDeviceSize offset{ 0 };
+		std::byte* pData{ nullptr };
+	};
+
+	// VK_EXT_descriptor_buffer backend, created by the Device when it selected DescriptorBackend::DescriptorBuffer.
+	// Descriptors are plain bytes written into one persistently mapped buffer: a persistent region for long lived
+	// sets (the BindlessHeap) followed by a ring segment per frame in flight. Allocating is an atomic bump and
+	// writing is vkGetDescriptorEXT into mapped memory, so worker threads never take a lock.
+	// The buffer has to be bound once per command buffer (BindBuffer), secondaries included, before any Bind.
+	// RUBY, RenderGraph batches and ParallelCommandRecorder secondaries already bind it.
+	class DescriptorBuffer
+	{
+	public:
+		static constexpr VkDeviceSize DEFAULT_PERSISTENT_SIZE = 8ull * 1024 * 1024;
+		static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 2ull * 1024 * 1024;
+
+		// Throws when the regions together exceed GetMaxSize
+		DescriptorBuffer(Device* pDevice, uint32_t frameCount,
+			VkDeviceSize persistentSize = DEFAULT_PERSISTENT_SIZE, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+		~DescriptorBuffer();
+
+		DescriptorBuffer(const DescriptorBuffer&) = delete;
+		DescriptorBuffer(DescriptorBuffer&&) = delete;
+		DescriptorBuffer& operator=(const DescriptorBuffer&) = delete;
+		DescriptorBuffer& operator=(DescriptorBuffer&&) = delete;
+
+		// Rewinds the segment of a slot whose previous use already retired (after FrameContext::Begin)
+		void BeginFrame(uint32_t frameIndex);
+
+		// Thread safe. Valid until the current frame retires.
+		DescriptorBufferSet Allocate(VkDescriptorSetLayout layout);
+		// Thread safe. Never freed, for sets living as long as the device.
+		DescriptorBufferSet AllocatePersistent(VkDescriptorSetLayout layout);
+
+		// Thread safe as long as no two threads write the same descriptor
+		void WriteDescriptor(const DescriptorBufferSet& set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type, const VkDescriptorDataEXT& data) const;
+		// Buffer writes need an explicit range and buffers created with SHADER_DEVICE_ADDRESS usage (Buffer adds it)
+		void Write(const DescriptorBufferSet& set, const DescriptorWriter& writer) const;
+
+		void BindBuffer(VkCommandBuffer commandBuffer) const;
+		void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t setIndex, const DescriptorBufferSet& set) const;
+
+		// Largest buffer the device can bind as both resource and sampler descriptor buffer
+		static VkDeviceSize GetMaxSize(VkPhysicalDevice physicalDevice);
+
+		VkDeviceSize GetLayoutSize(VkDescriptorSetLayout layout) const;
+		size_t GetDescriptorSize(VkDescriptorType type) const;
+		VkDeviceSize GetFrameUsage() const { return m_Head.load(std::memory_order_relaxed) - m_FrameBegin; }
+		VkDeviceSize GetPersistentSpace() const { return m_PersistentSize - m_PersistentHead.load(std::memory_order_relaxed); }
+
+	private:
+		DescriptorBufferSet AllocateFrom(std::atomic<VkDeviceSize>& head, VkDeviceSize end, VkDescriptorSetLayout layout, const char* pRegionName);
+
+		Device* m_pDevice{};
+		std::unique_ptr<Buffer> m_pBuffer;
+		VkDeviceAddress m_BufferAddress{ 0 };
+		// Also given to BindBuffer, which has to repeat the creation usage
+		VkBufferUsageFlags m_Usage{ 0 };
+		VkPhysicalDeviceDescriptorBufferPropertiesEXT m_Properties{};
+
+		VkDeviceSize m_PersistentSize{};
+		std::atomic<VkDeviceSize> m_PersistentHead{ 0 };
+
+		uint32_t m_FrameCount{};
+		VkDeviceSize m_FrameSize{};
+		VkDeviceSize m_FrameBegin{ 0 };
+		VkDeviceSize m_FrameEnd{ 0 };
+		std::atomic<VkDeviceSize> m_Head{ 0 };
+
+		PFN_vkGetDescriptorSetLayoutSizeEXT m_vkGetDescriptorSetLayoutSize{};
+		PFN_vkGetDescriptorSetLayoutBindingOffsetEXT m_vkGetDescriptorSetLayoutBindingOffset{};
+		PFN_vkGetDescriptorEXT m_vkGetDescriptor{};
+		PFN_vkCmdBindDescriptorBuffersEXT m_vkCmdBindDescriptorBuffers{};
+		PFN_vkCmdSetDescriptorBufferOffsetsEXT m_vkCmdSetDescriptorBufferOffsets{};
+	};
+}
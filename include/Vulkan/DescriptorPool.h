@@ -3,6 +3,7 @@
 #include <vulkan/vulkan_core.h>
 
 #include "Device.h"
+#include "Vulkan/ShaderReflection.h"
 
 namespace RUBY
 {
@@ -12,12 +13,16 @@ namespace RUBY
         struct DescriptorSetLayoutData
         {
             std::vector<VkDescriptorSetLayoutBinding> bindings{};
+            // Written with Device::CmdPushDescriptorSet or a PushDescriptorTemplate, never allocated from the pool
+            bool pushDescriptor{ false };
         };
 
         DescriptorPool(Device* pDevice,
                        const std::vector<DescriptorSetLayoutData>& layoutDatas,
                        const std::vector<VkDescriptorPoolSize>& poolSizes,
                        uint32_t maxSets = MAX_POOL_RESERVE);
+        // Set layouts and pool sizes taken from the shaders, see PipelineBuilder::GetReflection
+        DescriptorPool(Device* pDevice, const ShaderReflection& reflection, uint32_t maxSets = MAX_POOL_RESERVE);
 
         DescriptorPool(const DescriptorPool& other) = delete;
         DescriptorPool(DescriptorPool&& other) noexcept = delete;
@@ -28,10 +33,16 @@ namespace RUBY
 
         const VkDescriptorSetLayout& GetDescriptorSetLayout(int index) const;
         const std::vector<VkDescriptorSetLayout>& GetDescriptorSetLayouts() const;
+        // VK_NULL_HANDLE with the descriptor buffer backend
         const VkDescriptorPool& GetDescriptorPool() const;
+        // What the set layouts were created from, PipelineRegistry keys on it instead of the handles
+        const std::vector<DescriptorSetLayoutData>& GetSetLayoutData() const { return m_LayoutDatas; }
 
         static constexpr uint32_t MAX_POOL_RESERVE = 512;
 
+        // Throws on runtime sized arrays
+        static std::vector<DescriptorSetLayoutData> GetLayoutData(const ShaderReflection& reflection);
+
     private:
         void CreateDescriptorSetLayouts(const std::vector<DescriptorSetLayoutData>& layoutDatas);
         void CreateDescriptorPool(const std::vector<VkDescriptorPoolSize>& poolSizes, uint32_t maxSets);
@@ -40,5 +51,6 @@ namespace RUBY
 
         VkDescriptorPool m_DescriptorPool{VK_NULL_HANDLE};
         std::vector<VkDescriptorSetLayout> m_DescriptorSetLayouts{};
+        std::vector<DescriptorSetLayoutData> m_LayoutDatas{};
     };
 }
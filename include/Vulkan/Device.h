@@ -1,6 +1,14 @@
 #pragma once
+#include <array>
+#include <deque>
+#include <filesystem>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <string>
 #include <vulkan/vulkan.h>
 
 #include "Instance.h"
@@ -13,6 +21,28 @@ using VmaAllocator = VmaAllocator_T*;
 
 namespace RUBY
 {
+	class BindlessHeap;
+	class Defragmenter;
+	class DescriptorBuffer;
+	class MemoryTracker;
+	class PipelineCache;
+	class ShaderCache;
+	class TimelineSemaphore;
+
+	enum class QueueType
+	{
+		Graphics,
+		Compute,
+		Transfer,
+	};
+
+	// How descriptor sets are stored, fixed for the lifetime of a Device
+	enum class DescriptorBackend
+	{
+		Pools,				// VkDescriptorPool/VkDescriptorSet
+		DescriptorBuffer,	// VK_EXT_descriptor_buffer, see DescriptorBuffer
+	};
+
 	class Device
 	{
 	public:
@@ -21,6 +51,10 @@ namespace RUBY
 		{
 			std::optional<uint32_t> graphicsFamily;
 			std::optional<uint32_t> presentFamily;
+			// Prefers a family without graphics support, falls back to the graphics family
+			std::optional<uint32_t> computeFamily;
+			// Prefers a transfer-only family (DMA engine), then the compute family
+			std::optional<uint32_t> transferFamily;
 
 			bool IsComplete()
 			{
@@ -108,12 +142,19 @@ namespace RUBY
 
 
 	public:
-		Device(IRubyWindow* window);
+		static constexpr const char* DEFAULT_PIPELINE_CACHE_PATH = "RubyPipelineCache.bin";
+
+		// preferredBackend falls back to Pools when the device lacks descriptor buffer support. Allocations still alive
+		// when the Device is destroyed are always reported, with a leakDumpPath their VMA stats are also written there.
+		Device(IRubyWindow* window, const std::filesystem::path& pipelineCachePath = DEFAULT_PIPELINE_CACHE_PATH,
+			DescriptorBackend preferredBackend = DescriptorBackend::Pools, const std::filesystem::path& leakDumpPath = {});
 		~Device();
 
 		SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device) const;
 		VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) const;
 		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+		// Tile based GPUs expose LAZILY_ALLOCATED memory, transient attachments placed in it are never committed
+		bool SupportsLazilyAllocatedMemory() const;
 		VkFormat FindDepthFormat() const;
 
 		Instance* GetInstance() { return &m_Instance; }
@@ -121,13 +162,77 @@ namespace RUBY
 		VkDevice GetLogicalDevice() const { return m_LogicalDevice; }
 		VkPhysicalDevice GetPhysicalDevice() const { return m_PhysicalDevice; }
 		VkSurfaceKHR GetSurface() const { return m_Surface; }
+		// False when the window could not provide a surface, the SwapChain then renders offscreen
+		bool HasSurface() const { return m_Surface != VK_NULL_HANDLE; }
 
 		VkQueue GetGraphicsQueue() const { return m_GraphicsQueue; }
 		VkQueue GetPresentQueue() const { return m_PresentQueue; }
+		VkQueue GetComputeQueue() const { return m_ComputeQueue; }
+		VkQueue GetTransferQueue() const { return m_TransferQueue; }
+		VkQueue GetQueue(QueueType queueType) const;
+		uint32_t GetQueueFamily(QueueType queueType) const;
+
+		// Thread safe, every submit and present goes through these. Queue types can share a VkQueue (see
+		// HasAsyncComputeQueue), which then needs the same external synchronization.
+		VkResult Submit(QueueType queueType, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence = VK_NULL_HANDLE) const;
+		// Also signals the next value of the queue type's timeline, added to submitInfo's own signals. The value is
+		// handed out under the queue lock, so concurrent submits signal their values in order.
+		VkResult Submit(QueueType queueType, const VkSubmitInfo2& submitInfo, uint64_t& outSignalValue, VkFence fence = VK_NULL_HANDLE) const;
+		VkResult Present(const VkPresentInfoKHR& presentInfo) const;
+
+		// False when compute work shares the graphics VkQueue and can't overlap with it
+		bool HasAsyncComputeQueue() const { return m_ComputeQueue != m_GraphicsQueue; }
+		bool HasAsyncTransferQueue() const { return m_TransferQueue != m_GraphicsQueue; }
 
 		const DeviceDebugger& GetDebugger() const { return *m_pDebugger; }
 
 		VmaAllocator GetAllocator() const { return m_Allocator; }
+		// Heap budgets, per-category usage and the VMA JSON dump, leaks are reported when the Device is destroyed
+		MemoryTracker& GetMemoryTracker() const { return *m_pMemoryTracker; }
+		// Moves relocatable Buffers/Images out of fragmented blocks, RUBY updates it every frame
+		Defragmenter& GetDefragmenter() const { return *m_pDefragmenter; }
+
+		// Loaded from disk on creation and written back on destruction, pass it to every vkCreate*Pipelines
+		VkPipelineCache GetPipelineCache() const;
+		// Also worth calling after a loading screen, so a crash later doesn't lose the compiled pipelines
+		bool SavePipelineCache();
+
+		ShaderCache& GetShaderCache() const { return *m_pShaderCache; }
+		// Images and buffers with sampled/storage usage register themselves on creation
+		BindlessHeap& GetBindlessHeap() const { return *m_pBindlessHeap; }
+
+		DescriptorBackend GetDescriptorBackend() const { return m_DescriptorBackend; }
+		// nullptr with the Pools backend
+		DescriptorBuffer* GetDescriptorBuffer() const { return m_pDescriptorBuffer.get(); }
+		// Every set layout and pipeline created on this device needs these for the active backend
+		VkDescriptorSetLayoutCreateFlags GetDescriptorSetLayoutFlags() const;
+		VkPipelineCreateFlags GetPipelineCreateFlags() const;
+
+		// VK_KHR_push_descriptor, with descriptor buffers it also needs descriptorBufferPushDescriptors
+		bool SupportsPushDescriptors() const { return m_vkCmdPushDescriptorSet != nullptr; }
+		// Descriptors a single push descriptor set may hold, 0 without push descriptor support
+		uint32_t GetMaxPushDescriptors() const { return m_MaxPushDescriptors; }
+		void CmdPushDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set,
+			uint32_t writeCount, const VkWriteDescriptorSet* pWrites) const;
+		void CmdPushDescriptorSetWithTemplate(VkCommandBuffer commandBuffer, VkDescriptorUpdateTemplate updateTemplate, VkPipelineLayout layout,
+			uint32_t set, const void* pData) const;
+
+		// Optional extensions are enabled only when the physical device supports them
+		bool IsExtensionEnabled(const std::string& extensionName) const { return m_EnabledOptionalExtensions.contains(extensionName); }
+		const VkPhysicalDeviceFeatures& GetEnabledFeatures() const { return m_EnabledFeatures; }
+
+		// Device-wide timeline on the graphics queue, frames and single-time submits all signal it
+		TimelineSemaphore& GetTimeline() const { return *m_pTimeline; }
+		// Signaled by submissions on the compute queue only
+		TimelineSemaphore& GetComputeTimeline() const { return *m_pComputeTimeline; }
+		TimelineSemaphore& GetTransferTimeline() const { return *m_pTransferTimeline; }
+		TimelineSemaphore& GetTimeline(QueueType queueType) const;
+
+		// Runs destroyFn once the next frame submission (and everything submitted before it) has finished.
+		// Thread safe, destroyFn runs on the thread calling CollectGarbage.
+		void DeferDestroy(std::function<void()>&& destroyFn);
+		void OnFrameSubmitted(uint64_t timelineValue);
+		void CollectGarbage();
 
 		static bool HasStencilComponent(VkFormat format);
 		bool CheckDeviceExtensionSupport(VkPhysicalDevice device) const;
@@ -141,6 +246,8 @@ namespace RUBY
 		void PickPhysicalDevice();
 		void CreateLogicalDevice();
 		void SetupVMA();
+		bool SupportsDescriptorBuffers(const std::vector<VkExtensionProperties>& availableExtensions, VkBool32& outPushDescriptors) const;
+		std::mutex& GetQueueMutex(VkQueue queue) const;
 
 		IRubyWindow* m_pWindow;
 
@@ -153,13 +260,47 @@ namespace RUBY
 
 		VkQueue m_GraphicsQueue{};
 		VkQueue m_PresentQueue{};
+		VkQueue m_ComputeQueue{};
+		VkQueue m_TransferQueue{};
+		// One per queue above, aliased queues use the lock of the first one
+		mutable std::array<std::mutex, 4> m_QueueMutexes;
+
+		QueueFamilyIndices m_QueueFamilyIndices{};
 
 		VmaAllocator m_Allocator{};
 
 		const std::vector<const char*> m_ValidationLayers = { "VK_LAYER_KHRONOS_validation" };
-		const std::vector<const char*> m_DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+		std::vector<const char*> m_DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+		const std::vector<const char*> m_OptionalDeviceExtensions = { VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME, VK_KHR_MAINTENANCE_5_EXTENSION_NAME, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME };
+		std::set<std::string> m_EnabledOptionalExtensions;
 
-		DeviceDebugger* m_pDebugger{};
+		VkPhysicalDeviceFeatures m_EnabledFeatures{};
+		DescriptorBackend m_DescriptorBackend{ DescriptorBackend::Pools };
+		std::filesystem::path m_LeakDumpPath;
+
+		PFN_vkCmdPushDescriptorSetKHR m_vkCmdPushDescriptorSet{};
+		PFN_vkCmdPushDescriptorSetWithTemplateKHR m_vkCmdPushDescriptorSetWithTemplate{};
+		uint32_t m_MaxPushDescriptors{ 0 };
 
+		DeviceDebugger* m_pDebugger{};
+		std::unique_ptr<MemoryTracker> m_pMemoryTracker;
+		std::unique_ptr<Defragmenter> m_pDefragmenter;
+
+		std::unique_ptr<TimelineSemaphore> m_pTimeline;
+		std::unique_ptr<TimelineSemaphore> m_pComputeTimeline;
+		std::unique_ptr<TimelineSemaphore> m_pTransferTimeline;
+		std::unique_ptr<PipelineCache> m_pPipelineCache;
+		std::unique_ptr<ShaderCache> m_pShaderCache;
+		std::unique_ptr<DescriptorBuffer> m_pDescriptorBuffer;
+		std::unique_ptr<BindlessHeap> m_pBindlessHeap;
+
+		struct DeferredDestroy
+		{
+			uint64_t timelineValue;
+			std::function<void()> destroyFn;
+		};
+		std::mutex m_PendingDestroysMutex;
+		std::vector<std::function<void()>> m_PendingDestroys;
+		std::deque<DeferredDestroy> m_DeferredDestroys;
 	};
 }
@@ -0,0 +1,81 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/Buffer.h"
+#include "Vulkan/CommandPool.h"
+#include "Vulkan/Device.h"
+
+namespace RUBY
+{
+	// Everything one frame in flight owns: its command pool, WSI semaphores, the timeline value it signaled,
+	// upload staging and transient allocations. Begin() waits for the previous use of the slot to retire
+	// and recycles all of it in one go.
+	class FrameContext
+	{
+	public:
+		static constexpr uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+		static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+		// workerCount per-thread pools are created for secondary command buffers recorded on a ThreadPool
+		FrameContext(Device* pDevice, uint32_t frameIndex, uint32_t workerCount = 0);
+		~FrameContext();
+
+		FrameContext(const FrameContext&) = delete;
+		FrameContext(FrameContext&&) = delete;
+		FrameContext& operator=(const FrameContext&) = delete;
+		FrameContext& operator=(FrameContext&&) = delete;
+
+		void Begin();
+
+		uint32_t GetFrameIndex() const { return m_FrameIndex; }
+
+		CommandPool& GetCommandPool() { return *m_pCommandPool; }
+		VkCommandBuffer GetCommandBuffer() const { return m_pCommandPool->GetCommandBuffers()[0]; }
+
+		// Extra primary buffers for work the RenderGraph submits separately from the frame's main buffer
+		VkCommandBuffer AcquireCommandBuffer(QueueType queueType);
+
+		// Only call from the worker owning workerIndex, the pools are not synchronized
+		VkCommandBuffer AcquireSecondaryCommandBuffer(uint32_t workerIndex);
+		uint32_t GetWorkerCount() const { return static_cast<uint32_t>(m_WorkerCommandPools.size()); }
+
+		VkSemaphore GetImageAvailableSemaphore() const { return m_ImageAvailableSemaphore; }
+		VkSemaphore GetRenderFinishedSemaphore() const { return m_RenderFinishedSemaphore; }
+
+		uint64_t GetTimelineValue() const { return m_TimelineValue; }
+		void SetTimelineValue(uint64_t value) { m_TimelineValue = value; }
+
+		// Last compute-queue submission made on behalf of this frame, Begin() waits for it as well
+		uint64_t GetComputeTimelineValue() const { return m_ComputeTimelineValue; }
+		void SetComputeTimelineValue(uint64_t value) { m_ComputeTimelineValue = value; }
+
+		// Host visible source buffer for copies recorded into this frame, freed once the frame retires
+		Buffer& AllocateStaging(VkDeviceSize size);
+
+		// Runs releaseFn the next time this slot is reused, i.e. after this frame's GPU work finished
+		void DeferRelease(std::function<void()>&& releaseFn);
+
+	private:
+		void Release();
+
+		Device* m_pDevice{};
+		uint32_t m_FrameIndex{};
+
+		std::unique_ptr<CommandPool> m_pCommandPool;
+		std::unique_ptr<CommandPool> m_pComputeCommandPool;
+		std::vector<std::unique_ptr<CommandPool>> m_WorkerCommandPools;
+
+		VkSemaphore m_ImageAvailableSemaphore{ VK_NULL_HANDLE };
+		VkSemaphore m_RenderFinishedSemaphore{ VK_NULL_HANDLE };
+		uint64_t m_TimelineValue{ 0 };
+		uint64_t m_ComputeTimelineValue{ 0 };
+
+		// deque so handed out references stay valid while more staging is allocated
+		std::deque<Buffer> m_StagingBuffers;
+		std::vector<std::function<void()>> m_DeferredReleases;
+	};
+}
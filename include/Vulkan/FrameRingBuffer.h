@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/Buffer.h"
+#include "Vulkan/Device.h"
+
+namespace RUBY
+{
+	// Sub-allocation of the ring, valid until the frame that made it retires
+	struct RingAllocation
+	{
+		VkBuffer buffer{ VK_NULL_HANDLE };
+		VkDeviceSize offset{ 0 };
+		VkDeviceSize size{ 0 };
+		void* pData{ nullptr };
+
+		// For VK_DESCRIPTOR_TYPE_*_BUFFER_DYNAMIC bound at offset 0 of the ring
+		uint32_t GetDynamicOffset() const { return static_cast<uint32_t>(offset); }
+		VkDescriptorBufferInfo GetDescriptorInfo() const { return { buffer, offset, size }; }
+	};
+
+	// One persistently mapped buffer split into a segment per frame in flight, allocating is an atomic pointer
+	// bump. BeginFrame rewinds the segment of a slot whose previous use already retired (after FrameContext::Begin),
+	// Flush makes the writes visible before the frame is submitted when the memory isn't coherent.
+	// Prefers host visible device local memory (resizable BAR), falls back to host memory.
+	class FrameRingBuffer
+	{
+	public:
+		static constexpr VkDeviceSize DEFAULT_FRAME_SIZE = 8ull * 1024 * 1024;
+
+		FrameRingBuffer(Device* pDevice, uint32_t frameCount, VkDeviceSize frameSize = DEFAULT_FRAME_SIZE);
+
+		FrameRingBuffer(const FrameRingBuffer&) = delete;
+		FrameRingBuffer(FrameRingBuffer&&) = delete;
+		FrameRingBuffer& operator=(const FrameRingBuffer&) = delete;
+		FrameRingBuffer& operator=(FrameRingBuffer&&) = delete;
+
+		void BeginFrame(uint32_t frameIndex);
+		void Flush();
+
+		// Thread safe. alignment 0 satisfies uniform, storage and copy offsets alike.
+		RingAllocation Allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+		template<typename T>
+		RingAllocation Push(const T& data, VkDeviceSize alignment = 0)
+		{
+			RingAllocation allocation = Allocate(sizeof(T), alignment);
+			std::memcpy(allocation.pData, &data, sizeof(T));
+			return allocation;
+		}
+
+		VkBuffer GetBuffer() const { return m_pBuffer->GetBuffer(); }
+		VkDeviceSize GetFrameSize() const { return m_FrameSize; }
+		VkDeviceSize GetFrameUsage() const { return m_Head.load(std::memory_order_relaxed) - m_FrameBegin; }
+		bool IsDeviceLocal() const { return (m_pBuffer->GetMemoryProperties() & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0; }
+
+	private:
+		Device* m_pDevice{};
+		std::unique_ptr<Buffer> m_pBuffer;
+		uint32_t m_FrameCount{};
+		VkDeviceSize m_FrameSize{};
+		VkDeviceSize m_DefaultAlignment{ 16 };
+
+		VkDeviceSize m_FrameBegin{ 0 };
+		VkDeviceSize m_FrameEnd{ 0 };
+		std::atomic<VkDeviceSize> m_Head{ 0 };
+	};
+}
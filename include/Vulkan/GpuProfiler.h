@@ -0,0 +1,140 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/Device.h"
+
+namespace RUBY
+{
+	struct GpuPipelineStatistics
+	{
+		uint64_t inputAssemblyVertices{ 0 };
+		uint64_t inputAssemblyPrimitives{ 0 };
+		uint64_t vertexShaderInvocations{ 0 };
+		uint64_t clippingPrimitives{ 0 };
+		uint64_t fragmentShaderInvocations{ 0 };
+		uint64_t computeShaderInvocations{ 0 };
+	};
+
+	struct GpuScopeResult
+	{
+		std::string name;
+		uint32_t depth{ 0 };
+		double gpuMilliseconds{ 0.0 };
+
+		// steady_clock nanoseconds, only valid when the profiler is calibrated
+		int64_t cpuBeginNanoseconds{ 0 };
+		int64_t cpuEndNanoseconds{ 0 };
+
+		bool hasStatistics{ false };
+		GpuPipelineStatistics statistics{};
+	};
+
+	// Rolling statistics over the last HISTORY_SIZE resolved frames
+	struct GpuScopeSummary
+	{
+		uint32_t sampleCount{ 0 };
+		double averageMilliseconds{ 0.0 };
+		double minMilliseconds{ 0.0 };
+		double maxMilliseconds{ 0.0 };
+		double p50Milliseconds{ 0.0 };
+		double p95Milliseconds{ 0.0 };
+		double p99Milliseconds{ 0.0 };
+	};
+
+	// Timestamp and pipeline-statistics queries around named scopes, one set of query pools per frame slot.
+	// A slot is read back when BeginFrame reuses it, by then its timeline value has completed so reading
+	// never stalls. Scopes are recorded on the primary command buffer from the thread driving the frame.
+	class GpuProfiler
+	{
+	public:
+		static constexpr uint32_t MAX_SCOPES_PER_FRAME = 256;
+		static constexpr uint32_t HISTORY_SIZE = 240;
+		static constexpr VkQueryPipelineStatisticFlags PIPELINE_STATISTICS =
+			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+		GpuProfiler(Device* pDevice, uint32_t slotCount);
+		~GpuProfiler();
+
+		GpuProfiler(const GpuProfiler&) = delete;
+		GpuProfiler(GpuProfiler&&) = delete;
+		GpuProfiler& operator=(const GpuProfiler&) = delete;
+		GpuProfiler& operator=(GpuProfiler&&) = delete;
+
+		// False when the graphics queue has no timestamp support, every call is a no-op then
+		bool IsSupported() const { return m_TimestampValidBits != 0; }
+		bool HasPipelineStatistics() const { return m_HasPipelineStatistics; }
+		bool IsCalibrated() const { return m_HasCalibration; }
+
+		void SetEnabled(bool enabled) { m_IsEnabled = enabled; }
+		bool IsEnabled() const { return m_IsEnabled; }
+
+		// Resolves the slot's previous results, its timeline value must have completed
+		void BeginFrame(uint32_t slot);
+		void EndFrame(uint64_t timelineValue);
+
+		// Scopes nest, pipeline statistics are only gathered for the outermost scope that asks for them
+		void BeginScope(VkCommandBuffer commandBuffer, const std::string& name, bool collectStatistics = true);
+		void EndScope(VkCommandBuffer commandBuffer);
+
+		const std::vector<GpuScopeResult>& GetLatestResults() const { return m_LatestResults; }
+		double GetScopeMilliseconds(const std::string& name) const;
+		GpuScopeSummary GetScopeSummary(const std::string& name) const;
+
+	private:
+		struct Scope
+		{
+			std::string name;
+			uint32_t depth;
+			uint32_t firstTimestamp;
+			uint32_t statisticsQuery;	// ~0u when not collected
+			bool isClosed;
+		};
+
+		struct FrameSlot
+		{
+			VkQueryPool timestampPool{ VK_NULL_HANDLE };
+			VkQueryPool statisticsPool{ VK_NULL_HANDLE };
+			std::vector<Scope> scopes;
+			uint32_t timestampCount{ 0 };
+			uint32_t statisticsCount{ 0 };
+			uint64_t timelineValue{ 0 };
+			bool hasPendingResults{ false };
+		};
+
+		void Resolve(FrameSlot& slot);
+		void Calibrate();
+		int64_t ToCpuNanoseconds(uint64_t gpuTicks) const;
+
+		Device* m_pDevice{};
+		std::vector<FrameSlot> m_Slots;
+		FrameSlot* m_pCurrentSlot{ nullptr };
+		std::vector<uint32_t> m_OpenScopes;
+		uint32_t m_OpenStatisticsScope{ ~0u };
+
+		uint32_t m_TimestampValidBits{ 0 };
+		double m_TimestampPeriod{ 1.0 };	// nanoseconds per tick
+		bool m_HasPipelineStatistics{ false };
+		bool m_IsEnabled{ true };
+
+		// VK_EXT_calibrated_timestamps
+		PFN_vkGetCalibratedTimestampsEXT m_vkGetCalibratedTimestamps{ nullptr };
+		VkTimeDomainEXT m_HostTimeDomain{ VK_TIME_DOMAIN_DEVICE_EXT };
+		bool m_HasCalibration{ false };
+		uint64_t m_CalibrationGpuTicks{ 0 };
+		int64_t m_CalibrationCpuNanoseconds{ 0 };
+
+		std::vector<GpuScopeResult> m_LatestResults;
+		std::unordered_map<std::string, std::deque<double>> m_History;
+	};
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "Vulkan/IRubyWindow.h"
+
+namespace RUBY
+{
+	// Window backend for machines without a display.
+	// Creates a VK_EXT_headless_surface when the loader exposes it, otherwise no surface at all,
+	// in which case the SwapChain falls back to its offscreen image ring.
+	class HeadlessWindow final : public IRubyWindow
+	{
+	public:
+		HeadlessWindow(const std::string& name, int width, int height, bool useHeadlessSurface = true);
+		~HeadlessWindow() override = default;
+
+		HeadlessWindow(const HeadlessWindow&) = delete;
+		HeadlessWindow(HeadlessWindow&&) = delete;
+		HeadlessWindow& operator=(const HeadlessWindow&) = delete;
+		HeadlessWindow& operator=(HeadlessWindow&&) = delete;
+
+		const std::string& GetWindowName() override { return m_Name; }
+
+		void PollEvents() override {}
+		bool ShouldClose() const override { return m_ShouldClose; }
+		void RequestClose() { m_ShouldClose = true; }
+
+		int GetWidth() const override { return m_Width; }
+		int GetHeight() const override { return m_Height; }
+		void Resize(int width, int height);
+
+		bool IsResized() const override { return m_Resized; }
+		void SetResized() override { m_Resized = true; }
+
+		void WaitForEvents() const override {}
+		void GetFramebufferSize(int* width, int* height) const override;
+
+		std::vector<const char*> GetRequiredInstanceExtensions() const override;
+		void CreateVkSurface(Instance& instance, VkSurfaceKHR* vkSurface) const override;
+
+	private:
+		static bool IsHeadlessSurfaceSupported();
+
+		std::string m_Name;
+		int m_Width{};
+		int m_Height{};
+
+		bool m_UseHeadlessSurface{ true };
+		bool m_Resized{ false };
+		bool m_ShouldClose{ false };
+	};
+}
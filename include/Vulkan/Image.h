@@ -9,6 +9,7 @@ using VmaAllocation = VmaAllocation_T*;
 namespace RUBY
 {
 	class CommandPool;
+	class Defragmenter;
 
 	class Image
 	{
@@ -45,6 +46,8 @@ namespace RUBY
 		Image(const Device* pDevice, const CommandPool* pCommandPool, const ImageCreateInfo& imageCreate);
 		Image(const Device* pDevice, const CommandPool* pCommandPool, const VkImageCreateInfo& vkImageCreateInfo, const VkMemoryPropertyFlags& properties, const VkFormat& format, const VkImageAspectFlags& aspectFlags);
 		Image(const Device* pDevice, const CommandPool* pCommandPool, VkImage image, const VkFormat& format, const VkImageAspectFlags& aspectFlags);
+		// Placed in memory owned by someone else (vmaCreateAliasingImage), destroying the Image leaves the memory alone
+		Image(const Device* pDevice, const CommandPool* pCommandPool, const VkImageCreateInfo& vkImageCreateInfo, VmaAllocation aliasedMemory, const VkImageAspectFlags& aspectFlags);
 
 		~Image();
 
@@ -57,6 +60,29 @@ namespace RUBY
 		VkImageView GetImageView() const { return m_ImageView; }
 		VmaAllocation GetImageAllocation() const { return m_ImageAllocation; }
 		VkImageLayout GetImageLayout() const { return m_ImageLayout; }
+		VkImageAspectFlags GetAspectFlags() const { return m_ImageAspectFlags; }
+		// Zeroed for images wrapping a VkImage created elsewhere (swapchain images)
+		VkExtent3D GetExtent() const { return m_CreateInfo.extent; }
+		uint32_t GetMipLevels() const { return m_CreateInfo.mipLevels; }
+		uint32_t GetArrayLayers() const { return m_CreateInfo.arrayLayers; }
+		// Slots in the device BindlessHeap, BindlessHeap::INVALID_INDEX until RegisterBindless or when the usage lacks
+		// SAMPLED/STORAGE
+		uint32_t GetBindlessIndex() const { return m_SampledIndex; }
+		uint32_t GetStorageBindlessIndex() const { return m_StorageIndex; }
+		// Opt-in, takes a slot per SAMPLED/STORAGE usage and hands them back on destruction. Does nothing for slots
+		// already taken, throws when the heap is full.
+		void RegisterBindless();
+
+		// Debug name of the VkImage and, for images owning their memory, name of the allocation in the MemoryTracker
+		void SetName(const std::string& name) const;
+
+		// Lets the Defragmenter move the image, GetImage and GetImageView change when it does while the bindless indices stay.
+		// Only for images owning their memory, created with TRANSFER_SRC and TRANSFER_DST usage.
+		void SetRelocatable(bool relocatable);
+		bool IsRelocatable() const { return m_IsRelocatable; }
+
+		// For barriers recorded outside TransitionImageLayout (e.g. batched by the RenderGraph)
+		void SetImageLayout(VkImageLayout layout) { m_ImageLayout = layout; }
 
 		void CleanupImageView();
 		//void RecreateImageView();
@@ -65,7 +91,17 @@ namespace RUBY
 		void TransitionImageLayout(VkCommandBuffer& commandBuffer, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
 		void TransitionImageLayout(VkCommandBuffer& commandBuffer, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout,VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask, VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkImageAspectFlags imageAspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
 
+		// Queue family ownership transfer. Record the release on the source queue and the acquire, with the same
+		// families and layouts, on the destination queue; a semaphore between the two submissions orders them.
+		void ReleaseOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkImageLayout newLayout,
+			VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess) const;
+		void AcquireOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+
+		// Submits and waits on its own, ImmediateContext::CopyBufferToImage batches instead
 		void CopyBufferToImage(VkBuffer buffer, uint32_t width, uint32_t height) const;
+		// Only records, buffer has to outlive the command buffer's execution
+		void CopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t width, uint32_t height) const;
 		void CreateImageView(VkFormat format, VkImageAspectFlags aspectFlags);
 
 		static TransitionInfo GetTransitionInfo(VkImageLayout oldLayout, VkImageLayout newLayout, VkFormat format);
@@ -73,9 +109,13 @@ namespace RUBY
 		VkFormat GetFormat() const { return m_Format; }
 
 	private:
+		friend class Defragmenter;
 
 		void CreateImage(const ImageCreateInfo& imageCreateInfo);
 		void CreateImage(const VkImageCreateInfo& imageCreateInfo, const VkMemoryPropertyFlags& properties);
+		void ReleaseBindless();
+		// Swaps in an image bound to the new memory, recreates the view and rewrites the bindless slots
+		void Relocate(VkImage newImage, VkImage& outOldImage, VkImageView& outOldView);
 
 	protected:
 		const Device* m_pDevice;
@@ -88,5 +128,12 @@ namespace RUBY
 		VkFormat m_Format{};
 		VkImageLayout m_ImageLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
 		VkImageAspectFlags m_ImageAspectFlags{ VK_IMAGE_ASPECT_COLOR_BIT };
+		bool m_IsAliased{ false };
+		// What the image was created with, recreating it during relocation needs it
+		VkImageCreateInfo m_CreateInfo{};
+		bool m_IsRelocatable{ false };
+
+		uint32_t m_SampledIndex{ UINT32_MAX };
+		uint32_t m_StorageIndex{ UINT32_MAX };
 	};
 }
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/CommandPool.h"
+
+namespace RUBY
+{
+	class Buffer;
+	class Image;
+
+	// Scope that batches transfers on a CommandPool into one command buffer, submitted once by Submit.
+	// Only work recorded through the context joins the batch: its Copy* functions and GetCommandBuffer.
+	// Buffer::CopyBuffer, Image::CopyBufferToImage and other single-time commands still submit on their own.
+	// Copy sources have to be owned by the context (AllocateStaging or Adopt) so they live until the GPU is done.
+	// Nested contexts on the same pool fold into the outermost one. Not thread safe, like the pool itself.
+	//
+	//	ImmediateContext context{ &commandPool };
+	//	Buffer& staging = context.AllocateStaging(size);
+	//	staging.CopyMemory(pData, size);
+	//	context.CopyBuffer(staging, vertexBuffer, size);
+	//	VkCommandBuffer commandBuffer = context.GetCommandBuffer();
+	//	image.TransitionImageLayout(commandBuffer, format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	//	context.Submit();	// one submit, one wait
+	class ImmediateContext
+	{
+	public:
+		explicit ImmediateContext(CommandPool* pCommandPool);
+		// Contexts should be submitted explicitly, one that wasn't is submitted here and errors are only logged
+		~ImmediateContext() noexcept;
+
+		ImmediateContext(const ImmediateContext&) = delete;
+		ImmediateContext(ImmediateContext&&) = delete;
+		ImmediateContext& operator=(const ImmediateContext&) = delete;
+		ImmediateContext& operator=(ImmediateContext&&) = delete;
+
+		VkCommandBuffer GetCommandBuffer() const { return m_CommandBuffer; }
+
+		// Host visible transfer source that lives until the batch finished on the GPU
+		Buffer& AllocateStaging(VkDeviceSize size);
+		// Takes ownership of a transfer source, released once the batch finished on the GPU
+		Buffer& Adopt(std::unique_ptr<Buffer> pSource);
+
+		// Throw when source isn't owned by the context
+		void CopyBuffer(const Buffer& source, const Buffer& destination, VkDeviceSize size) const;
+		void CopyBufferToImage(const Buffer& source, const Image& destination, uint32_t width, uint32_t height) const;
+
+		// Returns the timeline value of the pool's queue to wait on, 0 when an outer context submits the work
+		// instead. With wait == false the CPU carries on while the GPU copies.
+		uint64_t Submit(bool wait = true);
+
+	private:
+		void CheckSource(const Buffer& source) const;
+
+		CommandPool* m_pCommandPool;
+		VkCommandBuffer m_CommandBuffer;
+		bool m_IsSubmitted{ false };
+	};
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class VmaAllocation_T;
+using VmaAllocation = VmaAllocation_T*;
+
+namespace RUBY
+{
+	class Device;
+
+	enum class MemoryCategory
+	{
+		Buffer,
+		Staging,		// host visible upload/readback memory
+		Image,
+		RenderTarget,	// attachments, render graph transients included
+		Count,
+	};
+
+	// Budget and usage of one VkMemoryHeap. budget is what the OS lets this process use before it starts paging,
+	// it is an estimate (80% of the heap size) when VK_EXT_memory_budget is missing.
+	struct HeapBudget
+	{
+		VkMemoryHeapFlags flags{ 0 };
+		VkDeviceSize size{ 0 };
+		VkDeviceSize budget{ 0 };
+		VkDeviceSize usage{ 0 };			// whole process, other allocators included
+		VkDeviceSize blockBytes{ 0 };		// VkDeviceMemory allocated by VMA
+		VkDeviceSize allocationBytes{ 0 };	// part of blockBytes handed out to resources
+		uint32_t allocationCount{ 0 };
+	};
+
+	struct CategoryUsage
+	{
+		VkDeviceSize bytes{ 0 };
+		uint32_t allocationCount{ 0 };
+	};
+
+	// Memory telemetry of the device allocator. Buffer, Image and the RenderGraph track every allocation they make
+	// with a category and a name, the name also ends up in the VMA JSON dump. Whatever is still tracked when the
+	// Device shuts down is reported as a leak. Thread safe.
+	class MemoryTracker
+	{
+	public:
+		static constexpr size_t CATEGORY_COUNT = static_cast<size_t>(MemoryCategory::Count);
+
+		explicit MemoryTracker(const Device* pDevice);
+
+		MemoryTracker(const MemoryTracker&) = delete;
+		MemoryTracker(MemoryTracker&&) = delete;
+		MemoryTracker& operator=(const MemoryTracker&) = delete;
+		MemoryTracker& operator=(MemoryTracker&&) = delete;
+
+		void Track(VmaAllocation allocation, MemoryCategory category, const std::string& name);
+		void SetName(VmaAllocation allocation, const std::string& name);
+		// Before the allocation is freed
+		void Untrack(VmaAllocation allocation);
+
+		std::vector<HeapBudget> GetHeapBudgets() const;
+		std::array<CategoryUsage, CATEGORY_COUNT> GetCategoryUsage() const;
+		// True once a heap uses more than the given fraction of its budget, paging hitches follow soon after
+		bool IsOverBudget(float fraction = 0.9f) const;
+
+		// vmaBuildStatsString, the detailed map lists every allocation with its name
+		std::string BuildStatsJson(bool detailedMap = true) const;
+		bool WriteStatsJson(const std::filesystem::path& path, bool detailedMap = true) const;
+
+		// Prints every allocation still tracked, returns how many there were
+		size_t ReportLeaks() const;
+
+		static const char* GetCategoryName(MemoryCategory category);
+
+	private:
+		struct Entry
+		{
+			MemoryCategory category;
+			std::string name;
+			VkDeviceSize size;
+		};
+
+		const Device* m_pDevice{};
+
+		mutable std::mutex m_Mutex;
+		std::unordered_map<VmaAllocation, Entry> m_Allocations;
+	};
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Core/ThreadPool.h"
+#include "Vulkan/Device.h"
+#include "Vulkan/FrameContext.h"
+
+namespace RUBY
+{
+	// Attachment formats the secondaries inherit from the dynamic rendering scope they execute in
+	struct SecondaryRenderingState
+	{
+		std::vector<VkFormat> colorFormats;
+		VkFormat depthFormat{ VK_FORMAT_UNDEFINED };
+		VkFormat stencilFormat{ VK_FORMAT_UNDEFINED };
+		VkSampleCountFlagBits samples{ VK_SAMPLE_COUNT_1_BIT };
+	};
+
+	// Splits a dynamic rendering scope into chunks that are recorded into secondary command buffers on the
+	// thread pool, then executed in chunk order so the result does not depend on thread scheduling.
+	// Secondaries start without any bound state: every chunk binds its own pipeline, viewport and scissor.
+	class ParallelCommandRecorder
+	{
+	public:
+		using RecordFn = std::function<void(VkCommandBuffer commandBuffer, uint32_t chunkIndex)>;
+
+		ParallelCommandRecorder(const Device* pDevice, ThreadPool* pThreadPool) : m_pDevice(pDevice), m_pThreadPool(pThreadPool) {}
+
+		ThreadPool& GetThreadPool() { return *m_pThreadPool; }
+
+		// Begins rendering on primaryCommandBuffer with renderingInfo, records chunkCount chunks in parallel
+		// and ends rendering again. renderingInfo.flags gets the secondary-contents bit added.
+		void RecordRendering(VkCommandBuffer primaryCommandBuffer, FrameContext& frame,
+			const VkRenderingInfo& renderingInfo, const SecondaryRenderingState& state,
+			uint32_t chunkCount, const RecordFn& recordFn);
+
+	private:
+		const Device* m_pDevice{};
+		ThreadPool* m_pThreadPool{};
+	};
+}
@@ -3,25 +3,36 @@
 #include "Vulkan/Device.h"
 #include "Vulkan/SwapChain.h"
 #include "Vulkan/Shader.h"
+#include "Vulkan/Passes/IBasePass.h"
 
 namespace RUBY
 {
-    class DemoPass
+    class DemoPass final : public IBasePass
     {
     public:
         DemoPass(Device* device, SwapChain* swapchain);
-        ~DemoPass();
+        ~DemoPass() override;
 
-        void Record(VkCommandBuffer cmd, uint32_t imageIndex);
-        void Recreate(SwapChain* swapchain);
+        void Setup(RenderGraphBuilder& builder) override;
+        void CreateDescriptorSets() override {}
+        void Update(uint32_t) override {}
+        void OnResize() override;
+
+        void RecordCommandBuffer(VkCommandBuffer cmd, uint32_t imageIndex, PassContext& passContext) override;
 
     private:
         void CreateGraphicsPipeline();
+        void DestroyGraphicsPipeline();
 
         Device* m_Device;
         SwapChain* m_SwapChain;
 
+        std::shared_ptr<const ShaderModule> m_pVertexShader;
+        std::shared_ptr<const ShaderModule> m_pFragmentShader;
+
         VkPipelineLayout m_PipelineLayout = VK_NULL_HANDLE;
         VkPipeline m_Pipeline = VK_NULL_HANDLE;
+        // Format the pipeline was built for, the extent is dynamic state
+        VkFormat m_ColorFormat = VK_FORMAT_UNDEFINED;
     };
 }
\ No newline at end of file
@@ -4,23 +4,57 @@
 
 namespace RUBY
 {
+	class DescriptorAllocator;
+	class FrameContext;
+	class FrameRingBuffer;
+	class GpuProfiler;
+	class ParallelCommandRecorder;
+	class RenderGraph;
+	class RenderGraphBuilder;
+
 	struct PassContext
 	{
 		Device* pDevice;
 		CommandPool* pCommandPool;
 		SwapChain* pSwapChain;
+		RenderGraph* pRenderGraph;
+		FrameContext* pFrame;
+		ParallelCommandRecorder* pCommandRecorder;
+		GpuProfiler* pGpuProfiler;
+		FrameRingBuffer* pFrameRing;
+		DescriptorAllocator* pDescriptorAllocator;
 	};
 
 	class IBasePass
 	{
 	public:
 		virtual ~IBasePass() = default;
+
+		// Declares the images the pass creates, reads and writes, called on every RenderGraph::Compile
+		virtual void Setup(RenderGraphBuilder& builder) = 0;
+
+		// Compute passes are recorded into their own submission on the compute queue, the RenderGraph adds the
+		// semaphores and queue family ownership transfers around them
+		virtual QueueType GetQueueType() const { return QueueType::Graphics; }
+
 		virtual void CreateDescriptorSets() = 0;
 
 		virtual void Update(uint32_t imageIndex) = 0;
+		// Called after the swapchain was recreated. Pipelines keep viewport and scissor dynamic, so only a change
+		// of attachment formats should make a pass rebuild them.
 		virtual void OnResize() = 0;
 
 		virtual void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, PassContext& passContext) = 0;
+
+	protected:
+		// Covers the whole render area, for pipelines with VK_DYNAMIC_STATE_VIEWPORT and VK_DYNAMIC_STATE_SCISSOR
+		static void SetViewportAndScissor(VkCommandBuffer commandBuffer, VkExtent2D extent)
+		{
+			const VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+			const VkRect2D scissor{ { 0, 0 }, extent };
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		}
 	};
 }
 
@@ -1,14 +1,38 @@
 #pragma once
 #include <vulkan/vulkan.h>
+#include <future>
+#include <memory>
 #include <vector>
 
 #include "Vulkan/DescriptorPool.h"
 #include "Vulkan/SwapChain.h"
 #include "Vulkan/Device.h"
 #include "Vulkan/Shader.h"
+#include "Vulkan/ShaderReflection.h"
+#include "Vulkan/SpecializationConstants.h"
 
 namespace RUBY
 {
+    class ThreadPool;
+    class PipelineRegistry;
+
+    // VkPipelineLayout shared between the pipelines PipelineRegistry hands out
+    class PipelineLayout
+    {
+    public:
+        PipelineLayout(Device* device, VkPipelineLayout layout) : m_Device(device), m_Layout(layout) {}
+        ~PipelineLayout();
+
+        PipelineLayout(const PipelineLayout&) = delete;
+        PipelineLayout& operator=(const PipelineLayout&) = delete;
+
+        VkPipelineLayout GetLayout() const { return m_Layout; }
+
+    private:
+        Device* m_Device{ nullptr };
+        VkPipelineLayout m_Layout{ VK_NULL_HANDLE };
+    };
+
     class Pipeline
     {
     public:
@@ -29,6 +53,10 @@ namespace RUBY
             const VkPipelineDynamicStateCreateInfo& dynamicState,
             VkPipelineRenderingCreateInfo renderingInfo,
             const std::vector<VkPushConstantRange>& pushConstants);
+        // Takes ownership of handles created elsewhere (PipelineBuilder::BuildBatch)
+        Pipeline(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, VkPipeline pipeline, VkPipelineLayout layout);
+        // Takes ownership of the pipeline only, the layout stays alive as long as one of its users does
+        Pipeline(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, VkPipeline pipeline, std::shared_ptr<const PipelineLayout> layout);
 
         Pipeline(const Pipeline&) = delete;
         Pipeline& operator=(const Pipeline&) = delete;
@@ -48,12 +76,47 @@ namespace RUBY
 
         VkPipeline m_Pipeline{ VK_NULL_HANDLE };
         VkPipelineLayout m_Layout{ VK_NULL_HANDLE };
+        std::shared_ptr<const PipelineLayout> m_pSharedLayout;
+    };
+
+    // Handle to a pipeline compiling on a ThreadPool, polled by the render thread
+    class AsyncPipeline
+    {
+    public:
+        AsyncPipeline() = default;
+
+        bool IsReady() const;
+        // The compiled pipeline once ready, the fallback (possibly nullptr) until then. Rethrows compile errors.
+        const Pipeline* Get() const;
+        const Pipeline& Wait() const;
+
+    private:
+        friend class PipelineBuilder;
+        using Batch = std::vector<Pipeline>;
+
+        AsyncPipeline(std::shared_future<std::shared_ptr<Batch>> future, uint32_t index, const Pipeline* pFallback)
+            : m_Future(std::move(future)), m_Index(index), m_pFallback(pFallback) {}
+
+        std::shared_future<std::shared_ptr<Batch>> m_Future;
+        uint32_t m_Index{ 0 };
+        const Pipeline* m_pFallback{ nullptr };
     };
 
     class PipelineBuilder
     {
     public:
-        PipelineBuilder& AddShader(const Shader& shader);
+        PipelineBuilder() = default;
+        // Copies re-point the create-info structs at their own storage, so a builder can serve as the base of variants
+        PipelineBuilder(const PipelineBuilder& other);
+        PipelineBuilder& operator=(const PipelineBuilder& other);
+        PipelineBuilder(PipelineBuilder&&) noexcept = default;
+        PipelineBuilder& operator=(PipelineBuilder&&) noexcept = default;
+
+        // Also merges the shader's reflected interface into GetReflection()
+        PipelineBuilder& AddShader(const Shader& shader, SpecializationConstants specialization = {});
+        // Replaces the constants of every added stage in stages, e.g. on a copy of a base builder.
+        // PipelineRegistry keys on the constant values, so each variant compiles once.
+        PipelineBuilder& SetSpecialization(VkShaderStageFlags stages, SpecializationConstants specialization);
         PipelineBuilder& SetVertexInput(const VkPipelineVertexInputStateCreateInfo& vertexInput);
         PipelineBuilder& SetInputAssembly(const VkPipelineInputAssemblyStateCreateInfo& inputAssembly);
         PipelineBuilder& SetViewportState(const VkPipelineViewportStateCreateInfo& viewportState);
@@ -64,15 +127,45 @@ namespace RUBY
         PipelineBuilder& SetDynamicState(const VkPipelineDynamicStateCreateInfo& dynamicState);
         PipelineBuilder& SetRenderingInfo(const VkPipelineRenderingCreateInfo& renderingInfo);
         PipelineBuilder& AddPushConstant(const VkPushConstantRange& pushConstant);
+        // Marks a set of the reflected interface as pushed per draw, the DescriptorPool made from GetReflection()
+        // then creates its layout with the push descriptor flag and reserves no pool space for it
+        PipelineBuilder& SetPushDescriptorSet(uint32_t set);
         PipelineBuilder& SetColorAttachmentFormats(const std::vector<VkFormat>& formats);
 
+        // Union of all added shaders, pass it to DescriptorPool for layouts matching the shaders exactly
+        const ShaderReflection& GetReflection() const { return m_Reflection; }
+        // Ranges added with AddPushConstant, the reflected ones when there are none
+        const std::vector<VkPushConstantRange>& GetPushConstantRanges() const;
+
         Pipeline Build(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool);
 
+        // All builders in one vkCreateGraphicsPipelines call
+        static std::vector<Pipeline> BuildBatch(std::vector<PipelineBuilder>& builders, Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool);
+
+        // Compile on the pool's workers, batchSize builders per vkCreateGraphicsPipelines call. The builders are
+        // consumed; the shader modules, swapchain and descriptor pool they use must outlive the compilation.
+        // Pass a pool that records no frames (RUBY::GetCompileThreadPool), jobs on one queue run in order.
+        static AsyncPipeline BuildAsync(ThreadPool& threadPool, PipelineBuilder&& builder,
+            Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, const Pipeline* pFallback = nullptr);
+        static std::vector<AsyncPipeline> BuildAsync(ThreadPool& threadPool, std::vector<PipelineBuilder>&& builders,
+            Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, uint32_t batchSize = 8, const Pipeline* pFallback = nullptr);
+
+        // Viewport and scissor are dynamic state, width and height only fill the (ignored) static values
         static PipelineBuilder CreateDefault(uint32_t width, uint32_t height);
 
     private:
+        friend class PipelineRegistry;
+
+        void RebindOwnedPointers(const PipelineBuilder& source);
+        void PrepareRenderingInfo(SwapChain* swapChain);
+        VkGraphicsPipelineCreateInfo GetCreateInfo(VkPipelineLayout layout) const;
+
         // CreateInfo copies (the create-info structs will point to owned vectors below)
         std::vector<VkPipelineShaderStageCreateInfo> m_ShaderStages{};
+        // Parallel to m_ShaderStages, keeps pSpecializationInfo alive
+        std::vector<SpecializationConstants> m_Specializations{};
+        // Parallel to m_ShaderStages, Shader::GetCodeHash of each stage
+        std::vector<uint64_t> m_ShaderHashes{};
         VkPipelineVertexInputStateCreateInfo m_VertexInput{};
         VkPipelineInputAssemblyStateCreateInfo m_InputAssembly{};
         VkPipelineViewportStateCreateInfo m_ViewportState{};
@@ -83,6 +176,7 @@ namespace RUBY
         VkPipelineDynamicStateCreateInfo m_DynamicState{};
         VkPipelineRenderingCreateInfo m_RenderingInfo{};
         std::vector<VkPushConstantRange> m_PushConstants{};
+        ShaderReflection m_Reflection{};
 
         // Owned storage for arrays pointed to by create-info structs
         std::vector<VkViewport> m_Viewports;
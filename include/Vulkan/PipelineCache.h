@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace RUBY
+{
+	class Device;
+
+	// VkPipelineCache persisted between runs. Data written by a different driver, GPU or cache layout is
+	// discarded on load instead of being handed to the driver. Save() writes and syncs a temporary file and
+	// renames it over the old one, so a crash mid-write never leaves a truncated cache behind.
+	class PipelineCache
+	{
+	public:
+		PipelineCache(const Device* pDevice, std::filesystem::path path);
+		// Saves once more before destroying the cache
+		~PipelineCache();
+
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache(PipelineCache&&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+		PipelineCache& operator=(PipelineCache&&) = delete;
+
+		VkPipelineCache GetPipelineCache() const { return m_PipelineCache; }
+		const std::filesystem::path& GetPath() const { return m_Path; }
+
+		// True when the cache started from usable data on disk
+		bool WasLoaded() const { return m_WasLoaded; }
+
+		// Skips the write when the data matches the last load or save. False on I/O errors.
+		bool Save();
+
+	private:
+		bool IsCompatible(const std::vector<char>& data) const;
+
+		const Device* m_pDevice{};
+		std::filesystem::path m_Path;
+		VkPipelineCache m_PipelineCache{ VK_NULL_HANDLE };
+		bool m_WasLoaded{ false };
+		std::vector<char> m_SavedData;	// what the file on disk holds
+	};
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/DescriptorPool.h"
+#include "Vulkan/Device.h"
+#include "Vulkan/Pipeline.h"
+#include "Vulkan/SwapChain.h"
+
+namespace RUBY
+{
+	// Hash-conses pipelines and pipeline layouts: builders with identical state get the same ref-counted object,
+	// so duplicates compile once and draws can skip the bind when the VkPipeline didn't change.
+	// The registry only holds weak references, the last user releasing an object destroys it through
+	// Device::DeferDestroy. Keys hold the SPIR-V content hash and the set layout bindings, never handles or
+	// pointers, so a recycled handle can't return a pipeline built from something else. Pipelines using shaders
+	// from outside the ShaderCache or immutable samplers aren't shared.
+	class PipelineRegistry
+	{
+	public:
+		explicit PipelineRegistry(Device* pDevice);
+
+		PipelineRegistry(const PipelineRegistry&) = delete;
+		PipelineRegistry(PipelineRegistry&&) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+		PipelineRegistry& operator=(PipelineRegistry&&) = delete;
+
+		// Thread safe
+		std::shared_ptr<const Pipeline> GetPipeline(PipelineBuilder& builder, SwapChain* pSwapChain, DescriptorPool* pDescriptorPool);
+		// Shared between pools with identical set layouts, created from descriptorPool's handles
+		std::shared_ptr<const PipelineLayout> GetLayout(const DescriptorPool& descriptorPool,
+			const std::vector<VkPushConstantRange>& pushConstants);
+
+		// Forgets entries whose objects were released, also done automatically as the tables grow
+		void Prune();
+
+		uint32_t GetPipelineCount() const;
+		uint64_t GetHitCount() const { return m_HitCount; }
+		uint64_t GetMissCount() const { return m_MissCount; }
+
+	private:
+		// False when the key can't describe the state (pNext chains, shaders without a content hash, immutable
+		// samplers), such pipelines and layouts are never shared
+		static bool BuildPipelineKey(const PipelineBuilder& builder, const DescriptorPool& descriptorPool, std::string& outKey);
+		static bool BuildLayoutKey(const DescriptorPool& descriptorPool, const std::vector<VkPushConstantRange>& pushConstants, std::string& outKey);
+
+		template<typename T>
+		std::shared_ptr<const T> MakeShared(T* pObject) const;
+
+		void PruneLocked();
+
+		Device* m_pDevice{};
+
+		mutable std::mutex m_Mutex;
+		std::unordered_map<std::string, std::weak_ptr<const Pipeline>> m_Pipelines;
+		std::unordered_map<std::string, std::weak_ptr<const PipelineLayout>> m_Layouts;
+		size_t m_PruneThreshold{ 64 };
+
+		std::atomic<uint64_t> m_HitCount{ 0 };
+		std::atomic<uint64_t> m_MissCount{ 0 };
+	};
+}
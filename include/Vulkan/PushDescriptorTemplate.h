@@ -0,0 +1,65 @@
+#pragma once
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/ShaderReflection.h"
+
+namespace RUBY
+{
+	class Device;
+
+	// One descriptor of a templated push, fixed stride so the template offsets only depend on the index
+	union PushDescriptorInfo
+	{
+		PushDescriptorInfo(const VkDescriptorImageInfo& info) : image(info) {}
+		PushDescriptorInfo(const VkDescriptorBufferInfo& info) : buffer(info) {}
+		PushDescriptorInfo(VkBufferView view) : texelBufferView(view) {}
+
+		VkDescriptorImageInfo image;
+		VkDescriptorBufferInfo buffer;
+		VkBufferView texelBufferView;
+	};
+
+	// Descriptor update template for a push descriptor set layout: a draw pushes its bindings with one call
+	// and no descriptor set, pool or VkWriteDescriptorSet array is involved.
+	//   m_pTemplate->Push(cmd, { uniformRing.GetDescriptorInfo(), VkDescriptorImageInfo{ sampler, view, layout } });
+	class PushDescriptorTemplate
+	{
+	public:
+		struct Entry
+		{
+			uint32_t binding{ 0 };
+			VkDescriptorType type{ VK_DESCRIPTOR_TYPE_MAX_ENUM };
+			uint32_t count{ 1 };
+		};
+
+		PushDescriptorTemplate(Device* pDevice, VkDescriptorSetLayout setLayout, VkPipelineLayout pipelineLayout, uint32_t set,
+			VkPipelineBindPoint bindPoint, const std::vector<Entry>& entries);
+		// Entries of the reflected set in binding order, runtime sized arrays are not supported
+		PushDescriptorTemplate(Device* pDevice, VkDescriptorSetLayout setLayout, VkPipelineLayout pipelineLayout, uint32_t set,
+			VkPipelineBindPoint bindPoint, const ShaderReflection& reflection);
+		~PushDescriptorTemplate();
+
+		PushDescriptorTemplate(const PushDescriptorTemplate&) = delete;
+		PushDescriptorTemplate(PushDescriptorTemplate&&) = delete;
+		PushDescriptorTemplate& operator=(const PushDescriptorTemplate&) = delete;
+		PushDescriptorTemplate& operator=(PushDescriptorTemplate&&) = delete;
+
+		// One info per descriptor, entries in order with arrays expanded
+		void Push(VkCommandBuffer commandBuffer, const PushDescriptorInfo* pInfos) const;
+		void Push(VkCommandBuffer commandBuffer, std::initializer_list<PushDescriptorInfo> infos) const;
+
+		uint32_t GetDescriptorCount() const { return m_DescriptorCount; }
+
+		static std::vector<Entry> GetEntries(const ShaderReflection& reflection, uint32_t set);
+
+	private:
+		Device* m_pDevice{};
+		VkDescriptorUpdateTemplate m_Template{ VK_NULL_HANDLE };
+		VkPipelineLayout m_PipelineLayout{ VK_NULL_HANDLE };
+		uint32_t m_Set{ 0 };
+		uint32_t m_DescriptorCount{ 0 };
+	};
+}
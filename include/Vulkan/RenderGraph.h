@@ -0,0 +1,241 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/Device.h"
+#include "Vulkan/Image.h"
+
+class VmaAllocation_T;
+using VmaAllocation = VmaAllocation_T*;
+
+namespace RUBY
+{
+	class CommandPool;
+	class FrameContext;
+	class IBasePass;
+	struct PassContext;
+
+	// How a pass touches an image, the graph derives layouts, stages and access masks from it
+	enum class ResourceUsage
+	{
+		ColorAttachment,
+		DepthAttachmentWrite,
+		DepthAttachmentRead,
+		SampledFragment,
+		SampledCompute,
+		StorageReadCompute,
+		StorageWriteCompute,
+		TransferSrc,
+		TransferDst,
+	};
+
+	struct TransientImageDesc
+	{
+		uint32_t width{ 0 };	// 0 follows the swapchain extent
+		uint32_t height{ 0 };
+		VkFormat format{ VK_FORMAT_UNDEFINED };
+		VkImageAspectFlags aspectFlags{ VK_IMAGE_ASPECT_COLOR_BIT };
+		VkImageUsageFlags extraUsage{ 0 };
+	};
+
+	class RenderGraph;
+
+	// Handed to IBasePass::Setup, records what the pass reads, writes and creates
+	class RenderGraphBuilder
+	{
+	public:
+		RenderGraphBuilder(RenderGraph& graph, uint32_t passIndex) : m_Graph(graph), m_PassIndex(passIndex) {}
+
+		void CreateImage(const std::string& name, const TransientImageDesc& desc);
+		void Read(const std::string& name, ResourceUsage usage);
+		void Write(const std::string& name, ResourceUsage usage);
+
+		// Keeps the pass alive even if nothing consumes its outputs
+		void SetSideEffects();
+
+	private:
+		RenderGraph& m_Graph;
+		uint32_t m_PassIndex;
+	};
+
+	// Passes declare their resources through Setup, Compile() orders them by dependency, culls passes that
+	// don't contribute to an imported image, plans the synchronization2 barriers between them and places
+	// transient images whose lifetimes don't overlap in the same memory. Images only used as attachments by a
+	// single pass get TRANSIENT_ATTACHMENT usage and lazily allocated memory when the device has it, the pass
+	// should then use LOAD_OP_CLEAR/DONT_CARE and STORE_OP_DONT_CARE so they can stay in tile memory.
+	//
+	// Consecutive passes on the same queue form a batch. The last graphics batch is recorded into the command
+	// buffer handed to Execute and submitted by the caller, waiting on GetFinalWaits(). Earlier batches are
+	// submitted from Execute, compute batches after it from OnFrameSubmitted so they overlap the next frame.
+	class RenderGraph
+	{
+	public:
+		static constexpr const char* BACKBUFFER = "Backbuffer";
+
+		RenderGraph(Device* pDevice, CommandPool* pCommandPool);
+		~RenderGraph();
+
+		RenderGraph(const RenderGraph&) = delete;
+		RenderGraph(RenderGraph&&) = delete;
+		RenderGraph& operator=(const RenderGraph&) = delete;
+		RenderGraph& operator=(RenderGraph&&) = delete;
+
+		void AddPass(const std::string& name, IBasePass* pPass);
+
+		// Images living outside the graph. finalLayout is applied after the last pass, UNDEFINED leaves it as is.
+		void ImportImage(const std::string& name, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+		void BindImage(const std::string& name, Image* pImage);
+
+		void Compile(VkExtent2D extent);
+		bool IsCompiled() const { return m_IsCompiled; }
+		void Invalidate() { m_IsCompiled = false; }
+
+		void Execute(VkCommandBuffer commandBuffer, uint32_t imageIndex, PassContext& passContext);
+
+		// Semaphores the submission of Execute's command buffer has to wait on
+		const std::vector<VkSemaphoreSubmitInfo>& GetFinalWaits() const { return m_FinalWaits; }
+		// Call right after submitting Execute's command buffer, frameValue is the graphics timeline value it signals
+		void OnFrameSubmitted(uint64_t frameValue);
+
+		Image& GetImage(const std::string& name);
+
+		uint32_t GetExecutedPassCount() const { return static_cast<uint32_t>(m_ExecutionOrder.size()); }
+		uint32_t GetBatchCount() const { return static_cast<uint32_t>(m_Batches.size()); }
+		VkDeviceSize GetTransientMemorySize() const { return m_TransientMemorySize; }
+		// Reserved for lazily allocated attachments, on tilers most of it is never backed by real memory
+		VkDeviceSize GetLazyMemorySize() const { return m_LazyMemorySize; }
+
+	private:
+		friend class RenderGraphBuilder;
+
+		struct ResourceAccess
+		{
+			std::string name;
+			ResourceUsage usage;
+			bool isWrite;
+
+			// Resolved by Compile
+			uint32_t resource{ ~0u };
+			VkPipelineStageFlags2 stage{ VK_PIPELINE_STAGE_2_NONE };
+			VkAccessFlags2 access{ VK_ACCESS_2_NONE };
+			VkImageLayout layout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		};
+
+		struct PassNode
+		{
+			std::string name;
+			const char* profileName{ nullptr };	// interned once, recording a zone then takes no lock
+			IBasePass* pPass;
+			std::vector<ResourceAccess> accesses;
+			bool hasSideEffects{ false };
+			QueueType queue{ QueueType::Graphics };
+
+			std::vector<uint32_t> producers;	// read-after-write / write-after-write, used for culling
+			std::vector<uint32_t> dependencies;	// producers plus write-after-read, used for ordering
+		};
+
+		struct ResourceNode
+		{
+			std::string name;
+			bool isImported{ false };
+			int creatorPass{ -1 };
+			TransientImageDesc desc{};
+			VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+
+			Image* pImage{ nullptr };
+			std::unique_ptr<Image> pTransientImage;
+
+			VkImageUsageFlags usage{ 0 };
+			uint32_t firstUse{ ~0u };
+			uint32_t lastUse{ 0 };
+			uint32_t aliasSlot{ ~0u };
+			bool isLazy{ false };
+
+			uint32_t queueMask{ 0 };	// 1 << QueueType of every pass touching it
+			uint32_t firstBatch{ ~0u };
+			uint32_t lastBatch{ 0 };
+
+			// Union of everything the graph does to the resource, the first barrier of a frame waits on it
+			VkPipelineStageFlags2 stages{ VK_PIPELINE_STAGE_2_NONE };
+			VkAccessFlags2 writeAccess{ VK_ACCESS_2_NONE };
+		};
+
+		struct Barrier
+		{
+			uint32_t resource;
+			VkPipelineStageFlags2 srcStage;
+			VkAccessFlags2 srcAccess;
+			VkPipelineStageFlags2 dstStage;
+			VkAccessFlags2 dstAccess;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+			bool fromCurrentLayout;	// imported images start in whatever layout they were left in
+			uint32_t srcQueueFamily{ VK_QUEUE_FAMILY_IGNORED };
+			uint32_t dstQueueFamily{ VK_QUEUE_FAMILY_IGNORED };
+		};
+
+		struct Batch
+		{
+			QueueType queue;
+			uint32_t firstPosition;
+			uint32_t endPosition;
+
+			std::vector<uint32_t> waitBatches;	// earlier batches of this frame on the other queue
+			std::vector<uint32_t> previousFrameWaitBatches;	// later batches, as submitted by the previous frame
+			std::vector<Barrier> releaseBarriers;	// ownership handed to the other queue family
+
+			VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+			uint64_t submittedValue{ 0 };
+		};
+
+		struct AliasSlot
+		{
+			VmaAllocation memory{ nullptr };
+			VkMemoryRequirements requirements{};
+			uint32_t lastUse{ 0 };
+			uint32_t queueMask{ 0 };
+			bool isLazy{ false };
+			VkPipelineStageFlags2 stages{ VK_PIPELINE_STAGE_2_NONE };
+			VkAccessFlags2 writeAccess{ VK_ACCESS_2_NONE };
+		};
+
+		uint32_t GetOrAddResource(const std::string& name);
+		void ResolveAccesses();
+		void BuildDependencies();
+		void SortAndCull();
+		void BuildBatches();
+		void AllocateTransients(VkExtent2D extent);
+		void PlanBarriers();
+		void ReleaseTransients();
+
+		void RecordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers);
+		void GatherWaits(uint32_t batch, std::vector<VkSemaphoreSubmitInfo>& outWaits) const;
+		void SubmitBatch(uint32_t batch);
+
+		Device* m_pDevice{};
+		CommandPool* m_pCommandPool{};
+
+		std::vector<PassNode> m_Passes;
+		std::vector<ResourceNode> m_Resources;
+		std::unordered_map<std::string, uint32_t> m_ResourceLookup;
+
+		std::vector<uint32_t> m_ExecutionOrder;
+		std::vector<Batch> m_Batches;
+		std::vector<uint32_t> m_PositionBatch;
+		uint32_t m_FinalBatch{ 0 };
+		std::vector<VkSemaphoreSubmitInfo> m_FinalWaits;
+		FrameContext* m_pFrame{ nullptr };
+		bool m_HasPendingSubmission{ false };
+		std::vector<std::vector<Barrier>> m_PassBarriers;	// indexed by position in m_ExecutionOrder
+		std::vector<Barrier> m_FinalBarriers;
+
+		std::vector<AliasSlot> m_AliasSlots;
+		VkDeviceSize m_TransientMemorySize{ 0 };
+		VkDeviceSize m_LazyMemorySize{ 0 };
+
+		bool m_IsCompiled{ false };
+	};
+}
@@ -1,19 +1,26 @@
 #pragma once
 #include <vulkan/vulkan.h>
 
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "Vulkan/Device.h"
+#include "Vulkan/ShaderReflection.h"
 
 
 namespace RUBY 
 {
+    class ShaderModule;
+
     class Shader
     {
     public:
         Shader() = default;
+        // Goes through the device ShaderCache, shaders loading the same SPIR-V share one module
         Shader(Device* pDevice, const std::string& filePath, VkShaderStageFlagBits stage);
+        Shader(std::shared_ptr<const ShaderModule> pModule, VkShaderStageFlagBits stage);
 
         Shader(const Shader& other) = delete;
         Shader(Shader&& other) noexcept;
@@ -23,8 +30,14 @@ namespace RUBY
         ~Shader();
 
         VkShaderModule GetShaderModule() const { return m_ShaderModule; }
+        // Content hash of the SPIR-V, 0 for shaders not loaded through the ShaderCache
+        uint64_t GetCodeHash() const;
         VkPipelineShaderStageCreateInfo GetStageCreateInfo() const;
 
+        // Bindings and push constants visible to this shader's stage, only for shaders loaded through the ShaderCache
+        bool HasReflection() const { return m_pModule != nullptr; }
+        ShaderReflection GetReflection() const;
+
         static VkShaderModule CreateShaderModule(const VkDevice& logicalDevice, const std::vector<char>& code);
         static std::vector<char> ReadFile(const std::string& filePath);
 
@@ -32,5 +45,6 @@ namespace RUBY
         Device* m_pDevice{};
         VkShaderModule m_ShaderModule{};
         VkShaderStageFlagBits m_Stage{};
+        std::shared_ptr<const ShaderModule> m_pModule;
     };
 }
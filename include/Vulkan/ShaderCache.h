@@ -0,0 +1,119 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/ShaderReflection.h"
+
+namespace RUBY
+{
+	class Device;
+
+	// Read-only view of a whole file, unmapped on destruction. Rewriting the file in place while it is mapped is
+	// undefined (SIGBUS on truncation), so the ShaderCache only holds one while loading.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::filesystem::path& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) = delete;
+
+		const void* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		void* m_pData{ nullptr };
+		size_t m_Size{ 0 };
+	};
+
+	// SPIR-V shared between all shaders with the same content. With VK_KHR_maintenance5 no VkShaderModule is
+	// created at all: the stage create info points at the module's own copy of the code through pNext.
+	class ShaderModule
+	{
+	public:
+		~ShaderModule();
+
+		ShaderModule(const ShaderModule&) = delete;
+		ShaderModule(ShaderModule&&) = delete;
+		ShaderModule& operator=(const ShaderModule&) = delete;
+		ShaderModule& operator=(ShaderModule&&) = delete;
+
+		// VK_NULL_HANDLE when module creation is skipped
+		VkShaderModule GetShaderModule() const { return m_ShaderModule; }
+		uint64_t GetHash() const { return m_Hash; }
+		// Reflected once on creation, stages are those of the module's entry points
+		const ShaderReflection& GetReflection() const { return m_Reflection; }
+
+		// Only valid while this module is alive
+		VkPipelineShaderStageCreateInfo GetStageCreateInfo(VkShaderStageFlagBits stage, const char* pEntryPoint = "main") const;
+
+	private:
+		friend class ShaderCache;
+
+		ShaderModule(Device* pDevice, uint64_t hash, std::vector<uint32_t> code, bool skipModuleCreation);
+
+		bool HasCode(const uint32_t* pCode, size_t codeSize) const;
+
+		Device* m_pDevice{};
+		uint64_t m_Hash{};
+		VkShaderModule m_ShaderModule{ VK_NULL_HANDLE };
+		ShaderReflection m_Reflection;
+
+		// Used only when the code is consumed at pipeline creation instead of module creation
+		VkShaderModuleCreateInfo m_CreateInfo{};
+		// Also compared against on hash hits, a 64-bit hash alone can collide
+		std::vector<uint32_t> m_Code;
+	};
+
+	// Device-level, deduplicates SPIR-V by content and hands out ref-counted modules. Files are memory mapped while
+	// loading and copied only for new modules, a file whose write time didn't change isn't even opened a second time.
+	// GetHash() is unique among live modules: content colliding with a live module gets the next free value.
+	// Only weak references are kept, a module goes away with its last user (modules aren't needed after
+	// pipeline creation, so no deferred destruction is involved).
+	class ShaderCache
+	{
+	public:
+		explicit ShaderCache(Device* pDevice);
+
+		ShaderCache(const ShaderCache&) = delete;
+		ShaderCache(ShaderCache&&) = delete;
+		ShaderCache& operator=(const ShaderCache&) = delete;
+		ShaderCache& operator=(ShaderCache&&) = delete;
+
+		// Thread safe
+		std::shared_ptr<const ShaderModule> Load(const std::filesystem::path& path);
+		std::shared_ptr<const ShaderModule> Get(const uint32_t* pCode, size_t codeSize);
+
+		bool UsesModulelessStages() const { return m_SkipModuleCreation; }
+
+		static uint64_t HashCode(const uint32_t* pCode, size_t codeSize);
+
+	private:
+		// Copies the code when a new module is created
+		std::shared_ptr<const ShaderModule> GetOrCreateLocked(const uint32_t* pCode, size_t codeSize);
+
+		struct FileEntry
+		{
+			std::filesystem::file_time_type writeTime;
+			std::weak_ptr<const ShaderModule> pModule;
+		};
+
+		Device* m_pDevice{};
+		bool m_SkipModuleCreation{ false };
+
+		std::mutex m_Mutex;
+		std::map<std::pair<uint64_t, size_t>, std::weak_ptr<const ShaderModule>> m_Modules;
+		std::unordered_map<std::filesystem::path::string_type, FileEntry> m_Files;
+	};
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace RUBY
+{
+	// Resource interface of one or more shader stages, read straight from SPIR-V
+	struct ShaderReflection
+	{
+		struct Binding
+		{
+			uint32_t set{ 0 };
+			uint32_t binding{ 0 };
+			VkDescriptorType type{ VK_DESCRIPTOR_TYPE_MAX_ENUM };
+			// 0 for runtime sized arrays, DescriptorPool refuses those, their set needs an explicit layout
+			uint32_t count{ 1 };
+			VkShaderStageFlags stages{ 0 };
+		};
+
+		static constexpr uint32_t NO_PUSH_DESCRIPTOR_SET = UINT32_MAX;
+
+		VkShaderStageFlags stages{ 0 };
+		// Set whose descriptors are pushed (VK_KHR_push_descriptor) instead of allocated, never read from SPIR-V
+		uint32_t pushDescriptorSet{ NO_PUSH_DESCRIPTOR_SET };
+		// Sorted by set, then binding
+		std::vector<Binding> bindings;
+		// Every stage appears in exactly one range, stages using the same bytes share it
+		std::vector<VkPushConstantRange> pushConstants;
+
+		// Throws on malformed SPIR-V
+		static ShaderReflection Reflect(const uint32_t* pCode, size_t codeSize);
+
+		// Union of both interfaces, throws when the same binding is declared with different descriptor types
+		void Merge(const ShaderReflection& other);
+		// Replaces the stage visibility, for modules whose entry point stage is overridden
+		void SetStages(VkShaderStageFlags newStages);
+
+		// One entry per set up to the highest used one, unused sets in between stay empty
+		std::vector<std::vector<VkDescriptorSetLayoutBinding>> GetSetLayoutBindings() const;
+		// Enough descriptors for maxSets allocations of every set but the push descriptor set
+		std::vector<VkDescriptorPoolSize> GetPoolSizes(uint32_t maxSets) const;
+	};
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Map entry for one member of a constants struct: RUBY_SPECIALIZATION_ENTRY(0, LightingConstants, lightCount)
+#define RUBY_SPECIALIZATION_ENTRY(constantId, Type, member) \
+	::RUBY::MakeSpecializationEntry<Type, decltype(Type::member)>(constantId, offsetof(Type, member))
+
+namespace RUBY
+{
+	template<typename T, typename Member>
+	constexpr VkSpecializationMapEntry MakeSpecializationEntry(uint32_t constantId, size_t offset)
+	{
+		static_assert(!std::is_same_v<Member, bool>, "SPIR-V booleans are 32 bit, use VkBool32");
+		static_assert(std::is_arithmetic_v<Member>, "Specialization constants are scalars");
+		static_assert(sizeof(Member) == 4 || sizeof(Member) == 8, "Specialization constants are 32 or 64 bit");
+		return { constantId, static_cast<uint32_t>(offset), sizeof(Member) };
+	}
+
+	// constant_id N is the Nth 32 bit member of T, for structs made of uint32_t/int32_t/float/VkBool32 only
+	template<typename T>
+	constexpr std::array<VkSpecializationMapEntry, sizeof(T) / 4> MakeSequentialSpecializationMap()
+	{
+		static_assert(std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T>);
+		static_assert(sizeof(T) % 4 == 0, "Sequential specialization structs hold 32 bit members only");
+
+		std::array<VkSpecializationMapEntry, sizeof(T) / 4> entries{};
+		for (uint32_t i = 0; i < entries.size(); ++i)
+			entries[i] = { i, i * 4, 4 };
+		return entries;
+	}
+
+	// Immutable copy of a constants struct and its map, cheap to copy around. The VkSpecializationInfo stays
+	// valid as long as any copy is alive, PipelineBuilder keeps one per stage.
+	class SpecializationConstants
+	{
+	public:
+		SpecializationConstants() = default;
+
+		template<typename T, size_t N>
+		SpecializationConstants(const T& values, const std::array<VkSpecializationMapEntry, N>& mapEntries)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+
+			auto pData = std::make_shared<Data>();
+			pData->entries.assign(mapEntries.begin(), mapEntries.end());
+			pData->bytes.resize(sizeof(T));
+			std::memcpy(pData->bytes.data(), &values, sizeof(T));
+
+			pData->info.mapEntryCount = static_cast<uint32_t>(pData->entries.size());
+			pData->info.pMapEntries = pData->entries.data();
+			pData->info.dataSize = pData->bytes.size();
+			pData->info.pData = pData->bytes.data();
+			m_pData = std::move(pData);
+		}
+
+		template<typename T>
+		explicit SpecializationConstants(const T& values)
+			: SpecializationConstants(values, MakeSequentialSpecializationMap<T>())
+		{
+		}
+
+		// nullptr when empty, ready for VkPipelineShaderStageCreateInfo::pSpecializationInfo
+		const VkSpecializationInfo* Get() const { return m_pData ? &m_pData->info : nullptr; }
+		bool IsEmpty() const { return m_pData == nullptr; }
+
+	private:
+		struct Data
+		{
+			std::vector<VkSpecializationMapEntry> entries;
+			std::vector<std::byte> bytes;
+			VkSpecializationInfo info{};
+		};
+
+		std::shared_ptr<const Data> m_pData;
+	};
+}
@@ -5,6 +5,7 @@
 #include "Vulkan/Image.h"
 #include "Vulkan/Device.h"
 #include "Vulkan/CommandPool.h"
+#include "Vulkan/FrameContext.h"
 #include "Vulkan/IRubyWindow.h"
 
 namespace RUBY
@@ -20,7 +21,8 @@ namespace RUBY
             RELAXED
         };
 
-        static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+        // Image ring used when there is no presentable surface, one more than the deepest frames-in-flight setting
+        static constexpr uint32_t OFFSCREEN_IMAGE_COUNT = FrameContext::MAX_FRAMES_IN_FLIGHT + 1;
 
         SwapChain(IRubyWindow* window, Device* device, CommandPool* pCommandPool, PresentMode preferredPresentMode = PresentMode::FIFO);
         ~SwapChain();
@@ -30,12 +32,10 @@ namespace RUBY
         VkFormat GetImageFormat() const { return m_SwapChainImageFormat; }
         std::vector<Image>& GetImages() { return m_SwapChainImages; }
 
-        // Sync accessors (per-frame)
-        VkSemaphore& GetImageAvailableSemaphore(uint32_t frameIndex) { return m_ImageAvailableSemaphores.at(frameIndex); }
-        VkSemaphore& GetRenderFinishedSemaphore(uint32_t frameIndex) { return m_RenderFinishedSemaphores.at(frameIndex); }
-        VkFence&     GetInFlightFence(uint32_t frameIndex) { return m_InFlightFences.at(frameIndex); }
+        // Offscreen swapchains own their images, never signal the acquire semaphore and are never presented
+        bool IsOffscreen() const { return m_IsOffscreen; }
 
-        uint32_t AcquireNextImage(uint64_t timeout, uint32_t frameIndex, VkSemaphore signalSemaphore, VkFence fence, VkResult* outResult = nullptr) const;
+        uint32_t AcquireNextImage(uint64_t timeout, uint32_t frameIndex, VkSemaphore signalSemaphore, VkFence fence, VkResult* outResult = nullptr);
 
         void RecreateSwapChain();
 
@@ -44,14 +44,13 @@ namespace RUBY
 
     private:
         void CreateSwapChain();
+        void CreateOffscreenImages();
         void QuerySwapChainSupport();
 
         VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats) const;
         VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) const;
         VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) const;
 
-        void CreateSyncObjects();
-        void CleanupSyncObjects();
         void CleanupSwapChainInternal();
 
     private:
@@ -72,13 +71,11 @@ namespace RUBY
             std::vector<VkPresentModeKHR> presentModes;
         } m_SwapChainSupport;
 
-        // Sync objects per frame
-        std::vector<VkSemaphore> m_ImageAvailableSemaphores;
-        std::vector<VkSemaphore> m_RenderFinishedSemaphores;
-        std::vector<VkFence>     m_InFlightFences;
-
         PresentMode m_PresentMode{ PresentMode::FIFO };
 
+        bool m_IsOffscreen{ false };
+        uint32_t m_OffscreenImageIndex{ 0 };
+
         uint32_t m_CurrentFrame{ 0 };
     };
 }
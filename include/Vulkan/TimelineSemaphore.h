@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace RUBY
+{
+	class Device;
+
+	// Monotonically increasing VkSemaphore (Vulkan 1.2 core).
+	// Every submission signals a fresh value, so "has submission N finished" is a single counter comparison.
+	class TimelineSemaphore
+	{
+	public:
+		TimelineSemaphore(const Device* pDevice, uint64_t initialValue = 0);
+		~TimelineSemaphore();
+
+		TimelineSemaphore(const TimelineSemaphore&) = delete;
+		TimelineSemaphore(TimelineSemaphore&&) = delete;
+		TimelineSemaphore& operator=(const TimelineSemaphore&) = delete;
+		TimelineSemaphore& operator=(TimelineSemaphore&&) = delete;
+
+		VkSemaphore GetSemaphore() const { return m_Semaphore; }
+
+		// Highest value handed to a submission so far, it may not have reached the queue yet
+		uint64_t GetPendingValue() const { return m_PendingValue; }
+
+		// Cheap when the value is already known to be reached, otherwise one vkGetSemaphoreCounterValue
+		uint64_t GetCompletedValue();
+		bool IsComplete(uint64_t value);
+		void Wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+		VkSemaphoreSubmitInfo GetSubmitInfo(uint64_t value, VkPipelineStageFlags2 stageMask) const;
+
+	private:
+		// Only Device::Submit hands out values, under the queue lock so they reach the queue in order
+		friend class Device;
+		uint64_t Advance() { return ++m_PendingValue; }
+
+		const Device* m_pDevice{};
+		VkSemaphore m_Semaphore{ VK_NULL_HANDLE };
+
+		std::atomic<uint64_t> m_PendingValue{ 0 };
+		std::atomic<uint64_t> m_CompletedValue{ 0 };
+	};
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "Vulkan/Buffer.h"
+#include "Vulkan/CommandPool.h"
+#include "Vulkan/Device.h"
+#include "Vulkan/Image.h"
+
+namespace RUBY
+{
+	// Queued uploads are submitted highest priority first, FIFO within a priority
+	enum class UploadPriority
+	{
+		High,
+		Normal,
+		Low,
+	};
+
+	// Returned by every upload, a default constructed token is always complete
+	struct UploadToken
+	{
+		uint64_t id{ 0 };
+	};
+
+	// Copies into device local buffers and images on the transfer queue without blocking the CPU.
+	// Data is staged immediately, the copies themselves are batched into one submission per Update() and
+	// limited to the frame budget so streaming doesn't starve rendering of bandwidth.
+	//
+	// When the transfer family differs from the graphics family, ownership is released on the transfer queue
+	// and acquired by RecordAcquires() on the frame's command buffer; that submission has to wait on
+	// GetFrameWaits(). A destination is safe to use on the graphics queue in the frame whose RecordAcquires
+	// ran after its token completed. Destinations must stay alive and unused by the GPU until then, the Defragmenter
+	// leaves them alone until their ownership was acquired.
+	class UploadManager
+	{
+	public:
+		static constexpr VkDeviceSize DEFAULT_FRAME_BUDGET = 64ull * 1024 * 1024;
+		static constexpr VkDeviceSize STAGING_PAGE_SIZE = 32ull * 1024 * 1024;
+
+		UploadManager(Device* pDevice, VkDeviceSize frameBudget = DEFAULT_FRAME_BUDGET);
+		~UploadManager();
+
+		UploadManager(const UploadManager&) = delete;
+		UploadManager(UploadManager&&) = delete;
+		UploadManager& operator=(const UploadManager&) = delete;
+		UploadManager& operator=(UploadManager&&) = delete;
+
+		// Thread safe, pData is copied before returning.
+		// UploadImage replaces the whole image, its previous contents and layout are discarded. Only images with a
+		// single mip level and array layer and a width and height matching the image are accepted. Both throw
+		// std::invalid_argument when size doesn't fit the buffer or is short of the image's tightly packed texels.
+		UploadToken UploadBuffer(Buffer& dst, const void* pData, VkDeviceSize size, VkDeviceSize dstOffset = 0,
+			UploadPriority priority = UploadPriority::Normal);
+		UploadToken UploadImage(Image& dst, const void* pData, VkDeviceSize size, uint32_t width, uint32_t height,
+			VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, UploadPriority priority = UploadPriority::Normal);
+
+		bool IsComplete(UploadToken token);
+		// Submits everything still queued, ignoring the budget, and blocks until the token's copy finished
+		void Wait(UploadToken token);
+		void Flush();
+
+		// Once per frame: submits queued uploads up to the budget and recycles retired staging memory
+		void Update();
+
+		// Graphics side of the frame, see the class comment
+		void RecordAcquires(VkCommandBuffer commandBuffer);
+		void GetFrameWaits(std::vector<VkSemaphoreSubmitInfo>& outWaits) const;
+
+		void SetFrameBudget(VkDeviceSize frameBudget) { m_FrameBudget = frameBudget; }
+		VkDeviceSize GetFrameBudget() const { return m_FrameBudget; }
+		VkDeviceSize GetQueuedBytes() const;
+
+	private:
+		struct StagingPage
+		{
+			std::unique_ptr<Buffer> pBuffer;
+			VkDeviceSize size{ 0 };
+			VkDeviceSize used{ 0 };
+			uint32_t queuedRequests{ 0 };
+			uint64_t retireValue{ 0 };	// transfer timeline value of the last submission reading from it
+		};
+
+		struct Request
+		{
+			uint64_t id;
+			StagingPage* pPage;
+			VkDeviceSize stagingOffset;
+			VkDeviceSize size;
+
+			Buffer* pBuffer{ nullptr };
+			VkDeviceSize dstOffset{ 0 };
+
+			Image* pImage{ nullptr };
+			VmaAllocation allocation{ nullptr };
+			uint32_t width{ 0 };
+			uint32_t height{ 0 };
+			VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		};
+
+		struct Submission
+		{
+			uint64_t timelineValue;
+			VkCommandBuffer commandBuffer;
+		};
+
+		UploadToken Enqueue(Request&& request, const void* pData, UploadPriority priority);
+		// Expects m_Mutex to be held
+		void Submit(VkDeviceSize budget);
+		void Retire();
+
+		Device* m_pDevice{};
+		std::unique_ptr<CommandPool> m_pCommandPool;
+		bool m_TransfersOwnership{ false };
+
+		mutable std::mutex m_Mutex;
+		VkDeviceSize m_FrameBudget;
+
+		std::array<std::deque<Request>, 3> m_Queued;
+		VkDeviceSize m_QueuedBytes{ 0 };
+		uint64_t m_NextId{ 1 };
+		std::unordered_map<uint64_t, uint64_t> m_Tokens;	// id -> timeline value, 0 while still queued
+
+		std::list<StagingPage> m_StagingPages;	// list so requests can keep pointers to their page
+
+		std::deque<Submission> m_Submissions;
+		std::vector<VkCommandBuffer> m_FreeCommandBuffers;
+
+		std::vector<VkBufferMemoryBarrier2> m_PendingBufferAcquires;
+		std::vector<VkImageMemoryBarrier2> m_PendingImageAcquires;
+		// Destinations marked busy in the Defragmenter until their acquire is recorded
+		std::vector<VmaAllocation> m_PendingAcquireAllocations;
+		uint64_t m_LastSubmittedValue{ 0 };
+		uint64_t m_LastAcquiredValue{ 0 };
+		uint64_t m_FrameWaitValue{ 0 };
+	};
+}
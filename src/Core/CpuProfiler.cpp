@@ -0,0 +1,137 @@
+#include "Core/CpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+	void WriteJsonString(std::ofstream& out, const char* text)
+	{
+		out << '"';
+		for (const char* c = text; *c != '\0'; ++c)
+		{
+			switch (*c)
+			{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(*c) < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(*c));
+					out << escaped;
+				}
+				else
+				{
+					out << *c;
+				}
+			}
+		}
+		out << '"';
+	}
+}
+
+RUBY::CpuProfiler& RUBY::CpuProfiler::Get()
+{
+	static CpuProfiler profiler;
+	return profiler;
+}
+
+int64_t RUBY::CpuProfiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* RUBY::CpuProfiler::Intern(const std::string& name)
+{
+	std::lock_guard lock(m_Mutex);
+	return m_InternedNames.insert(name).first->c_str();
+}
+
+RUBY::CpuProfiler::ThreadBuffer& RUBY::CpuProfiler::GetThreadBuffer()
+{
+	// Buffers are never freed, so a thread that already exited can still be dumped
+	thread_local ThreadBuffer* t_pBuffer = nullptr;
+	if (t_pBuffer == nullptr)
+	{
+		std::lock_guard lock(m_Mutex);
+		auto buffer = std::make_unique<ThreadBuffer>();
+		buffer->threadId = static_cast<uint32_t>(m_ThreadBuffers.size());
+		buffer->threadName = buffer->threadId == 0 ? "Main" : "Thread " + std::to_string(buffer->threadId);
+		t_pBuffer = buffer.get();
+		m_ThreadBuffers.push_back(std::move(buffer));
+	}
+	return *t_pBuffer;
+}
+
+void RUBY::CpuProfiler::Record(const char* name, int64_t beginNanoseconds, int64_t endNanoseconds)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	// Single writer per buffer, the release store publishes the event to WriteChromeTrace
+	const uint64_t index = buffer.writeCount.load(std::memory_order_relaxed);
+	buffer.events[index % EVENTS_PER_THREAD] = { name, beginNanoseconds, endNanoseconds };
+	buffer.writeCount.store(index + 1, std::memory_order_release);
+}
+
+void RUBY::CpuProfiler::SetThreadName(const std::string& name)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard lock(m_Mutex);
+	buffer.threadName = name;
+}
+
+void RUBY::CpuProfiler::WriteChromeTrace(const std::string& path)
+{
+	std::ofstream out(path, std::ios::trunc);
+	if (!out.is_open())
+	{
+		throw std::runtime_error("failed to open profiler trace file: " + path);
+	}
+
+	// Threads keep recording meanwhile, events they overwrite during the dump may come out torn
+	std::lock_guard lock(m_Mutex);
+
+	int64_t origin = INT64_MAX;
+	for (const auto& buffer : m_ThreadBuffers)
+	{
+		const uint64_t count = buffer->writeCount.load(std::memory_order_acquire);
+		const uint64_t first = count > EVENTS_PER_THREAD ? count - EVENTS_PER_THREAD : 0;
+		for (uint64_t i = first; i < count; ++i)
+			origin = std::min(origin, buffer->events[i % EVENTS_PER_THREAD].begin);
+	}
+	if (origin == INT64_MAX)
+		origin = 0;
+
+	out << std::fixed;
+	out.precision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool isFirst = true;
+
+	for (const auto& buffer : m_ThreadBuffers)
+	{
+		out << (isFirst ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":";
+		WriteJsonString(out, buffer->threadName.c_str());
+		out << "}}";
+		isFirst = false;
+
+		const uint64_t count = buffer->writeCount.load(std::memory_order_acquire);
+		const uint64_t first = count > EVENTS_PER_THREAD ? count - EVENTS_PER_THREAD : 0;
+		for (uint64_t i = first; i < count; ++i)
+		{
+			const Event& event = buffer->events[i % EVENTS_PER_THREAD];
+			out << ",\n{\"name\":";
+			WriteJsonString(out, event.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+				<< ",\"ts\":" << static_cast<double>(event.begin - origin) / 1000.0
+				<< ",\"dur\":" << static_cast<double>(event.end - event.begin) / 1000.0 << "}";
+		}
+	}
+
+	out << "\n]}\n";
+}
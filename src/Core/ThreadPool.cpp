@@ -0,0 +1,115 @@
+#include "Core/ThreadPool.h"
+#include "Core/CpuProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <latch>
+#include <string>
+
+namespace
+{
+	thread_local uint32_t t_WorkerIndex = RUBY::ThreadPool::INVALID_WORKER;
+}
+
+RUBY::ThreadPool::ThreadPool(uint32_t workerCount, std::string name)
+	: m_Name(std::move(name))
+{
+	if (workerCount == 0)
+	{
+		const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	m_Workers.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+	}
+}
+
+RUBY::ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(m_Mutex);
+		m_IsStopping = true;
+	}
+	m_JobAvailable.notify_all();
+
+	for (auto& worker : m_Workers)
+		worker.join();
+}
+
+uint32_t RUBY::ThreadPool::GetCurrentWorkerIndex()
+{
+	return t_WorkerIndex;
+}
+
+void RUBY::ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t workerIndex)>& fn)
+{
+	if (count == 0)
+		return;
+
+	// One job per worker that keeps grabbing indices, cheaper than a job per index for small bodies
+	const uint32_t jobCount = std::min(count, GetWorkerCount());
+	std::atomic<uint32_t> nextIndex{ 0 };
+	std::latch done{ static_cast<std::ptrdiff_t>(jobCount) };
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	for (uint32_t job = 0; job < jobCount; ++job)
+	{
+		Enqueue([&]()
+		{
+			try
+			{
+				for (uint32_t index = nextIndex.fetch_add(1); index < count; index = nextIndex.fetch_add(1))
+					fn(index, t_WorkerIndex);
+			}
+			catch (...)
+			{
+				std::lock_guard lock(errorMutex);
+				if (!error)
+					error = std::current_exception();
+				nextIndex = count;
+			}
+			done.count_down();
+		});
+	}
+
+	done.wait();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void RUBY::ThreadPool::Enqueue(std::function<void()>&& job)
+{
+	{
+		std::lock_guard lock(m_Mutex);
+		m_Jobs.emplace_back(std::move(job));
+	}
+	m_JobAvailable.notify_one();
+}
+
+void RUBY::ThreadPool::WorkerLoop(uint32_t workerIndex)
+{
+	t_WorkerIndex = workerIndex;
+	RUBY_PROFILE_THREAD_NAME(m_Name + " " + std::to_string(workerIndex));
+
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock lock(m_Mutex);
+			m_JobAvailable.wait(lock, [this]() { return m_IsStopping || !m_Jobs.empty(); });
+
+			if (m_IsStopping && m_Jobs.empty())
+				return;
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+		}
+		job();
+	}
+}
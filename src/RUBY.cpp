@@ -1,32 +1,68 @@
 #include "RUBY.h"
 
+#include "Core/CpuProfiler.h"
+#include "Vulkan/Defragmenter.h"
 #include "Vulkan/Passes/DemoPass.h"
 
+#include <stdexcept>
+#include <string>
+
 namespace RUBY
 {
-    RUBY::RUBY(IRubyWindow* pWindow)
-        : m_pWindow(pWindow), m_Device(pWindow), m_CommandPool(&m_Device), m_SwapChain(pWindow, &m_Device, &m_CommandPool)
+    RUBY::RUBY(IRubyWindow* pWindow, uint32_t framesInFlight, DescriptorBackend descriptorBackend)
+        : m_pWindow(pWindow), m_Device(pWindow, Device::DEFAULT_PIPELINE_CACHE_PATH, descriptorBackend), m_CommandPool(&m_Device), m_SwapChain(pWindow, &m_Device, &m_CommandPool)
     {
+        SetFramesInFlight(framesInFlight);
         m_TrianglePass = std::make_unique<DemoPass>(&m_Device, &m_SwapChain);
+
+        // Offscreen images are read back by the caller, they stay in whatever layout the last pass left
+        m_RenderGraph.ImportImage(RenderGraph::BACKBUFFER,
+            m_SwapChain.IsOffscreen() ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        m_RenderGraph.AddPass("Triangle", m_TrianglePass.get());
     }
 
     RUBY::~RUBY()
     {
         vkDeviceWaitIdle(m_Device.GetLogicalDevice());
         m_TrianglePass.reset();
+        m_FrameContexts.clear();
+    }
+
+    void RUBY::SetFramesInFlight(uint32_t framesInFlight)
+    {
+        if (framesInFlight < FrameContext::MIN_FRAMES_IN_FLIGHT || framesInFlight > FrameContext::MAX_FRAMES_IN_FLIGHT)
+        {
+            throw std::out_of_range("frames in flight must be between " + std::to_string(FrameContext::MIN_FRAMES_IN_FLIGHT) +
+                " and " + std::to_string(FrameContext::MAX_FRAMES_IN_FLIGHT));
+        }
+
+        if (framesInFlight == GetFramesInFlight())
+            return;
+
+        // Contexts only wait for their timeline value, not for the presents and acquires still using their semaphores
+        vkDeviceWaitIdle(m_Device.GetLogicalDevice());
+        m_FrameContexts.clear();
+        for (uint32_t i = 0; i < framesInFlight; ++i)
+        {
+            m_FrameContexts.emplace_back(std::make_unique<FrameContext>(&m_Device, i, m_ThreadPool.GetWorkerCount()));
+        }
+        m_CurrentFrame = 0;
     }
 
     void RUBY::Render()
     {
+        RUBY_PROFILE_FUNCTION();
         uint32_t imageIndex;
         if (!BeginFrame(imageIndex)) return;
 
-        VkCommandBuffer cmd = m_CommandPool.GetCommandBuffers()[m_CurrentFrame];
-        vkResetCommandBuffer(cmd, 0);
+        VkCommandBuffer cmd = GetCurrentFrameContext().GetCommandBuffer();
 
         VkCommandBufferBeginInfo beginInfo{};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
         vkBeginCommandBuffer(cmd, &beginInfo);
+        if (const DescriptorBuffer* pDescriptorBuffer = m_Device.GetDescriptorBuffer())
+            pDescriptorBuffer->BindBuffer(cmd);
 
         RecordPasses(cmd, imageIndex);
 
@@ -36,15 +72,30 @@ namespace RUBY
 
     bool RUBY::BeginFrame(uint32_t& outImageIndex)
     {
-        vkWaitForFences(m_Device.GetLogicalDevice(), 1, &m_SwapChain.GetInFlightFence(m_CurrentFrame), VK_TRUE, UINT64_MAX);
+        RUBY_PROFILE_FUNCTION();
 
-        VkResult result = vkAcquireNextImageKHR(
-            m_Device.GetLogicalDevice(),
-            m_SwapChain.GetSwapChain(),
+        // Wait until the frame that last used this slot retired, then release whatever it left behind
+        FrameContext& frame = GetCurrentFrameContext();
+        {
+            RUBY_PROFILE_SCOPE("Wait For Frame Slot");
+            frame.Begin();
+        }
+        m_Device.CollectGarbage();
+        m_UploadManager.Update();
+        m_Device.GetDefragmenter().Update();
+        m_FrameRing.BeginFrame(m_CurrentFrame);
+        m_DescriptorAllocator.BeginFrame(m_CurrentFrame);
+        if (DescriptorBuffer* pDescriptorBuffer = m_Device.GetDescriptorBuffer())
+            pDescriptorBuffer->BeginFrame(m_CurrentFrame);
+
+        RUBY_PROFILE_SCOPE("Acquire Image");
+        VkResult result = VK_SUCCESS;
+        outImageIndex = m_SwapChain.AcquireNextImage(
             UINT64_MAX,
-            m_SwapChain.GetImageAvailableSemaphore(m_CurrentFrame),
+            m_CurrentFrame,
+            frame.GetImageAvailableSemaphore(),
             VK_NULL_HANDLE,
-            &outImageIndex
+            &result
         );
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR) {
@@ -55,47 +106,114 @@ namespace RUBY
             throw std::runtime_error("failed to acquire swap chain image!");
         }
 
-        vkResetFences(m_Device.GetLogicalDevice(), 1, &m_SwapChain.GetInFlightFence(m_CurrentFrame));
+        m_GpuProfiler.BeginFrame(m_CurrentFrame);
         return true;
     }
 
     void RUBY::RecordPasses(VkCommandBuffer& cmd, uint32_t& img)
     {
-        m_TrianglePass->Record(cmd, img);
+        RUBY_PROFILE_FUNCTION();
+        if (!m_RenderGraph.IsCompiled())
+            m_RenderGraph.Compile(m_SwapChain.GetExtent());
+
+        m_RenderGraph.BindImage(RenderGraph::BACKBUFFER, &m_SwapChain.GetImages()[img]);
+
+        // Ownership of this frame's finished uploads moves to the graphics queue before any pass reads them
+        m_UploadManager.RecordAcquires(cmd);
+
+        PassContext passContext{ &m_Device, &m_CommandPool, &m_SwapChain, &m_RenderGraph, &GetCurrentFrameContext(), &m_CommandRecorder, &m_GpuProfiler, &m_FrameRing, &m_DescriptorAllocator };
+
+        m_GpuProfiler.BeginScope(cmd, "Frame", false);
+        m_RenderGraph.Execute(cmd, img, passContext);
+        m_GpuProfiler.EndScope(cmd);
     }
 
     void RUBY::EndFrame(uint32_t imageIndex)
     {
-        VkCommandBuffer cmd = m_CommandPool.GetCommandBuffers()[m_CurrentFrame];
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-        VkSemaphore waitSemaphores[] = { m_SwapChain.GetImageAvailableSemaphore(m_CurrentFrame) };
-        VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = waitSemaphores;
-        submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &cmd;
-        VkSemaphore signalSemaphores[] = { m_SwapChain.GetRenderFinishedSemaphore(m_CurrentFrame) };
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = signalSemaphores;
-
-        if (vkQueueSubmit(m_Device.GetGraphicsQueue(), 1, &submitInfo, m_SwapChain.GetInFlightFence(m_CurrentFrame)) != VK_SUCCESS) {
-            throw std::runtime_error("failed to submit draw command buffer!");
+        RUBY_PROFILE_FUNCTION();
+        FrameContext& frame = GetCurrentFrameContext();
+        VkCommandBuffer cmd = frame.GetCommandBuffer();
+
+        // Offscreen swapchains have nothing to wait on or present, the timeline alone paces them
+        const bool offscreen = m_SwapChain.IsOffscreen();
+
+        std::vector<VkSemaphoreSubmitInfo> waitInfos;
+        if (!offscreen)
+        {
+            VkSemaphoreSubmitInfo& waitInfo = waitInfos.emplace_back();
+            waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+            waitInfo.semaphore = frame.GetImageAvailableSemaphore();
+            waitInfo.stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        }
+        // Compute batches the graph submitted earlier this frame
+        const auto& graphWaits = m_RenderGraph.GetFinalWaits();
+        waitInfos.insert(waitInfos.end(), graphWaits.begin(), graphWaits.end());
+        m_UploadManager.GetFrameWaits(waitInfos);
+
+        m_FrameRing.Flush();
+
+        // The timeline signal is added by Device::Submit
+        VkSemaphoreSubmitInfo signalInfo{};
+        signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signalInfo.semaphore = frame.GetRenderFinishedSemaphore();
+        signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkCommandBufferSubmitInfo cmdInfo{};
+        cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        cmdInfo.commandBuffer = cmd;
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waitInfos.size());
+        submitInfo.pWaitSemaphoreInfos = waitInfos.data();
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &cmdInfo;
+        submitInfo.signalSemaphoreInfoCount = offscreen ? 0 : 1;
+        submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+        uint64_t frameValue = 0;
+        {
+            RUBY_PROFILE_SCOPE("vkQueueSubmit2");
+            if (m_Device.Submit(QueueType::Graphics, submitInfo, frameValue) != VK_SUCCESS) {
+                throw std::runtime_error("failed to submit draw command buffer!");
+            }
+        }
+
+        frame.SetTimelineValue(frameValue);
+        m_LastFrameTimelineValue = frameValue;
+        m_RenderGraph.OnFrameSubmitted(frameValue);
+        m_Device.OnFrameSubmitted(frameValue);
+        m_GpuProfiler.EndFrame(frameValue);
+
+        if (offscreen)
+        {
+            // No surface to report OUT_OF_DATE, so compare against the window size ourselves
+            const VkExtent2D extent = m_SwapChain.GetExtent();
+            if (m_FramebufferResized ||
+                extent.width != static_cast<uint32_t>(m_pWindow->GetWidth()) ||
+                extent.height != static_cast<uint32_t>(m_pWindow->GetHeight()))
+            {
+                m_FramebufferResized = false;
+                RecreateSwapChain();
+            }
+            m_CurrentFrame = (m_CurrentFrame + 1) % GetFramesInFlight();
+            return;
         }
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = signalSemaphores;
+        presentInfo.pWaitSemaphores = &signalInfos[1].semaphore;
         VkSwapchainKHR swapChains[] = { m_SwapChain.GetSwapChain() };
         presentInfo.swapchainCount = 1;
         presentInfo.pSwapchains = swapChains;
         presentInfo.pImageIndices = &imageIndex;
 
-        VkResult result = vkQueuePresentKHR(m_Device.GetPresentQueue(), &presentInfo);
+        VkResult result;
+        {
+            RUBY_PROFILE_SCOPE("vkQueuePresentKHR");
+            result = m_Device.Present(presentInfo);
+        }
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || m_FramebufferResized) {
             m_FramebufferResized = false;
@@ -105,13 +223,15 @@ namespace RUBY
             throw std::runtime_error("failed to present swap chain image!");
         }
 
-        m_CurrentFrame = (m_CurrentFrame + 1) % SwapChain::MAX_FRAMES_IN_FLIGHT;
+        m_CurrentFrame = (m_CurrentFrame + 1) % GetFramesInFlight();
     }
 
     void RUBY::RecreateSwapChain()
     {
+        RUBY_PROFILE_FUNCTION();
         vkDeviceWaitIdle(m_Device.GetLogicalDevice());
         m_SwapChain.RecreateSwapChain();
-        m_TrianglePass->Recreate(&m_SwapChain);
+        m_TrianglePass->OnResize();
+        m_RenderGraph.Invalidate();
     }
 }
@@ -0,0 +1,285 @@
+#include "Vulkan/BindlessHeap.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "Vulkan/DescriptorAllocator.h"
+#include "Vulkan/Device.h"
+
+namespace
+{
+	constexpr std::array<VkDescriptorType, static_cast<size_t>(RUBY::BindlessType::Count)> DESCRIPTOR_TYPES{
+		VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+		VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_SAMPLER,
+	};
+
+	// Upper bounds, lowered to what the device allows
+	constexpr std::array<uint32_t, static_cast<size_t>(RUBY::BindlessType::Count)> DESIRED_CAPACITIES{ 16384, 4096, 16384, 256 };
+	// Per-stage resources left to the other sets and the attachments of a pipeline using the heap
+	constexpr uint32_t RESERVED_STAGE_RESOURCES = 64;
+}
+
+RUBY::BindlessHeap::BindlessHeap(Device* pDevice)
+	: m_pDevice(pDevice), m_pDescriptorBuffer(pDevice->GetDescriptorBuffer())
+{
+	VkPhysicalDeviceVulkan12Properties properties12{};
+	properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &properties12;
+	vkGetPhysicalDeviceProperties2(pDevice->GetPhysicalDevice(), &properties);
+
+	// The descriptor buffer layout isn't update-after-bind, the regular limits apply to it
+	const VkPhysicalDeviceLimits& deviceLimits = properties.properties.limits;
+	const std::array<uint32_t, static_cast<size_t>(BindlessType::Count)> limits = m_pDescriptorBuffer
+		? std::array<uint32_t, static_cast<size_t>(BindlessType::Count)>{
+			std::min(deviceLimits.maxDescriptorSetSampledImages, deviceLimits.maxPerStageDescriptorSampledImages),
+			std::min(deviceLimits.maxDescriptorSetStorageImages, deviceLimits.maxPerStageDescriptorStorageImages),
+			std::min(deviceLimits.maxDescriptorSetStorageBuffers, deviceLimits.maxPerStageDescriptorStorageBuffers),
+			std::min(deviceLimits.maxDescriptorSetSamplers, deviceLimits.maxPerStageDescriptorSamplers),
+		}
+		: std::array<uint32_t, static_cast<size_t>(BindlessType::Count)>{
+			std::min(properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages),
+			std::min(properties12.maxDescriptorSetUpdateAfterBindStorageImages, properties12.maxPerStageDescriptorUpdateAfterBindStorageImages),
+			std::min(properties12.maxDescriptorSetUpdateAfterBindStorageBuffers, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers),
+			std::min(properties12.maxDescriptorSetUpdateAfterBindSamplers, properties12.maxPerStageDescriptorUpdateAfterBindSamplers),
+		};
+
+	for (uint32_t i = 0; i < m_Slots.size(); ++i)
+		m_Slots[i].capacity = std::min(DESIRED_CAPACITIES[i], limits[i]);
+
+	// Every array is visible to all stages, so together they also have to fit the per-stage resource limit.
+	// Samplers don't count towards it, the rest is scaled down evenly, leaving room for the pipeline's other sets.
+	const uint32_t stageLimit = m_pDescriptorBuffer ? deviceLimits.maxPerStageResources : properties12.maxPerStageUpdateAfterBindResources;
+	const uint64_t resourceBudget = stageLimit > RESERVED_STAGE_RESOURCES * 2 ? stageLimit - RESERVED_STAGE_RESOURCES : stageLimit / 2;
+	uint64_t resourceCount = 0;
+	for (uint32_t i = 0; i < m_Slots.size(); ++i)
+	{
+		if (DESCRIPTOR_TYPES[i] != VK_DESCRIPTOR_TYPE_SAMPLER)
+			resourceCount += m_Slots[i].capacity;
+	}
+	if (resourceCount > resourceBudget)
+	{
+		for (uint32_t i = 0; i < m_Slots.size(); ++i)
+		{
+			if (DESCRIPTOR_TYPES[i] != VK_DESCRIPTOR_TYPE_SAMPLER)
+				m_Slots[i].capacity = static_cast<uint32_t>(m_Slots[i].capacity * resourceBudget / resourceCount);
+		}
+	}
+
+	// The set also has to fit the descriptor buffer's persistent region, which the device limits may have shrunk
+	if (m_pDescriptorBuffer)
+	{
+		uint64_t setSize = 0;
+		for (uint32_t i = 0; i < m_Slots.size(); ++i)
+			setSize += static_cast<uint64_t>(m_Slots[i].capacity) * m_pDescriptorBuffer->GetDescriptorSize(DESCRIPTOR_TYPES[i]);
+		const uint64_t space = m_pDescriptorBuffer->GetPersistentSpace();
+		if (setSize > space)
+		{
+			for (SlotAllocator& slots : m_Slots)
+				slots.capacity = static_cast<uint32_t>(slots.capacity * space / setSize);
+		}
+	}
+
+	std::array<VkDescriptorSetLayoutBinding, static_cast<size_t>(BindlessType::Count)> bindings{};
+	std::array<VkDescriptorBindingFlags, static_cast<size_t>(BindlessType::Count)> bindingFlags{};
+	std::array<VkDescriptorPoolSize, static_cast<size_t>(BindlessType::Count)> poolSizes{};
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = DESCRIPTOR_TYPES[i];
+		bindings[i].descriptorCount = m_Slots[i].capacity;
+		bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+		// Descriptor buffers are plain memory, updating them while bound needs no flags
+		if (!m_pDescriptorBuffer)
+		{
+			bindingFlags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+				VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+		}
+		poolSizes[i] = { DESCRIPTOR_TYPES[i], m_Slots[i].capacity };
+	}
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags = m_pDescriptorBuffer ? pDevice->GetDescriptorSetLayoutFlags() : VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	const VkDevice device = pDevice->GetLogicalDevice();
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_SetLayout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create bindless descriptor set layout!");
+	}
+
+	if (m_pDescriptorBuffer)
+	{
+		m_DescriptorBufferSet = m_pDescriptorBuffer->AllocatePersistent(m_SetLayout);
+		return;
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &m_Pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create bindless descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_Pool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_SetLayout;
+	if (vkAllocateDescriptorSets(device, &allocInfo, &m_Set) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate bindless descriptor set!");
+	}
+
+	pDevice->GetDebugger().SetDebugName(reinterpret_cast<uint64_t>(m_Set), "Bindless Heap", VK_OBJECT_TYPE_DESCRIPTOR_SET);
+}
+
+RUBY::BindlessHeap::~BindlessHeap()
+{
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	if (m_Pool != VK_NULL_HANDLE)
+		vkDestroyDescriptorPool(device, m_Pool, nullptr);
+	vkDestroyDescriptorSetLayout(device, m_SetLayout, nullptr);
+}
+
+uint32_t RUBY::BindlessHeap::RegisterSampledImage(VkImageView imageView)
+{
+	const VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	const uint32_t index = AllocateSlot(BindlessType::SampledImage);
+	Write(BindlessType::SampledImage, index, &imageInfo, nullptr);
+	return index;
+}
+
+uint32_t RUBY::BindlessHeap::RegisterStorageImage(VkImageView imageView)
+{
+	const VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL };
+	const uint32_t index = AllocateSlot(BindlessType::StorageImage);
+	Write(BindlessType::StorageImage, index, &imageInfo, nullptr);
+	return index;
+}
+
+uint32_t RUBY::BindlessHeap::RegisterStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	const VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+	const uint32_t index = AllocateSlot(BindlessType::StorageBuffer);
+	Write(BindlessType::StorageBuffer, index, nullptr, &bufferInfo);
+	return index;
+}
+
+uint32_t RUBY::BindlessHeap::RegisterSampler(VkSampler sampler)
+{
+	const VkDescriptorImageInfo imageInfo{ sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED };
+	const uint32_t index = AllocateSlot(BindlessType::Sampler);
+	Write(BindlessType::Sampler, index, &imageInfo, nullptr);
+	return index;
+}
+
+void RUBY::BindlessHeap::UpdateSampledImage(uint32_t index, VkImageView imageView)
+{
+	const VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+	Write(BindlessType::SampledImage, index, &imageInfo, nullptr);
+}
+
+void RUBY::BindlessHeap::UpdateStorageImage(uint32_t index, VkImageView imageView)
+{
+	const VkDescriptorImageInfo imageInfo{ VK_NULL_HANDLE, imageView, VK_IMAGE_LAYOUT_GENERAL };
+	Write(BindlessType::StorageImage, index, &imageInfo, nullptr);
+}
+
+void RUBY::BindlessHeap::UpdateStorageBuffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+{
+	const VkDescriptorBufferInfo bufferInfo{ buffer, offset, range };
+	Write(BindlessType::StorageBuffer, index, nullptr, &bufferInfo);
+}
+
+void RUBY::BindlessHeap::Release(BindlessType type, uint32_t index)
+{
+	if (index == INVALID_INDEX)
+		return;
+
+	// Frames already recorded may still index the slot, it only becomes reusable once they finished
+	m_pDevice->DeferDestroy([this, type, index]()
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_Slots[static_cast<uint32_t>(type)].freeSlots.push_back(index);
+	});
+}
+
+void RUBY::BindlessHeap::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t setIndex) const
+{
+	if (m_pDescriptorBuffer)
+		m_pDescriptorBuffer->Bind(commandBuffer, bindPoint, layout, setIndex, m_DescriptorBufferSet);
+	else
+		vkCmdBindDescriptorSets(commandBuffer, bindPoint, layout, setIndex, 1, &m_Set, 0, nullptr);
+}
+
+uint32_t RUBY::BindlessHeap::GetUsedCount(BindlessType type) const
+{
+	std::lock_guard lock{ m_Mutex };
+	const SlotAllocator& slots = m_Slots[static_cast<uint32_t>(type)];
+	return slots.next - static_cast<uint32_t>(slots.freeSlots.size());
+}
+
+uint32_t RUBY::BindlessHeap::AllocateSlot(BindlessType type)
+{
+	std::lock_guard lock{ m_Mutex };
+	SlotAllocator& slots = m_Slots[static_cast<uint32_t>(type)];
+	if (!slots.freeSlots.empty())
+	{
+		const uint32_t index = slots.freeSlots.back();
+		slots.freeSlots.pop_back();
+		return index;
+	}
+
+	if (slots.next >= slots.capacity)
+	{
+		throw std::runtime_error("Bindless heap is full (" + std::to_string(slots.capacity) + " descriptors of type " +
+			std::to_string(static_cast<uint32_t>(type)) + ")");
+	}
+	return slots.next++;
+}
+
+void RUBY::BindlessHeap::Write(BindlessType type, uint32_t index, const VkDescriptorImageInfo* pImageInfo, const VkDescriptorBufferInfo* pBufferInfo)
+{
+	if (m_pDescriptorBuffer)
+	{
+		// Every slot is its own memory, no lock needed
+		DescriptorWriter writer{};
+		if (pImageInfo)
+			writer.WriteImage(static_cast<uint32_t>(type), DESCRIPTOR_TYPES[static_cast<uint32_t>(type)], *pImageInfo, index);
+		else
+			writer.WriteBuffer(static_cast<uint32_t>(type), DESCRIPTOR_TYPES[static_cast<uint32_t>(type)], *pBufferInfo, index);
+		m_pDescriptorBuffer->Write(m_DescriptorBufferSet, writer);
+		return;
+	}
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = m_Set;
+	write.dstBinding = static_cast<uint32_t>(type);
+	write.dstArrayElement = index;
+	write.descriptorCount = 1;
+	write.descriptorType = DESCRIPTOR_TYPES[static_cast<uint32_t>(type)];
+	write.pImageInfo = pImageInfo;
+	write.pBufferInfo = pBufferInfo;
+
+	// Updates of one set must be externally synchronized
+	std::lock_guard lock{ m_Mutex };
+	vkUpdateDescriptorSets(m_pDevice->GetLogicalDevice(), 1, &write, 0, nullptr);
+}
@@ -1,11 +1,45 @@
 #include "Vulkan/Buffer.h"
 
+#include <cassert>
+#include <cstring>
 #include <stdexcept>
+#include <utility>
 
 //#define VMA_IMPLEMENTATION
 #include "vulkan/vulkan.h"
 #include "vk_mem_alloc.h"
 
+#include "Vulkan/BindlessHeap.h"
+#include "Vulkan/Defragmenter.h"
+#include "Vulkan/Device.h"
+#include "Vulkan/MemoryTracker.h"
+
+namespace
+{
+	bool IsStaging(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+	{
+		constexpr VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		return (usage & ~transferUsage) == 0 && (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	}
+
+	const char* GetDefaultName(VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+	{
+		if (IsStaging(usage, properties))
+			return "Staging Buffer";
+		if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+			return "Vertex Buffer";
+		if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+			return "Index Buffer";
+		if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+			return "Uniform Buffer";
+		if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+			return "Storage Buffer";
+		if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT)
+			return "Indirect Buffer";
+		return "Buffer";
+	}
+}
+
 RUBY::Buffer::Buffer(Device* pDevice, CommandPool* pCommandPool, const VkBufferCreateInfo& bufferInfo, const VkMemoryPropertyFlags properties, HostAccess hostAcces)
 	: m_pDevice(pDevice), m_pCommandPool(pCommandPool)
 {
@@ -25,16 +59,108 @@ RUBY::Buffer::Buffer(Device* pDevice, CommandPool* pCommandPool, const VkBufferC
 		break;
 	}
 
+	CreateBuffer(bufferInfo, allocInfo);
+}
+
+RUBY::Buffer::Buffer(Device* pDevice, CommandPool* pCommandPool, const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocInfo)
+	: m_pDevice(pDevice), m_pCommandPool(pCommandPool)
+{
+	CreateBuffer(bufferInfo, allocInfo);
+}
+
+void RUBY::Buffer::CreateBuffer(const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocInfo)
+{
 	m_Size = bufferInfo.size;
 
-	vmaCreateBuffer(pDevice->GetAllocator(), &bufferInfo, &allocInfo, &m_Buffer, &m_BufferAllocation, nullptr);
-	vmaSetAllocationName(pDevice->GetAllocator(), m_BufferAllocation, "MyBuffer");
+	// Descriptor buffers reference uniform and storage buffers by device address
+	VkBufferCreateInfo createInfo = bufferInfo;
+	if (m_pDevice->GetDescriptorBackend() == DescriptorBackend::DescriptorBuffer &&
+		(createInfo.usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)))
+	{
+		createInfo.usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+
+	m_CreateInfo = createInfo;
+	m_CreateInfo.pNext = nullptr;
+
+	VmaAllocationInfo allocationInfo{};
+	if (vmaCreateBuffer(m_pDevice->GetAllocator(), &createInfo, &allocInfo, &m_Buffer, &m_BufferAllocation, &allocationInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create buffer!");
+	}
+
+	m_pMappedData = allocationInfo.pMappedData;
+	vmaGetAllocationMemoryProperties(m_pDevice->GetAllocator(), m_BufferAllocation, &m_MemoryProperties);
+
+	const MemoryCategory category = IsStaging(bufferInfo.usage, m_MemoryProperties) ? MemoryCategory::Staging : MemoryCategory::Buffer;
+	m_pDevice->GetMemoryTracker().Track(m_BufferAllocation, category, GetDefaultName(bufferInfo.usage, m_MemoryProperties));
+}
+
+void RUBY::Buffer::RegisterBindless()
+{
+	if (m_BindlessIndex != BindlessHeap::INVALID_INDEX || !(m_CreateInfo.usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT))
+		return;
+	m_BindlessIndex = m_pDevice->GetBindlessHeap().RegisterStorageBuffer(m_Buffer, 0, m_Size);
+}
+
+void RUBY::Buffer::ReleaseBindless()
+{
+	if (m_BindlessIndex == BindlessHeap::INVALID_INDEX)
+		return;
+	m_pDevice->GetBindlessHeap().Release(BindlessType::StorageBuffer, m_BindlessIndex);
+	m_BindlessIndex = BindlessHeap::INVALID_INDEX;
 }
 
 RUBY::Buffer::~Buffer()
 {
+	ReleaseBindless();
 	if (m_Buffer != VK_NULL_HANDLE && m_BufferAllocation != VK_NULL_HANDLE)
-		vmaDestroyBuffer(m_pDevice->GetAllocator(), m_Buffer, m_BufferAllocation);
+	{
+		m_pDevice->GetMemoryTracker().Untrack(m_BufferAllocation);
+
+		// An allocation the running defragmentation pass is moving is freed by the Defragmenter once the pass ends
+		VkDevice device = m_pDevice->GetLogicalDevice();
+		VkBuffer buffer = m_Buffer;
+		if (!m_pDevice->GetDefragmenter().ReleaseAllocation(m_BufferAllocation, [device, buffer]() { vkDestroyBuffer(device, buffer, nullptr); }))
+			vmaDestroyBuffer(m_pDevice->GetAllocator(), m_Buffer, m_BufferAllocation);
+	}
+}
+
+void RUBY::Buffer::SetRelocatable(bool relocatable)
+{
+	if (relocatable == m_IsRelocatable)
+		return;
+
+	if (relocatable)
+	{
+		constexpr VkBufferUsageFlags transferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		if ((m_CreateInfo.usage & transferUsage) != transferUsage || m_CreateInfo.sharingMode != VK_SHARING_MODE_EXCLUSIVE ||
+			(m_MemoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		{
+			throw std::logic_error("Relocatable buffers need TRANSFER_SRC/DST usage, exclusive sharing and memory that is not host visible");
+		}
+		m_pDevice->GetDefragmenter().Register(m_BufferAllocation, this);
+	}
+	else
+	{
+		m_pDevice->GetDefragmenter().Unregister(m_BufferAllocation);
+	}
+	m_IsRelocatable = relocatable;
+}
+
+VkBuffer RUBY::Buffer::Relocate(VkBuffer newBuffer)
+{
+	VkBuffer oldBuffer = std::exchange(m_Buffer, newBuffer);
+	// Shaders keep the index, the Defragmenter drained every command buffer that could read the slot
+	if (m_BindlessIndex != BindlessHeap::INVALID_INDEX)
+		m_pDevice->GetBindlessHeap().UpdateStorageBuffer(m_BindlessIndex, m_Buffer, 0, m_Size);
+	return oldBuffer;
+}
+
+void RUBY::Buffer::SetName(const std::string& name) const
+{
+	m_pDevice->GetDebugger().SetDebugName(reinterpret_cast<uint64_t>(m_Buffer), name, VK_OBJECT_TYPE_BUFFER);
+	m_pDevice->GetMemoryTracker().SetName(m_BufferAllocation, name);
 }
 
 RUBY::Buffer::Buffer(Buffer&& other) noexcept
@@ -43,18 +169,41 @@ RUBY::Buffer::Buffer(Buffer&& other) noexcept
 	m_BufferAllocation = other.m_BufferAllocation;
 	m_pDevice = other.m_pDevice;
 	m_pCommandPool = other.m_pCommandPool;
+	m_Size = other.m_Size;
+	m_pMappedData = other.m_pMappedData;
+	m_MemoryProperties = other.m_MemoryProperties;
+	m_BindlessIndex = std::exchange(other.m_BindlessIndex, BindlessHeap::INVALID_INDEX);
+	m_CreateInfo = other.m_CreateInfo;
+	m_IsRelocatable = std::exchange(other.m_IsRelocatable, false);
 	other.m_Buffer = VK_NULL_HANDLE;
 	other.m_BufferAllocation = VK_NULL_HANDLE;
+	other.m_pMappedData = nullptr;
+
+	if (m_IsRelocatable)
+		m_pDevice->GetDefragmenter().Register(m_BufferAllocation, this);
 }
 
 RUBY::Buffer& RUBY::Buffer::operator=(Buffer&& other) noexcept
 {
+	ReleaseBindless();
+	if (m_IsRelocatable)
+		m_pDevice->GetDefragmenter().Unregister(m_BufferAllocation);
 	m_Buffer = other.m_Buffer;
 	m_BufferAllocation = other.m_BufferAllocation;
 	m_pDevice = other.m_pDevice;
 	m_pCommandPool = other.m_pCommandPool;
+	m_Size = other.m_Size;
+	m_pMappedData = other.m_pMappedData;
+	m_MemoryProperties = other.m_MemoryProperties;
+	m_BindlessIndex = std::exchange(other.m_BindlessIndex, BindlessHeap::INVALID_INDEX);
+	m_CreateInfo = other.m_CreateInfo;
+	m_IsRelocatable = std::exchange(other.m_IsRelocatable, false);
 	other.m_Buffer = VK_NULL_HANDLE;
 	other.m_BufferAllocation = VK_NULL_HANDLE;
+	other.m_pMappedData = nullptr;
+
+	if (m_IsRelocatable)
+		m_pDevice->GetDefragmenter().Register(m_BufferAllocation, this);
 
 	return *this;
 }
@@ -62,16 +211,68 @@ RUBY::Buffer& RUBY::Buffer::operator=(Buffer&& other) noexcept
 void RUBY::Buffer::CopyBuffer(VkBuffer srcBuffer, VkDeviceSize size) const
 {
     VkCommandBuffer commandBuffer = m_pCommandPool->BeginSingleTimeCommands();
+    CopyBuffer(commandBuffer, srcBuffer, size);
+    m_pCommandPool->EndSingleTimeCommands(commandBuffer);
+}
 
+void RUBY::Buffer::CopyBuffer(VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkDeviceSize size) const
+{
     VkBufferCopy copyRegion{};
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, srcBuffer, m_Buffer, 1, &copyRegion);
-
-    m_pCommandPool->EndSingleTimeCommands(commandBuffer);
 }
 
-void RUBY::Buffer::CopyMemory(void* data, const VkDeviceSize& size, int offset) const
+void RUBY::Buffer::CopyMemory(const void* data, const VkDeviceSize& size, int offset) const
 {
 	assert(offset + size <= m_Size && "CopyMemory out of bounds!");
+	if (m_pMappedData != nullptr)
+	{
+		// Already mapped, skip the map/unmap pair; the flush is a no-op on coherent memory
+		std::memcpy(static_cast<char*>(m_pMappedData) + offset, data, size);
+		vmaFlushAllocation(m_pDevice->GetAllocator(), m_BufferAllocation, offset, size);
+		return;
+	}
 	vmaCopyMemoryToAllocation(m_pDevice->GetAllocator(), data, m_BufferAllocation, offset, size);
 }
+
+void RUBY::Buffer::ReleaseOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+	VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess) const
+{
+	VkBufferMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	barrier.srcStageMask = srcStage;
+	barrier.srcAccessMask = srcAccess;
+	barrier.srcQueueFamilyIndex = srcQueueFamily;
+	barrier.dstQueueFamilyIndex = dstQueueFamily;
+	barrier.buffer = m_Buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.bufferMemoryBarrierCount = 1;
+	dependencyInfo.pBufferMemoryBarriers = &barrier;
+
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+void RUBY::Buffer::AcquireOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+	VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess) const
+{
+	VkBufferMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	barrier.dstStageMask = dstStage;
+	barrier.dstAccessMask = dstAccess;
+	barrier.srcQueueFamilyIndex = srcQueueFamily;
+	barrier.dstQueueFamilyIndex = dstQueueFamily;
+	barrier.buffer = m_Buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.bufferMemoryBarrierCount = 1;
+	dependencyInfo.pBufferMemoryBarriers = &barrier;
+
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
@@ -1,18 +1,62 @@
 #include "Vulkan/CommandPool.h"
-#include "Vulkan/SwapChain.h"
+#include "Vulkan/Buffer.h"
+#include "Vulkan/TimelineSemaphore.h"
+#include "Core/CpuProfiler.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 
-RUBY::CommandPool::CommandPool(Device* pDevice)
-	: m_pDevice(pDevice)
+RUBY::CommandPool::CommandPool(Device* pDevice, uint32_t commandBufferCount, VkCommandPoolCreateFlags flags, const std::string& debugName, QueueType queueType)
+	: m_pDevice(pDevice), m_QueueType(queueType), m_CanResetCommandBuffers((flags & VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT) != 0)
 {
-	CreateCommandPool();
-	CreateCommandBuffers();
+	CreateCommandPool(flags, debugName);
+	CreateCommandBuffers(commandBufferCount);
+}
+
+void RUBY::CommandPool::Reset()
+{
+	vkResetCommandPool(m_pDevice->GetLogicalDevice(), m_CommandPool, 0);
+	m_PrimaryInUse = 0;
+	m_SecondaryInUse = 0;
+}
+
+VkCommandBuffer RUBY::CommandPool::AcquirePrimaryCommandBuffer()
+{
+	return AcquireCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, m_PrimaryCommandBuffers, m_PrimaryInUse);
+}
+
+VkCommandBuffer RUBY::CommandPool::AcquireSecondaryCommandBuffer()
+{
+	return AcquireCommandBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY, m_SecondaryCommandBuffers, m_SecondaryInUse);
+}
+
+VkCommandBuffer RUBY::CommandPool::AcquireCommandBuffer(VkCommandBufferLevel level, std::vector<VkCommandBuffer>& buffers, uint32_t& inUse)
+{
+	if (inUse == buffers.size())
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_CommandPool;
+		allocInfo.level = level;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_pDevice->GetLogicalDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate command buffer!");
+		}
+		buffers.push_back(commandBuffer);
+	}
+
+	return buffers[inUse++];
 }
 
 RUBY::CommandPool::~CommandPool()
 {
+	if (!m_ImmediateBatches.empty())
+		m_pDevice->GetTimeline(m_QueueType).Wait(m_ImmediateBatches.back().timelineValue);
+	m_ImmediateBatches.clear();
+
 	vkDestroyCommandPool(m_pDevice->GetLogicalDevice(), m_CommandPool, nullptr);
 }
 
@@ -38,34 +82,168 @@ VkCommandBuffer RUBY::CommandPool::BeginSingleTimeCommands() const
 
 void RUBY::CommandPool::EndSingleTimeCommands(VkCommandBuffer commandBuffer) const
 {
+	RUBY_PROFILE_FUNCTION();
 	vkEndCommandBuffer(commandBuffer);
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	VkFenceCreateInfo fenceInfo{ VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-	VkFence fence;
-	vkCreateFence(m_pDevice->GetLogicalDevice(), &fenceInfo, nullptr, &fence);
+	// Completion is tracked on the device timeline instead of a throwaway fence
+	VkCommandBufferSubmitInfo cmdInfo{};
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	cmdInfo.commandBuffer = commandBuffer;
 
-	vkQueueSubmit(m_pDevice->GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE);
-	vkWaitForFences(m_pDevice->GetLogicalDevice(), 1, &fence, VK_TRUE, UINT64_MAX);
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &cmdInfo;
 
-	vkDestroyFence(m_pDevice->GetLogicalDevice(), fence, nullptr);
-	//vkQueueWaitIdle(m_pDevice->GetGraphicsQueue());
+	uint64_t signalValue = 0;
+	if (m_pDevice->Submit(m_QueueType, submitInfo, signalValue) != VK_SUCCESS)
+	{
+		vkFreeCommandBuffers(m_pDevice->GetLogicalDevice(), m_CommandPool, 1, &commandBuffer);
+		throw std::runtime_error("Failed to submit single time commands!");
+	}
+	m_pDevice->GetTimeline(m_QueueType).Wait(signalValue);
 
 	vkFreeCommandBuffers(m_pDevice->GetLogicalDevice(), m_CommandPool, 1, &commandBuffer);
 }
 
-void RUBY::CommandPool::CreateCommandPool()
+VkCommandBuffer RUBY::CommandPool::BeginImmediate()
 {
-	Device::QueueFamilyIndices queueFamilyIndices = m_pDevice->FindQueueFamilies(m_pDevice->GetPhysicalDevice());
+	if (m_ImmediateDepth++ > 0)
+		return m_ImmediateBatches.back().commandBuffer;
+
+	TimelineSemaphore& timeline = m_pDevice->GetTimeline(m_QueueType);
+	for (auto& batch : m_ImmediateBatches)
+	{
+		if (timeline.IsComplete(batch.timelineValue))
+			batch.stagingBuffers.clear();
+	}
+
+	// Reuse the oldest batch once the GPU is done with it, submissions that didn't wait may still be running
+	ImmediateBatch batch{};
+	if (!m_ImmediateBatches.empty() && timeline.IsComplete(m_ImmediateBatches.front().timelineValue))
+	{
+		batch = std::move(m_ImmediateBatches.front());
+		m_ImmediateBatches.pop_front();
+
+		if (!m_CanResetCommandBuffers)
+		{
+			vkFreeCommandBuffers(m_pDevice->GetLogicalDevice(), m_CommandPool, 1, &batch.commandBuffer);
+			batch.commandBuffer = VK_NULL_HANDLE;
+		}
+	}
 
+	if (batch.commandBuffer == VK_NULL_HANDLE)
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_CommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(m_pDevice->GetLogicalDevice(), &allocInfo, &batch.commandBuffer) != VK_SUCCESS)
+		{
+			m_ImmediateDepth = 0;
+			throw std::runtime_error("Failed to allocate immediate command buffer!");
+		}
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+	m_ImmediateBatches.push_back(std::move(batch));
+	return m_ImmediateBatches.back().commandBuffer;
+}
+
+uint64_t RUBY::CommandPool::EndImmediate(bool wait)
+{
+	if (m_ImmediateDepth == 0)
+	{
+		throw std::logic_error("EndImmediate without a matching BeginImmediate");
+	}
+
+	// Nested contexts are part of the outermost one
+	if (--m_ImmediateDepth > 0)
+		return 0;
+
+	RUBY_PROFILE_FUNCTION();
+	ImmediateBatch& batch = m_ImmediateBatches.back();
+	vkEndCommandBuffer(batch.commandBuffer);
+
+	VkCommandBufferSubmitInfo cmdInfo{};
+	cmdInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	cmdInfo.commandBuffer = batch.commandBuffer;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &cmdInfo;
+
+	uint64_t signalValue = 0;
+	if (m_pDevice->Submit(m_QueueType, submitInfo, signalValue) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit immediate commands!");
+	}
+	batch.timelineValue = signalValue;
+
+	if (wait)
+		m_pDevice->GetTimeline(m_QueueType).Wait(signalValue);
+	return signalValue;
+}
+
+RUBY::Buffer& RUBY::CommandPool::AllocateImmediateStaging(VkDeviceSize size)
+{
+	if (m_ImmediateDepth == 0)
+	{
+		throw std::logic_error("Immediate staging requested without an open ImmediateContext");
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	auto& stagingBuffers = m_ImmediateBatches.back().stagingBuffers;
+	Buffer& stagingBuffer = *stagingBuffers.emplace_back(std::make_unique<Buffer>(m_pDevice, this, bufferInfo,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		HostAccess::Sequential));
+	stagingBuffer.SetName("Immediate Staging");
+	return stagingBuffer;
+}
+
+RUBY::Buffer& RUBY::CommandPool::AdoptImmediateStaging(std::unique_ptr<Buffer> pBuffer)
+{
+	if (m_ImmediateDepth == 0)
+	{
+		throw std::logic_error("Immediate staging adopted without an open ImmediateContext");
+	}
+	if (!pBuffer)
+	{
+		throw std::invalid_argument("Adopted immediate staging buffer is null");
+	}
+	return *m_ImmediateBatches.back().stagingBuffers.emplace_back(std::move(pBuffer));
+}
+
+bool RUBY::CommandPool::OwnsImmediateStaging(const Buffer& buffer) const
+{
+	if (m_ImmediateDepth == 0)
+		return false;
+
+	const auto& stagingBuffers = m_ImmediateBatches.back().stagingBuffers;
+	return std::any_of(stagingBuffers.begin(), stagingBuffers.end(), [&buffer](const std::unique_ptr<Buffer>& pStaging)
+	{
+		return pStaging.get() == &buffer;
+	});
+}
+
+void RUBY::CommandPool::CreateCommandPool(VkCommandPoolCreateFlags flags, const std::string& debugName)
+{
 	VkCommandPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+	poolInfo.flags = flags;
+	poolInfo.queueFamilyIndex = m_pDevice->GetQueueFamily(m_QueueType);
 
 	VkResult result = vkCreateCommandPool(m_pDevice->GetLogicalDevice(), &poolInfo, nullptr, &m_CommandPool);
 	if ( result != VK_SUCCESS)
@@ -75,14 +253,17 @@ void RUBY::CommandPool::CreateCommandPool()
 
 	m_pDevice->GetDebugger().SetDebugName(
 		reinterpret_cast<uint64_t>(m_CommandPool),
-		"Main Command Pool",
+		debugName,
 		VK_OBJECT_TYPE_COMMAND_POOL
 	);
 }
 
-void RUBY::CommandPool::CreateCommandBuffers()
+void RUBY::CommandPool::CreateCommandBuffers(uint32_t count)
 {
-	m_CommandBuffers.resize(SwapChain::MAX_FRAMES_IN_FLIGHT);
+	if (count == 0)
+		return;
+
+	m_CommandBuffers.resize(count);
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -0,0 +1,470 @@
+#include "Vulkan/Defragmenter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "vulkan/vulkan.h"
+#include "vk_mem_alloc.h"
+
+#include "Core/CpuProfiler.h"
+#include "Vulkan/Buffer.h"
+#include "Vulkan/Device.h"
+#include "Vulkan/Image.h"
+#include "Vulkan/TimelineSemaphore.h"
+
+namespace
+{
+	// Every aspect holding data, the image's own aspect flags only name the one its view reads
+	VkImageAspectFlags GetCopyAspects(VkFormat format, VkImageAspectFlags fallback)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		case VK_FORMAT_S8_UINT:
+			return VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return fallback;
+		}
+	}
+}
+
+RUBY::Defragmenter::Defragmenter(Device* pDevice)
+	: m_pDevice(pDevice)
+	, m_CommandPool(pDevice, 0, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, "Defragmentation Command Pool")
+	, m_pPass(std::make_unique<VmaDefragmentationPassMoveInfo>())
+{
+}
+
+RUBY::Defragmenter::~Defragmenter()
+{
+	std::lock_guard lock{ m_Mutex };
+	if (m_IsPassOpen)
+	{
+		m_pDevice->GetTimeline().Wait(m_PassValue);
+		EndPass();
+	}
+	if (m_Context != nullptr)
+		Finish();
+}
+
+void RUBY::Defragmenter::SetFrameBudget(VkDeviceSize maxBytes, std::chrono::microseconds maxTime)
+{
+	// Both budgets end up in the VMA pass limits, so they only apply from the next Start on
+	m_MaxBytesPerFrame = maxBytes;
+	m_MaxTimePerFrame = maxTime;
+}
+
+void RUBY::Defragmenter::Start()
+{
+	std::lock_guard lock{ m_Mutex };
+	BeginDefragmentation();
+}
+
+void RUBY::Defragmenter::Update()
+{
+	RUBY_PROFILE_FUNCTION();
+	std::lock_guard lock{ m_Mutex };
+
+	if (m_IsPassOpen)
+	{
+		if (!m_pDevice->GetTimeline().IsComplete(m_PassValue))
+			return;
+		// Freeing the moved-from memory is the expensive part, the next pass waits for the next frame
+		EndPass();
+		return;
+	}
+
+	if (m_Context == nullptr)
+	{
+		if (m_FragmentationThreshold <= 0.0f || ++m_FramesSinceCheck < CHECK_INTERVAL)
+			return;
+		m_FramesSinceCheck = 0;
+		if (GetFragmentation() < m_FragmentationThreshold)
+			return;
+		BeginDefragmentation();
+	}
+
+	BeginPass();
+}
+
+float RUBY::Defragmenter::GetFragmentation() const
+{
+	VmaTotalStatistics statistics{};
+	vmaCalculateStatistics(m_pDevice->GetAllocator(), &statistics);
+
+	const VmaStatistics& total = statistics.total.statistics;
+	if (total.blockBytes == 0)
+		return 0.0f;
+	return 1.0f - static_cast<float>(static_cast<double>(total.allocationBytes) / static_cast<double>(total.blockBytes));
+}
+
+void RUBY::Defragmenter::Register(VmaAllocation allocation, Buffer* pBuffer)
+{
+	std::lock_guard lock{ m_Mutex };
+	m_Owners[allocation] = { pBuffer, nullptr };
+}
+
+void RUBY::Defragmenter::Register(VmaAllocation allocation, Image* pImage)
+{
+	std::lock_guard lock{ m_Mutex };
+	m_Owners[allocation] = { nullptr, pImage };
+}
+
+void RUBY::Defragmenter::Unregister(VmaAllocation allocation)
+{
+	std::lock_guard lock{ m_Mutex };
+	m_Owners.erase(allocation);
+}
+
+bool RUBY::Defragmenter::ReleaseAllocation(VmaAllocation allocation, std::function<void()>&& destroyHandle)
+{
+	std::lock_guard lock{ m_Mutex };
+	m_Owners.erase(allocation);
+	if (!m_IsPassOpen)
+		return false;
+
+	for (uint32_t i = 0; i < m_pPass->moveCount; ++i)
+	{
+		VmaDefragmentationMove& move = m_pPass->pMoves[i];
+		if (move.srcAllocation != allocation)
+			continue;
+
+		// VMA frees both the source and the reserved destination when the pass ends
+		move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+		m_PassDestroys.push_back(std::move(destroyHandle));
+		return true;
+	}
+	return false;
+}
+
+void RUBY::Defragmenter::AddBusy(VmaAllocation allocation)
+{
+	std::lock_guard lock{ m_Mutex };
+	++m_BusyCounts[allocation];
+}
+
+void RUBY::Defragmenter::RemoveBusy(VmaAllocation allocation)
+{
+	std::lock_guard lock{ m_Mutex };
+	auto it = m_BusyCounts.find(allocation);
+	if (it != m_BusyCounts.end() && --it->second == 0)
+		m_BusyCounts.erase(it);
+}
+
+uint32_t RUBY::Defragmenter::AddRelocationListener(std::function<void(const std::vector<uint64_t>& oldHandles)>&& listener)
+{
+	std::lock_guard lock{ m_Mutex };
+	const uint32_t id = m_NextListenerId++;
+	m_RelocationListeners.emplace_back(id, std::move(listener));
+	return id;
+}
+
+void RUBY::Defragmenter::RemoveRelocationListener(uint32_t id)
+{
+	std::lock_guard lock{ m_Mutex };
+	std::erase_if(m_RelocationListeners, [id](const auto& listener) { return listener.first == id; });
+}
+
+void RUBY::Defragmenter::BeginDefragmentation()
+{
+	if (m_Context != nullptr)
+		return;
+
+	VmaDefragmentationInfo info{};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+	info.maxBytesPerPass = m_MaxBytesPerFrame;
+	info.maxAllocationsPerPass = m_MovesPerPass;
+
+	if (vmaBeginDefragmentation(m_pDevice->GetAllocator(), &info, &m_Context) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to begin defragmentation!");
+	}
+}
+
+void RUBY::Defragmenter::BeginPass()
+{
+	*m_pPass = {};
+	const VkResult result = vmaBeginDefragmentationPass(m_pDevice->GetAllocator(), m_Context, m_pPass.get());
+	if (result == VK_SUCCESS)
+	{
+		// Nothing left to move
+		Finish();
+		return;
+	}
+	if (result != VK_INCOMPLETE)
+	{
+		throw std::runtime_error("Failed to begin defragmentation pass!");
+	}
+	m_IsPassOpen = true;
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	std::chrono::steady_clock::time_point recordStart{};
+	uint32_t recordedMoves = 0;
+	std::vector<VkImageMemoryBarrier2> afterBarriers;
+
+	for (uint32_t i = 0; i < m_pPass->moveCount; ++i)
+	{
+		VmaDefragmentationMove& move = m_pPass->pMoves[i];
+		auto it = m_Owners.find(move.srcAllocation);
+		// Tells VMA the allocation can't move, only for owners that really can't
+		if (it == m_Owners.end() || m_BusyCounts.contains(move.srcAllocation))
+		{
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+			continue;
+		}
+
+		if (commandBuffer == VK_NULL_HANDLE)
+		{
+			// Bindless slots are rewritten in place, no frame in flight may still read them
+			TimelineSemaphore& timeline = m_pDevice->GetTimeline();
+			timeline.Wait(timeline.GetPendingValue());
+			TimelineSemaphore& computeTimeline = m_pDevice->GetComputeTimeline();
+			computeTimeline.Wait(computeTimeline.GetPendingValue());
+			recordStart = std::chrono::steady_clock::now();
+
+			commandBuffer = m_CommandPool.AcquirePrimaryCommandBuffer();
+
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+			// Whatever earlier submissions wrote to the moved resources has to land before the copies read it
+			VkMemoryBarrier2 barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+			VkDependencyInfo dependencyInfo{};
+			dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+			dependencyInfo.memoryBarrierCount = 1;
+			dependencyInfo.pMemoryBarriers = &barrier;
+			vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+		}
+
+		const bool moved = it->second.pBuffer != nullptr
+			? RecordBufferMove(commandBuffer, *it->second.pBuffer, move.dstTmpAllocation)
+			: RecordImageMove(commandBuffer, *it->second.pImage, move.dstTmpAllocation, afterBarriers);
+		if (moved)
+			++recordedMoves;
+		else
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+	}
+
+	if (commandBuffer == VK_NULL_HANDLE)
+	{
+		// Only allocations nobody can move are left, stop instead of offering them again every frame
+		EndPass();
+		if (m_Context != nullptr)
+			Finish();
+		return;
+	}
+
+	// Planned moves are never dropped for time, instead the next run plans as many as fit the time budget
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - recordStart);
+	if (recordedMoves != 0 && elapsed.count() > 0)
+	{
+		const auto fitting = static_cast<uint64_t>(recordedMoves) * static_cast<uint64_t>(m_MaxTimePerFrame.count()) / static_cast<uint64_t>(elapsed.count());
+		m_MovesPerPass = static_cast<uint32_t>(std::clamp<uint64_t>(fitting, 1, MAX_MOVES_PER_PASS));
+	}
+
+	// Frames recorded from here on must not pick up cached descriptors of the old handles
+	for (auto& [id, listener] : m_RelocationListeners)
+		listener(m_PassOldHandles);
+	m_PassOldHandles.clear();
+
+	// Later submissions on the graphics queue see the copied contents and the new layouts
+	VkMemoryBarrier2 barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.memoryBarrierCount = 1;
+	dependencyInfo.pMemoryBarriers = &barrier;
+	dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(afterBarriers.size());
+	dependencyInfo.pImageMemoryBarriers = afterBarriers.data();
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+	Submit(commandBuffer);
+}
+
+void RUBY::Defragmenter::EndPass()
+{
+	// Old handles go before VMA releases the memory they are bound to
+	for (auto& destroyFn : m_PassDestroys)
+		destroyFn();
+	m_PassDestroys.clear();
+	m_CommandPool.Reset();
+
+	const VkResult result = vmaEndDefragmentationPass(m_pDevice->GetAllocator(), m_Context, m_pPass.get());
+	m_IsPassOpen = false;
+	*m_pPass = {};
+	if (result == VK_SUCCESS)
+		Finish();
+}
+
+void RUBY::Defragmenter::Finish()
+{
+	VmaDefragmentationStats stats{};
+	vmaEndDefragmentation(m_pDevice->GetAllocator(), m_Context, &stats);
+	m_Context = nullptr;
+
+	m_Stats.bytesMoved += stats.bytesMoved;
+	m_Stats.bytesFreed += stats.bytesFreed;
+	m_Stats.allocationsMoved += stats.allocationsMoved;
+	m_Stats.deviceMemoryBlocksFreed += stats.deviceMemoryBlocksFreed;
+}
+
+bool RUBY::Defragmenter::RecordBufferMove(VkCommandBuffer commandBuffer, Buffer& buffer, VmaAllocation dstAllocation)
+{
+	VkDevice device = m_pDevice->GetLogicalDevice();
+
+	VkBuffer newBuffer = VK_NULL_HANDLE;
+	if (vkCreateBuffer(device, &buffer.m_CreateInfo, nullptr, &newBuffer) != VK_SUCCESS)
+		return false;
+	if (vmaBindBufferMemory(m_pDevice->GetAllocator(), dstAllocation, newBuffer) != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device, newBuffer, nullptr);
+		return false;
+	}
+
+	VkBufferCopy region{};
+	region.size = buffer.m_Size;
+	vkCmdCopyBuffer(commandBuffer, buffer.m_Buffer, newBuffer, 1, &region);
+
+	VkBuffer oldBuffer = buffer.Relocate(newBuffer);
+	m_PassOldHandles.push_back(reinterpret_cast<uint64_t>(oldBuffer));
+	m_PassDestroys.push_back([device, oldBuffer]() { vkDestroyBuffer(device, oldBuffer, nullptr); });
+	return true;
+}
+
+bool RUBY::Defragmenter::RecordImageMove(VkCommandBuffer commandBuffer, Image& image, VmaAllocation dstAllocation,
+	std::vector<VkImageMemoryBarrier2>& outAfterBarriers)
+{
+	VkDevice device = m_pDevice->GetLogicalDevice();
+
+	VkImageCreateInfo createInfo = image.m_CreateInfo;
+	createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImage newImage = VK_NULL_HANDLE;
+	if (vkCreateImage(device, &createInfo, nullptr, &newImage) != VK_SUCCESS)
+		return false;
+	if (vmaBindImageMemory(m_pDevice->GetAllocator(), dstAllocation, newImage) != VK_SUCCESS)
+	{
+		vkDestroyImage(device, newImage, nullptr);
+		return false;
+	}
+
+	// Nothing to copy from an image that was never written
+	const VkImageLayout layout = image.m_ImageLayout;
+	if (layout != VK_IMAGE_LAYOUT_UNDEFINED && layout != VK_IMAGE_LAYOUT_PREINITIALIZED)
+	{
+		const VkImageAspectFlags aspects = GetCopyAspects(createInfo.format, image.m_ImageAspectFlags);
+		const VkImageSubresourceRange range{ aspects, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+		VkImageMemoryBarrier2 barriers[2]{};
+		barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		barriers[0].srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+		barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+		barriers[0].oldLayout = layout;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].image = image.m_Image;
+		barriers[0].subresourceRange = range;
+
+		barriers[1] = barriers[0];
+		barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barriers[1].srcAccessMask = VK_ACCESS_2_NONE;
+		barriers[1].dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].image = newImage;
+
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.imageMemoryBarrierCount = 2;
+		dependencyInfo.pImageMemoryBarriers = barriers;
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+		std::vector<VkImageCopy> regions(createInfo.mipLevels);
+		for (uint32_t mip = 0; mip < createInfo.mipLevels; ++mip)
+		{
+			VkImageCopy& region = regions[mip];
+			region.srcSubresource = { aspects, mip, 0, createInfo.arrayLayers };
+			region.dstSubresource = region.srcSubresource;
+			region.extent.width = std::max(createInfo.extent.width >> mip, 1u);
+			region.extent.height = std::max(createInfo.extent.height >> mip, 1u);
+			region.extent.depth = std::max(createInfo.extent.depth >> mip, 1u);
+		}
+		vkCmdCopyImage(commandBuffer, image.m_Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()), regions.data());
+
+		// The new image continues in the layout the owner believes it is in
+		VkImageMemoryBarrier2& after = outAfterBarriers.emplace_back(barriers[1]);
+		after.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		after.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		after.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		after.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+		after.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		after.newLayout = layout;
+	}
+
+	VkImage oldImage = VK_NULL_HANDLE;
+	VkImageView oldView = VK_NULL_HANDLE;
+	image.Relocate(newImage, oldImage, oldView);
+	m_PassOldHandles.push_back(reinterpret_cast<uint64_t>(oldView));
+	m_PassDestroys.push_back([device, oldImage, oldView]()
+	{
+		vkDestroyImageView(device, oldView, nullptr);
+		vkDestroyImage(device, oldImage, nullptr);
+	});
+	return true;
+}
+
+void RUBY::Defragmenter::Submit(VkCommandBuffer commandBuffer)
+{
+	vkEndCommandBuffer(commandBuffer);
+
+	// Async compute batches of earlier frames and uploads on the transfer queue may still touch the moved resources
+	std::vector<VkSemaphoreSubmitInfo> waits;
+	TimelineSemaphore& computeTimeline = m_pDevice->GetComputeTimeline();
+	if (m_pDevice->HasAsyncComputeQueue() && computeTimeline.GetPendingValue() != 0)
+		waits.push_back(computeTimeline.GetSubmitInfo(computeTimeline.GetPendingValue(), VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT));
+	TimelineSemaphore& transferTimeline = m_pDevice->GetTransferTimeline();
+	if (m_pDevice->HasAsyncTransferQueue() && transferTimeline.GetPendingValue() != 0)
+		waits.push_back(transferTimeline.GetSubmitInfo(transferTimeline.GetPendingValue(), VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT));
+
+	VkCommandBufferSubmitInfo commandBufferInfo{};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	commandBufferInfo.commandBuffer = commandBuffer;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size());
+	submitInfo.pWaitSemaphoreInfos = waits.data();
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+
+	uint64_t signalValue = 0;
+	if (m_pDevice->Submit(QueueType::Graphics, submitInfo, signalValue) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit defragmentation copies!");
+	}
+	m_PassValue = signalValue;
+}
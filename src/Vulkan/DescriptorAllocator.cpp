@@ -0,0 +1,391 @@
+#include "Vulkan/DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "Core/CpuProfiler.h"
+#include "Vulkan/Defragmenter.h"
+#include "Vulkan/DescriptorBuffer.h"
+#include "Vulkan/Device.h"
+
+namespace
+{
+	void HashValue(uint64_t& hash, uint64_t value)
+	{
+		// FNV-1a, one field at a time so struct padding never reaches the hash
+		for (int i = 0; i < 8; ++i)
+		{
+			hash ^= (value >> (i * 8)) & 0xFF;
+			hash *= 1099511628211ull;
+		}
+	}
+}
+
+RUBY::DescriptorWriter& RUBY::DescriptorWriter::WriteBuffer(uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& bufferInfo, uint32_t arrayElement)
+{
+	Write write{};
+	write.binding = binding;
+	write.arrayElement = arrayElement;
+	write.type = type;
+	write.bufferInfo = bufferInfo;
+	m_Writes.push_back(write);
+	return *this;
+}
+
+RUBY::DescriptorWriter& RUBY::DescriptorWriter::WriteImage(uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo& imageInfo, uint32_t arrayElement)
+{
+	Write write{};
+	write.binding = binding;
+	write.arrayElement = arrayElement;
+	write.type = type;
+	write.imageInfo = imageInfo;
+	m_Writes.push_back(write);
+	return *this;
+}
+
+void RUBY::DescriptorWriter::Update(VkDevice device, VkDescriptorSet set) const
+{
+	if (m_Writes.empty())
+		return;
+
+	const std::vector<VkWriteDescriptorSet> writes = BuildWrites(set);
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void RUBY::DescriptorWriter::Push(const Device& device, VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set) const
+{
+	if (m_Writes.empty())
+		return;
+
+	// dstSet is ignored for pushes
+	const std::vector<VkWriteDescriptorSet> writes = BuildWrites(VK_NULL_HANDLE);
+	device.CmdPushDescriptorSet(commandBuffer, bindPoint, layout, set, static_cast<uint32_t>(writes.size()), writes.data());
+}
+
+std::vector<VkWriteDescriptorSet> RUBY::DescriptorWriter::BuildWrites(VkDescriptorSet set) const
+{
+	std::vector<VkWriteDescriptorSet> writes(m_Writes.size());
+	for (size_t i = 0; i < m_Writes.size(); ++i)
+	{
+		const Write& source = m_Writes[i];
+		VkWriteDescriptorSet& write = writes[i];
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = source.binding;
+		write.dstArrayElement = source.arrayElement;
+		write.descriptorCount = 1;
+		write.descriptorType = source.type;
+		if (IsImageType(source.type))
+			write.pImageInfo = &source.imageInfo;
+		else
+			write.pBufferInfo = &source.bufferInfo;
+	}
+	return writes;
+}
+
+uint64_t RUBY::DescriptorWriter::GetHash() const
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (const Write& write : m_Writes)
+	{
+		HashValue(hash, (uint64_t(write.binding) << 32) | write.arrayElement);
+		HashValue(hash, write.type);
+		if (IsImageType(write.type))
+		{
+			HashValue(hash, reinterpret_cast<uint64_t>(write.imageInfo.sampler));
+			HashValue(hash, reinterpret_cast<uint64_t>(write.imageInfo.imageView));
+			HashValue(hash, write.imageInfo.imageLayout);
+		}
+		else
+		{
+			HashValue(hash, reinterpret_cast<uint64_t>(write.bufferInfo.buffer));
+			HashValue(hash, write.bufferInfo.offset);
+			HashValue(hash, write.bufferInfo.range);
+		}
+	}
+	return hash;
+}
+
+bool RUBY::DescriptorWriter::operator==(const DescriptorWriter& other) const
+{
+	return std::equal(m_Writes.begin(), m_Writes.end(), other.m_Writes.begin(), other.m_Writes.end(),
+		[](const Write& a, const Write& b)
+		{
+			if (a.binding != b.binding || a.arrayElement != b.arrayElement || a.type != b.type)
+				return false;
+			if (IsImageType(a.type))
+				return a.imageInfo.sampler == b.imageInfo.sampler && a.imageInfo.imageView == b.imageInfo.imageView &&
+					a.imageInfo.imageLayout == b.imageInfo.imageLayout;
+			return a.bufferInfo.buffer == b.bufferInfo.buffer && a.bufferInfo.offset == b.bufferInfo.offset &&
+				a.bufferInfo.range == b.bufferInfo.range;
+		});
+}
+
+bool RUBY::DescriptorWriter::IsImageType(VkDescriptorType type)
+{
+	switch (type)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER:
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+	case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+RUBY::DescriptorAllocator::DescriptorAllocator(Device* pDevice, uint32_t frameCount, const std::vector<PoolSizeRatio>& ratios)
+	: m_pDevice(pDevice), m_Ratios(ratios), m_FrameChains(frameCount)
+{
+	m_RelocationListener = pDevice->GetDefragmenter().AddRelocationListener([this](const std::vector<uint64_t>& oldHandles)
+	{
+		Invalidate(oldHandles);
+	});
+}
+
+RUBY::DescriptorAllocator::~DescriptorAllocator()
+{
+	m_pDevice->GetDefragmenter().RemoveRelocationListener(m_RelocationListener);
+
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	auto destroyChain = [device](PoolChain& chain)
+	{
+		if (chain.current != VK_NULL_HANDLE)
+			vkDestroyDescriptorPool(device, chain.current, nullptr);
+		for (VkDescriptorPool pool : chain.full)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+	};
+
+	for (PoolChain& chain : m_FrameChains)
+		destroyChain(chain);
+	destroyChain(m_PersistentChain);
+	for (VkDescriptorPool pool : m_FreePools)
+		vkDestroyDescriptorPool(device, pool, nullptr);
+}
+
+void RUBY::DescriptorAllocator::BeginFrame(uint32_t frameIndex)
+{
+	if (frameIndex >= m_FrameChains.size())
+	{
+		throw std::out_of_range("Descriptor allocator has no pools for frame " + std::to_string(frameIndex));
+	}
+
+	std::lock_guard lock{ m_Mutex };
+	m_FrameIndex = frameIndex;
+
+	// The frame retired, every set it allocated is dead. The current pool stays with the frame, overflow pools
+	// go back to be shared with the other frames.
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	PoolChain& chain = m_FrameChains[frameIndex];
+	if (chain.current != VK_NULL_HANDLE)
+		vkResetDescriptorPool(device, chain.current, 0);
+	for (VkDescriptorPool pool : chain.full)
+	{
+		vkResetDescriptorPool(device, pool, 0);
+		m_FreePools.push_back(pool);
+	}
+	chain.full.clear();
+}
+
+VkDescriptorSet RUBY::DescriptorAllocator::Allocate(VkDescriptorSetLayout layout)
+{
+	CheckPoolBackend();
+	std::lock_guard lock{ m_Mutex };
+	return AllocateFromChain(m_FrameChains[m_FrameIndex], layout);
+}
+
+VkDescriptorSet RUBY::DescriptorAllocator::Allocate(VkDescriptorSetLayout layout, const DescriptorWriter& writer)
+{
+	const VkDescriptorSet set = Allocate(layout);
+	writer.Update(m_pDevice->GetLogicalDevice(), set);
+	return set;
+}
+
+void RUBY::DescriptorAllocator::BindTransient(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout,
+	uint32_t setIndex, VkDescriptorSetLayout setLayout, const DescriptorWriter& writer)
+{
+	if (DescriptorBuffer* pDescriptorBuffer = m_pDevice->GetDescriptorBuffer())
+	{
+		const DescriptorBufferSet set = pDescriptorBuffer->Allocate(setLayout);
+		pDescriptorBuffer->Write(set, writer);
+		pDescriptorBuffer->Bind(commandBuffer, bindPoint, pipelineLayout, setIndex, set);
+		return;
+	}
+
+	const VkDescriptorSet set = Allocate(setLayout, writer);
+	vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &set, 0, nullptr);
+}
+
+VkDescriptorSet RUBY::DescriptorAllocator::GetOrCreate(VkDescriptorSetLayout layout, const DescriptorWriter& writer)
+{
+	CheckPoolBackend();
+	uint64_t hash = writer.GetHash();
+	HashValue(hash, reinterpret_cast<uint64_t>(layout));
+
+	std::lock_guard lock{ m_Mutex };
+	std::vector<CachedSet>& bucket = m_Cache[hash];
+	for (const CachedSet& cached : bucket)
+	{
+		if (cached.layout == layout && cached.writer == writer)
+		{
+			m_CacheHits.fetch_add(1, std::memory_order_relaxed);
+			return cached.set;
+		}
+	}
+
+	m_CacheMisses.fetch_add(1, std::memory_order_relaxed);
+	const VkDescriptorSet set = AllocateFromChain(m_PersistentChain, layout);
+	writer.Update(m_pDevice->GetLogicalDevice(), set);
+	bucket.push_back({ layout, writer, set });
+	++m_CachedSetCount;
+	return set;
+}
+
+void RUBY::DescriptorAllocator::ClearCache()
+{
+	std::lock_guard lock{ m_Mutex };
+	m_Cache.clear();
+	m_CachedSetCount = 0;
+
+	std::vector<VkDescriptorPool> pools = std::move(m_PersistentChain.full);
+	if (m_PersistentChain.current != VK_NULL_HANDLE)
+		pools.push_back(m_PersistentChain.current);
+	m_PersistentChain = {};
+	m_PoolCount -= static_cast<uint32_t>(pools.size());
+
+	// Recorded frames may still bind the cached sets
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	m_pDevice->DeferDestroy([device, pools = std::move(pools)]()
+	{
+		for (VkDescriptorPool pool : pools)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+	});
+}
+
+void RUBY::DescriptorAllocator::Invalidate(const std::vector<uint64_t>& handles)
+{
+	auto referencesHandle = [&handles](const CachedSet& cached)
+	{
+		return std::any_of(cached.writer.GetWrites().begin(), cached.writer.GetWrites().end(), [&handles](const DescriptorWriter::Write& write)
+		{
+			const uint64_t writeHandles[] = {
+				reinterpret_cast<uint64_t>(write.bufferInfo.buffer),
+				reinterpret_cast<uint64_t>(write.imageInfo.imageView),
+				reinterpret_cast<uint64_t>(write.imageInfo.sampler),
+			};
+			return std::any_of(std::begin(writeHandles), std::end(writeHandles), [&handles](uint64_t handle)
+			{
+				return handle != 0 && std::find(handles.begin(), handles.end(), handle) != handles.end();
+			});
+		});
+	};
+
+	std::lock_guard lock{ m_Mutex };
+	for (auto it = m_Cache.begin(); it != m_Cache.end();)
+	{
+		m_CachedSetCount -= std::erase_if(it->second, referencesHandle);
+		if (it->second.empty())
+			it = m_Cache.erase(it);
+		else
+			++it;
+	}
+}
+
+uint32_t RUBY::DescriptorAllocator::GetPoolCount() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return m_PoolCount;
+}
+
+size_t RUBY::DescriptorAllocator::GetCachedSetCount() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return m_CachedSetCount;
+}
+
+std::vector<RUBY::DescriptorAllocator::PoolSizeRatio> RUBY::DescriptorAllocator::GetDefaultRatios()
+{
+	return {
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1.f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f },
+	};
+}
+
+VkDescriptorSet RUBY::DescriptorAllocator::AllocateFromChain(PoolChain& chain, VkDescriptorSetLayout layout)
+{
+	if (chain.current == VK_NULL_HANDLE)
+		chain.current = AcquirePool();
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = chain.current;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		chain.full.push_back(chain.current);
+		chain.current = AcquirePool();
+		allocInfo.descriptorPool = chain.current;
+		result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		// A fresh pool failing means the layout needs more descriptors than a whole pool holds
+		throw std::runtime_error("Failed to allocate descriptor set (VkResult " + std::to_string(result) + ")");
+	}
+	return set;
+}
+
+void RUBY::DescriptorAllocator::CheckPoolBackend() const
+{
+	if (m_pDevice->GetDescriptorBackend() != DescriptorBackend::Pools)
+	{
+		throw std::logic_error("Descriptor buffer layouts can't be allocated from pools, use BindTransient or the device DescriptorBuffer");
+	}
+}
+
+VkDescriptorPool RUBY::DescriptorAllocator::AcquirePool()
+{
+	if (!m_FreePools.empty())
+	{
+		const VkDescriptorPool pool = m_FreePools.back();
+		m_FreePools.pop_back();
+		return pool;
+	}
+
+	RUBY_PROFILE_FUNCTION();
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	poolSizes.reserve(m_Ratios.size());
+	for (const PoolSizeRatio& ratio : m_Ratios)
+		poolSizes.push_back({ ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * m_SetsPerPool)) });
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = m_SetsPerPool;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	VkDescriptorPool pool = VK_NULL_HANDLE;
+	if (vkCreateDescriptorPool(m_pDevice->GetLogicalDevice(), &poolInfo, nullptr, &pool) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+
+	// Every overflow means the workload outgrew the pools, the next one is larger
+	m_SetsPerPool = std::min(m_SetsPerPool + m_SetsPerPool / 2, MAX_SETS_PER_POOL);
+	++m_PoolCount;
+	return pool;
+}
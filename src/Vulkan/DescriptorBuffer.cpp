@@ -0,0 +1,263 @@
+#include "Vulkan/DescriptorBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "vulkan/vulkan.h"
+#include "vk_mem_alloc.h"
+
+#include "Vulkan/Buffer.h"
+#include "Vulkan/DescriptorAllocator.h"
+#include "Vulkan/Device.h"
+
+namespace
+{
+	VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+RUBY::DescriptorBuffer::DescriptorBuffer(Device* pDevice, uint32_t frameCount, VkDeviceSize persistentSize, VkDeviceSize frameSize)
+	: m_pDevice(pDevice), m_FrameCount(frameCount)
+{
+	m_Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &m_Properties;
+	vkGetPhysicalDeviceProperties2(pDevice->GetPhysicalDevice(), &properties);
+
+	const VkDevice device = pDevice->GetLogicalDevice();
+	m_vkGetDescriptorSetLayoutSize = reinterpret_cast<PFN_vkGetDescriptorSetLayoutSizeEXT>(vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutSizeEXT"));
+	m_vkGetDescriptorSetLayoutBindingOffset = reinterpret_cast<PFN_vkGetDescriptorSetLayoutBindingOffsetEXT>(vkGetDeviceProcAddr(device, "vkGetDescriptorSetLayoutBindingOffsetEXT"));
+	m_vkGetDescriptor = reinterpret_cast<PFN_vkGetDescriptorEXT>(vkGetDeviceProcAddr(device, "vkGetDescriptorEXT"));
+	m_vkCmdBindDescriptorBuffers = reinterpret_cast<PFN_vkCmdBindDescriptorBuffersEXT>(vkGetDeviceProcAddr(device, "vkCmdBindDescriptorBuffersEXT"));
+	m_vkCmdSetDescriptorBufferOffsets = reinterpret_cast<PFN_vkCmdSetDescriptorBufferOffsetsEXT>(vkGetDeviceProcAddr(device, "vkCmdSetDescriptorBufferOffsetsEXT"));
+	if (!m_vkGetDescriptorSetLayoutSize || !m_vkGetDescriptorSetLayoutBindingOffset || !m_vkGetDescriptor ||
+		!m_vkCmdBindDescriptorBuffers || !m_vkCmdSetDescriptorBufferOffsets)
+	{
+		throw std::runtime_error("VK_EXT_descriptor_buffer entry points are missing!");
+	}
+
+	const VkDeviceSize alignment = m_Properties.descriptorBufferOffsetAlignment;
+	m_PersistentSize = AlignUp(persistentSize, alignment);
+	m_FrameSize = AlignUp(frameSize, alignment);
+
+	const VkDeviceSize size = m_PersistentSize + m_FrameSize * frameCount;
+	const VkDeviceSize maxSize = GetMaxSize(pDevice->GetPhysicalDevice());
+	if (size > maxSize)
+	{
+		throw std::runtime_error("Descriptor buffer of " + std::to_string(size) + " bytes exceeds the device limit of " +
+			std::to_string(maxSize) + " bytes");
+	}
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	m_Usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT | VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+	// Without bufferlessPushDescriptors push descriptors need a bound buffer with this usage to live in
+	if (pDevice->SupportsPushDescriptors() && !m_Properties.bufferlessPushDescriptors)
+		m_Usage |= VK_BUFFER_USAGE_PUSH_DESCRIPTORS_DESCRIPTOR_BUFFER_BIT_EXT;
+	bufferInfo.usage = m_Usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// Coherent so descriptor writes never need a flush before submission
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+	allocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	m_pBuffer = std::make_unique<Buffer>(pDevice, nullptr, bufferInfo, allocInfo);
+	m_pBuffer->SetName("Descriptor Buffer");
+
+	VkBufferDeviceAddressInfo addressInfo{};
+	addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	addressInfo.buffer = m_pBuffer->GetBuffer();
+	m_BufferAddress = vkGetBufferDeviceAddress(device, &addressInfo);
+
+	BeginFrame(0);
+}
+
+RUBY::DescriptorBuffer::~DescriptorBuffer() = default;
+
+void RUBY::DescriptorBuffer::BeginFrame(uint32_t frameIndex)
+{
+	if (frameIndex >= m_FrameCount)
+	{
+		throw std::out_of_range("Descriptor buffer has no segment for frame " + std::to_string(frameIndex));
+	}
+
+	m_FrameBegin = m_PersistentSize + m_FrameSize * frameIndex;
+	m_FrameEnd = m_FrameBegin + m_FrameSize;
+	m_Head.store(m_FrameBegin, std::memory_order_relaxed);
+}
+
+RUBY::DescriptorBufferSet RUBY::DescriptorBuffer::Allocate(VkDescriptorSetLayout layout)
+{
+	return AllocateFrom(m_Head, m_FrameEnd, layout, "frame");
+}
+
+RUBY::DescriptorBufferSet RUBY::DescriptorBuffer::AllocatePersistent(VkDescriptorSetLayout layout)
+{
+	return AllocateFrom(m_PersistentHead, m_PersistentSize, layout, "persistent");
+}
+
+void RUBY::DescriptorBuffer::WriteDescriptor(const DescriptorBufferSet& set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+	const VkDescriptorDataEXT& data) const
+{
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	VkDeviceSize bindingOffset = 0;
+	m_vkGetDescriptorSetLayoutBindingOffset(device, set.layout, binding, &bindingOffset);
+
+	VkDescriptorGetInfoEXT getInfo{};
+	getInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+	getInfo.type = type;
+	getInfo.data = data;
+
+	// Array elements are packed at the descriptor size of their type
+	const size_t descriptorSize = GetDescriptorSize(type);
+	m_vkGetDescriptor(device, &getInfo, descriptorSize, set.pData + bindingOffset + arrayElement * descriptorSize);
+}
+
+void RUBY::DescriptorBuffer::Write(const DescriptorBufferSet& set, const DescriptorWriter& writer) const
+{
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+	for (const DescriptorWriter::Write& write : writer.GetWrites())
+	{
+		VkDescriptorDataEXT data{};
+		VkDescriptorAddressInfoEXT addressInfo{};
+		switch (write.type)
+		{
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+			data.pSampler = &write.imageInfo.sampler;
+			break;
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+			data.pCombinedImageSampler = &write.imageInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+			data.pSampledImage = &write.imageInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+			data.pStorageImage = &write.imageInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			data.pInputAttachmentImage = &write.imageInfo;
+			break;
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		{
+			if (write.bufferInfo.range == VK_WHOLE_SIZE)
+			{
+				throw std::invalid_argument("Descriptor buffer writes need an explicit range (binding " + std::to_string(write.binding) + ")");
+			}
+			VkBufferDeviceAddressInfo bufferAddressInfo{};
+			bufferAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+			bufferAddressInfo.buffer = write.bufferInfo.buffer;
+
+			addressInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+			addressInfo.address = vkGetBufferDeviceAddress(device, &bufferAddressInfo) + write.bufferInfo.offset;
+			addressInfo.range = write.bufferInfo.range;
+			if (write.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER)
+				data.pUniformBuffer = &addressInfo;
+			else
+				data.pStorageBuffer = &addressInfo;
+			break;
+		}
+		default:
+			// Dynamic buffers don't exist with descriptor buffers, offset the binding instead
+			throw std::invalid_argument("Descriptor type " + std::to_string(write.type) + " is not supported by the descriptor buffer backend");
+		}
+
+		WriteDescriptor(set, write.binding, write.arrayElement, write.type, data);
+	}
+}
+
+void RUBY::DescriptorBuffer::BindBuffer(VkCommandBuffer commandBuffer) const
+{
+	VkDescriptorBufferBindingInfoEXT bindingInfo{};
+	bindingInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+	bindingInfo.address = m_BufferAddress;
+	bindingInfo.usage = m_Usage;
+
+	VkDescriptorBufferBindingPushDescriptorBufferHandleEXT pushDescriptorBuffer{};
+	pushDescriptorBuffer.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_PUSH_DESCRIPTOR_BUFFER_HANDLE_EXT;
+	pushDescriptorBuffer.buffer = m_pBuffer->GetBuffer();
+	if (m_Usage & VK_BUFFER_USAGE_PUSH_DESCRIPTORS_DESCRIPTOR_BUFFER_BIT_EXT)
+		bindingInfo.pNext = &pushDescriptorBuffer;
+
+	m_vkCmdBindDescriptorBuffers(commandBuffer, 1, &bindingInfo);
+}
+
+void RUBY::DescriptorBuffer::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t setIndex,
+	const DescriptorBufferSet& set) const
+{
+	const uint32_t bufferIndex = 0;
+	m_vkCmdSetDescriptorBufferOffsets(commandBuffer, bindPoint, layout, setIndex, 1, &bufferIndex, &set.offset);
+}
+
+VkDeviceSize RUBY::DescriptorBuffer::GetMaxSize(VkPhysicalDevice physicalDevice)
+{
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProperties{};
+	descriptorBufferProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &descriptorBufferProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	// The one buffer holds samplers and resources, every set offset has to stay within both ranges
+	return std::min({
+		descriptorBufferProperties.maxResourceDescriptorBufferRange,
+		descriptorBufferProperties.maxSamplerDescriptorBufferRange,
+		descriptorBufferProperties.resourceDescriptorBufferAddressSpaceSize,
+		descriptorBufferProperties.samplerDescriptorBufferAddressSpaceSize,
+		descriptorBufferProperties.descriptorBufferAddressSpaceSize,
+	});
+}
+
+VkDeviceSize RUBY::DescriptorBuffer::GetLayoutSize(VkDescriptorSetLayout layout) const
+{
+	VkDeviceSize size = 0;
+	m_vkGetDescriptorSetLayoutSize(m_pDevice->GetLogicalDevice(), layout, &size);
+	return size;
+}
+
+size_t RUBY::DescriptorBuffer::GetDescriptorSize(VkDescriptorType type) const
+{
+	switch (type)
+	{
+	case VK_DESCRIPTOR_TYPE_SAMPLER: return m_Properties.samplerDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return m_Properties.combinedImageSamplerDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return m_Properties.sampledImageDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return m_Properties.storageImageDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: return m_Properties.inputAttachmentDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: return m_Properties.uniformTexelBufferDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: return m_Properties.storageTexelBufferDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return m_Properties.uniformBufferDescriptorSize;
+	case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return m_Properties.storageBufferDescriptorSize;
+	default: return 0;
+	}
+}
+
+RUBY::DescriptorBufferSet RUBY::DescriptorBuffer::AllocateFrom(std::atomic<VkDeviceSize>& head, VkDeviceSize end, VkDescriptorSetLayout layout,
+	const char* pRegionName)
+{
+	// Sizes are rounded up so every head stays a valid set offset
+	const VkDeviceSize size = AlignUp(GetLayoutSize(layout), m_Properties.descriptorBufferOffsetAlignment);
+
+	VkDeviceSize offset = head.load(std::memory_order_relaxed);
+	do
+	{
+		if (offset + size > end)
+		{
+			throw std::runtime_error(std::string("Descriptor buffer ") + pRegionName + " region out of space (" +
+				std::to_string(size) + " bytes requested)");
+		}
+	} while (!head.compare_exchange_weak(offset, offset + size, std::memory_order_relaxed));
+
+	DescriptorBufferSet set{};
+	set.layout = layout;
+	set.offset = offset;
+	set.pData = static_cast<std::byte*>(m_pBuffer->GetMappedData()) + offset;
+	return set;
+}
@@ -1,14 +1,42 @@
 #include "Vulkan/DescriptorPool.h"
 #include <stdexcept>
+#include <string>
 
 RUBY::DescriptorPool::DescriptorPool(Device* pDevice,
     const std::vector<DescriptorSetLayoutData>& layoutDatas,
     const std::vector<VkDescriptorPoolSize>& poolSizes,
     uint32_t maxSets)
-    : m_pDevice(pDevice)
+    : m_pDevice(pDevice), m_LayoutDatas(layoutDatas)
 {
     CreateDescriptorSetLayouts(layoutDatas);
-    CreateDescriptorPool(poolSizes, maxSets);
+    // Sets of descriptor buffer layouts live in the DescriptorBuffer, not in a pool
+    if (pDevice->GetDescriptorBackend() == DescriptorBackend::Pools)
+        CreateDescriptorPool(poolSizes, maxSets);
+}
+
+RUBY::DescriptorPool::DescriptorPool(Device* pDevice, const ShaderReflection& reflection, uint32_t maxSets)
+    : DescriptorPool(pDevice, GetLayoutData(reflection), reflection.GetPoolSizes(maxSets), maxSets)
+{
+}
+
+std::vector<RUBY::DescriptorPool::DescriptorSetLayoutData> RUBY::DescriptorPool::GetLayoutData(const ShaderReflection& reflection)
+{
+    std::vector<DescriptorSetLayoutData> layoutDatas;
+    for (auto& bindings : reflection.GetSetLayoutBindings())
+    {
+        for (const VkDescriptorSetLayoutBinding& binding : bindings)
+        {
+            // A count of 0 would declare an empty binding, not a variable sized one
+            if (binding.descriptorCount == 0)
+            {
+                throw std::runtime_error("Set " + std::to_string(layoutDatas.size()) + " binding " + std::to_string(binding.binding) +
+                    " is a runtime sized array, pass an explicit layout for it (e.g. the BindlessHeap set) instead of the reflected one");
+            }
+        }
+        const bool pushDescriptor = layoutDatas.size() == reflection.pushDescriptorSet;
+        layoutDatas.push_back({ std::move(bindings), pushDescriptor });
+    }
+    return layoutDatas;
 }
 
 RUBY::DescriptorPool::~DescriptorPool()
@@ -47,6 +75,23 @@ void RUBY::DescriptorPool::CreateDescriptorSetLayouts(const std::vector<Descript
     {
         VkDescriptorSetLayoutCreateInfo layoutInfo{};
         layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.flags = m_pDevice->GetDescriptorSetLayoutFlags();
+        if (layoutDatas[i].pushDescriptor)
+        {
+            if (!m_pDevice->SupportsPushDescriptors())
+            {
+                throw std::runtime_error("Descriptor set layout " + std::to_string(i) + " uses push descriptors, which the device does not support");
+            }
+            uint32_t descriptorCount = 0;
+            for (const VkDescriptorSetLayoutBinding& binding : layoutDatas[i].bindings)
+                descriptorCount += binding.descriptorCount;
+            if (descriptorCount > m_pDevice->GetMaxPushDescriptors())
+            {
+                throw std::runtime_error("Push descriptor set layout " + std::to_string(i) + " holds " + std::to_string(descriptorCount) +
+                    " descriptors, the device allows " + std::to_string(m_pDevice->GetMaxPushDescriptors()));
+            }
+            layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+        }
         layoutInfo.bindingCount = static_cast<uint32_t>(layoutDatas[i].bindings.size());
         layoutInfo.pBindings = layoutDatas[i].bindings.data();
 
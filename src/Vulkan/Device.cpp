@@ -1,5 +1,6 @@
 #include "Vulkan/Device.h"
 
+#include <algorithm>
 #include <set>
 #include <stdexcept>
 
@@ -15,32 +16,143 @@
 #include "vulkan/vulkan.h"
 #include "vk_mem_alloc.h"
 
-RUBY::Device::Device(IRubyWindow* window)
-	: m_pWindow(window)
+#include "Vulkan/BindlessHeap.h"
+#include "Vulkan/Defragmenter.h"
+#include "Vulkan/DescriptorBuffer.h"
+#include "Vulkan/FrameContext.h"
+#include "Vulkan/MemoryTracker.h"
+#include "Vulkan/PipelineCache.h"
+#include "Vulkan/ShaderCache.h"
+#include "Vulkan/TimelineSemaphore.h"
+
+namespace
+{
+    // What CreateLogicalDevice enables unconditionally, most of it for the BindlessHeap
+    bool HasRequiredFeatures(const VkPhysicalDeviceVulkan12Features& features12, const VkPhysicalDeviceVulkan13Features& features13)
+    {
+        return features12.descriptorIndexing && features12.runtimeDescriptorArray &&
+            features12.descriptorBindingPartiallyBound && features12.descriptorBindingVariableDescriptorCount &&
+            features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingStorageImageUpdateAfterBind &&
+            features12.descriptorBindingStorageBufferUpdateAfterBind && features12.descriptorBindingUpdateUnusedWhilePending &&
+            features12.shaderSampledImageArrayNonUniformIndexing && features12.shaderStorageImageArrayNonUniformIndexing &&
+            features12.shaderStorageBufferArrayNonUniformIndexing &&
+            features12.timelineSemaphore && features12.hostQueryReset &&
+            features13.synchronization2 && features13.dynamicRendering;
+    }
+}
+
+RUBY::Device::Device(IRubyWindow* window, const std::filesystem::path& pipelineCachePath, DescriptorBackend preferredBackend,
+    const std::filesystem::path& leakDumpPath)
+	: m_pWindow(window), m_DescriptorBackend(preferredBackend), m_LeakDumpPath(leakDumpPath)
 {
     window->CreateVkSurface(m_Instance, &m_Surface);
+    if (!HasSurface())
+    {
+        // Nothing to present to, so the swapchain extension is not required either
+        m_DeviceExtensions.clear();
+    }
 	PickPhysicalDevice();
 	CreateLogicalDevice();
     SetupVMA();
+    m_pMemoryTracker = std::make_unique<MemoryTracker>(this);
 	m_pDebugger = new DeviceDebugger(m_LogicalDevice);
+    m_pTimeline = std::make_unique<TimelineSemaphore>(this);
+    m_pComputeTimeline = std::make_unique<TimelineSemaphore>(this);
+    m_pTransferTimeline = std::make_unique<TimelineSemaphore>(this);
+    m_pDefragmenter = std::make_unique<Defragmenter>(this);
+    m_pPipelineCache = std::make_unique<PipelineCache>(this, pipelineCachePath);
+    m_pShaderCache = std::make_unique<ShaderCache>(this);
+    if (m_DescriptorBackend == DescriptorBackend::DescriptorBuffer)
+        m_pDescriptorBuffer = std::make_unique<DescriptorBuffer>(this, FrameContext::MAX_FRAMES_IN_FLIGHT);
+    m_pBindlessHeap = std::make_unique<BindlessHeap>(this);
 }
 
 RUBY::Device::~Device()
 {
+    vkDeviceWaitIdle(m_LogicalDevice);
+    // Destroy callbacks may defer further destroys (e.g. an Image handing its bindless slots back), drain until
+    // nothing new shows up
+    while (true)
+    {
+        std::vector<std::function<void()>> pendingDestroys;
+        std::deque<DeferredDestroy> deferredDestroys;
+        {
+            std::lock_guard lock{ m_PendingDestroysMutex };
+            pendingDestroys.swap(m_PendingDestroys);
+            deferredDestroys.swap(m_DeferredDestroys);
+        }
+        if (pendingDestroys.empty() && deferredDestroys.empty())
+            break;
+
+        for (auto& deferred : deferredDestroys)
+            deferred.destroyFn();
+        for (auto& destroyFn : pendingDestroys)
+            destroyFn();
+    }
+    // After the deferred destroys, those may still hand slots back
+    m_pBindlessHeap.reset();
+    m_pDescriptorBuffer.reset();
+    // Last, every Buffer and Image hands its allocation to it on destruction
+    m_pDefragmenter.reset();
+    m_pTimeline.reset();
+    m_pComputeTimeline.reset();
+    m_pTransferTimeline.reset();
+    m_pPipelineCache.reset();
+    m_pShaderCache.reset();
+
     delete m_pDebugger;
-    /* Debugging VMA */
-    //char* StatsString = nullptr;
-    //vmaBuildStatsString(m_Allocator, &StatsString, true);
-    //{
-    //    std::ofstream OutStats{ "VmaStats.json" };
-    //    OutStats << StatsString;
-    //}
-    //vmaFreeStatsString(m_Allocator, StatsString);
-    /* END - Debugging VMA */
+
+    // Everything owned by the engine is gone by now, what is left was never destroyed
+    if (m_pMemoryTracker->ReportLeaks() != 0 && !m_LeakDumpPath.empty())
+        m_pMemoryTracker->WriteStatsJson(m_LeakDumpPath);
+    m_pMemoryTracker.reset();
 
 	vmaDestroyAllocator(m_Allocator);
     vkDestroyDevice(m_LogicalDevice, nullptr);
-    vkDestroySurfaceKHR(m_Instance.GetInstance(), m_Surface, nullptr);
+    if (HasSurface())
+        vkDestroySurfaceKHR(m_Instance.GetInstance(), m_Surface, nullptr);
+}
+
+VkPipelineCache RUBY::Device::GetPipelineCache() const
+{
+    return m_pPipelineCache->GetPipelineCache();
+}
+
+bool RUBY::Device::SavePipelineCache()
+{
+    return m_pPipelineCache->Save();
+}
+
+void RUBY::Device::DeferDestroy(std::function<void()>&& destroyFn)
+{
+    // Stamped on the next frame submit rather than now: a single-time submit may still signal a value
+    // before the frame that references the resource does
+    std::lock_guard lock{ m_PendingDestroysMutex };
+    m_PendingDestroys.emplace_back(std::move(destroyFn));
+}
+
+void RUBY::Device::OnFrameSubmitted(uint64_t timelineValue)
+{
+    // Lets VMA refresh its VK_EXT_memory_budget numbers
+    vmaSetCurrentFrameIndex(m_Allocator, static_cast<uint32_t>(timelineValue));
+
+    std::lock_guard lock{ m_PendingDestroysMutex };
+    for (auto& destroyFn : m_PendingDestroys)
+        m_DeferredDestroys.push_back({ timelineValue, std::move(destroyFn) });
+    m_PendingDestroys.clear();
+}
+
+void RUBY::Device::CollectGarbage()
+{
+    if (m_DeferredDestroys.empty())
+        return;
+
+    const uint64_t completed = m_pTimeline->GetCompletedValue();
+    while (!m_DeferredDestroys.empty() && m_DeferredDestroys.front().timelineValue <= completed)
+    {
+        m_DeferredDestroys.front().destroyFn();
+        m_DeferredDestroys.pop_front();
+    }
 }
 
 uint32_t RUBY::Device::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
@@ -59,6 +171,19 @@ uint32_t RUBY::Device::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
     throw std::runtime_error("failed to find suitable memory type!");
 }
 
+bool RUBY::Device::SupportsLazilyAllocatedMemory() const
+{
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &memProperties);
+
+    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+    {
+        if (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+            return true;
+    }
+    return false;
+}
+
 VkFormat RUBY::Device::FindDepthFormat() const
 {
     return FindSupportedFormat(
@@ -117,37 +242,25 @@ int RUBY::Device::RateDeviceSuitability(VkPhysicalDevice device) const
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
+    // Devices missing a required extension or feature would only fail in vkCreateDevice
+    if (!indices.IsComplete() || !extensionsSupported || (HasSurface() && !swapChainAdequate))
+        return 0;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceVulkan13Features vulkan13Features{};
+    vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13Features.pNext = &vulkan12Features;
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &vulkan13Features;
+    vkGetPhysicalDeviceFeatures2(device, &features2);
 
-    VkPhysicalDeviceProperties deviceProperties;
-
-    VkPhysicalDeviceVulkan13Features vulkan13Features;
-    VkPhysicalDeviceFeatures2 features2;
-
-    VkPhysicalDeviceDescriptorIndexingFeatures indexFeatures{
-        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES,
-        .pNext = nullptr,
-        .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
-        .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
-        //.descriptorBindingPartiallyBound = VK_TRUE,
-
-        .descriptorBindingVariableDescriptorCount = VK_TRUE,
-        .runtimeDescriptorArray = VK_FALSE,
-    };
-
-    vulkan13Features = {
-	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
-	    .pNext = &indexFeatures,
-		.synchronization2 = VK_TRUE,
-        .dynamicRendering = VK_TRUE,
-    };
-
-    features2 = {
-	    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
-	    .pNext = &vulkan13Features
-    };
+    if (!features2.features.samplerAnisotropy || !HasRequiredFeatures(vulkan12Features, vulkan13Features))
+        return 0;
 
+    VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(device, &deviceProperties);
-    vkGetPhysicalDeviceFeatures2(device, &features2);
 
     int score = 0;
 
@@ -181,12 +294,20 @@ RUBY::Device::QueueFamilyIndices RUBY::Device::FindQueueFamilies(VkPhysicalDevic
             indices.graphicsFamily = i;
         }
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_Surface, &presentSupport);
+        if (HasSurface())
+        {
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_Surface, &presentSupport);
 
-        if (presentSupport)
+            if (presentSupport)
+            {
+                indices.presentFamily = i;
+            }
+        }
+        else if (indices.graphicsFamily.has_value())
         {
-            indices.presentFamily = i;
+            // Offscreen: the "present" queue is just the graphics queue, nothing is ever presented
+            indices.presentFamily = indices.graphicsFamily;
         }
 
         if (indices.IsComplete()) {
@@ -196,9 +317,113 @@ RUBY::Device::QueueFamilyIndices RUBY::Device::FindQueueFamilies(VkPhysicalDevic
         i++;
     }
 
+    for (uint32_t family = 0; family < queueFamilyCount; ++family)
+    {
+        const VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+        {
+            indices.computeFamily = family;
+            break;
+        }
+    }
+    if (!indices.computeFamily.has_value())
+        indices.computeFamily = indices.graphicsFamily;
+
+    for (uint32_t family = 0; family < queueFamilyCount; ++family)
+    {
+        const VkQueueFlags flags = queueFamilies[family].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            indices.transferFamily = family;
+            break;
+        }
+    }
+    if (!indices.transferFamily.has_value())
+        indices.transferFamily = indices.computeFamily;
+
     return indices;
 }
 
+uint32_t RUBY::Device::GetQueueFamily(QueueType queueType) const
+{
+    switch (queueType)
+    {
+    case QueueType::Compute:
+        return m_QueueFamilyIndices.computeFamily.value();
+    case QueueType::Transfer:
+        return m_QueueFamilyIndices.transferFamily.value();
+    default:
+        return m_QueueFamilyIndices.graphicsFamily.value();
+    }
+}
+
+VkQueue RUBY::Device::GetQueue(QueueType queueType) const
+{
+    switch (queueType)
+    {
+    case QueueType::Compute:
+        return m_ComputeQueue;
+    case QueueType::Transfer:
+        return m_TransferQueue;
+    default:
+        return m_GraphicsQueue;
+    }
+}
+
+VkResult RUBY::Device::Submit(QueueType queueType, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence) const
+{
+    const VkQueue queue = GetQueue(queueType);
+    std::lock_guard lock(GetQueueMutex(queue));
+    return vkQueueSubmit2(queue, submitCount, pSubmits, fence);
+}
+
+VkResult RUBY::Device::Submit(QueueType queueType, const VkSubmitInfo2& submitInfo, uint64_t& outSignalValue, VkFence fence) const
+{
+    TimelineSemaphore& timeline = GetTimeline(queueType);
+    std::vector<VkSemaphoreSubmitInfo> signals(submitInfo.pSignalSemaphoreInfos,
+        submitInfo.pSignalSemaphoreInfos + submitInfo.signalSemaphoreInfoCount);
+
+    const VkQueue queue = GetQueue(queueType);
+    std::lock_guard lock(GetQueueMutex(queue));
+    outSignalValue = timeline.Advance();
+    signals.push_back(timeline.GetSubmitInfo(outSignalValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+
+    VkSubmitInfo2 timelineSubmitInfo = submitInfo;
+    timelineSubmitInfo.signalSemaphoreInfoCount = static_cast<uint32_t>(signals.size());
+    timelineSubmitInfo.pSignalSemaphoreInfos = signals.data();
+    return vkQueueSubmit2(queue, 1, &timelineSubmitInfo, fence);
+}
+
+VkResult RUBY::Device::Present(const VkPresentInfoKHR& presentInfo) const
+{
+    std::lock_guard lock(GetQueueMutex(m_PresentQueue));
+    return vkQueuePresentKHR(m_PresentQueue, &presentInfo);
+}
+
+std::mutex& RUBY::Device::GetQueueMutex(VkQueue queue) const
+{
+    const std::array<VkQueue, 4> queues{ m_GraphicsQueue, m_PresentQueue, m_ComputeQueue, m_TransferQueue };
+    for (size_t i = 0; i < queues.size(); ++i)
+    {
+        if (queues[i] == queue)
+            return m_QueueMutexes[i];
+    }
+    throw std::logic_error("Queue does not belong to this device");
+}
+
+RUBY::TimelineSemaphore& RUBY::Device::GetTimeline(QueueType queueType) const
+{
+    switch (queueType)
+    {
+    case QueueType::Compute:
+        return *m_pComputeTimeline;
+    case QueueType::Transfer:
+        return *m_pTransferTimeline;
+    default:
+        return *m_pTimeline;
+    }
+}
+
 RUBY::Device::QueueFamilyIndices RUBY::Device::FindQueueFamilies() const
 {
     return FindQueueFamilies(m_PhysicalDevice);
@@ -245,7 +470,9 @@ bool RUBY::Device::CheckDeviceExtensionSupport(VkPhysicalDevice device) const
 
 RUBY::Device::SwapChainSupportDetails RUBY::Device::QuerySwapChainSupport(VkPhysicalDevice device) const
 {
-    SwapChainSupportDetails details;
+    SwapChainSupportDetails details{};
+    if (!HasSurface())
+        return details;
 
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, m_Surface, &details.capabilities);
 
@@ -273,24 +500,85 @@ RUBY::Device::SwapChainSupportDetails RUBY::Device::QuerySwapChainSupport(VkPhys
 void RUBY::Device::CreateLogicalDevice()
 {
     QueueFamilyIndices indices = FindQueueFamilies(m_PhysicalDevice);
+    m_QueueFamilyIndices = indices;
 
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_PhysicalDevice, &queueFamilyCount, queueFamilies.data());
 
-    float queuePriority = 1.0f;
-    for (uint32_t queueFamily : uniqueQueueFamilies)
+    // Hands out the next unused queue of a family, so compute and transfer still overlap with graphics when they
+    // share its family. Once the family runs out they share its last queue.
+    std::map<uint32_t, uint32_t> queueCounts;
+    auto claimQueue = [&](uint32_t family)
+    {
+        uint32_t& count = queueCounts[family];
+        if (count < queueFamilies[family].queueCount)
+            ++count;
+        return count - 1;
+    };
+
+    claimQueue(indices.graphicsFamily.value());
+    if (indices.presentFamily != indices.graphicsFamily)
+        claimQueue(indices.presentFamily.value());
+    const uint32_t computeQueueIndex = claimQueue(indices.computeFamily.value());
+    const uint32_t transferQueueIndex = claimQueue(indices.transferFamily.value());
+
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    const float queuePriorities[3] = { 1.0f, 1.0f, 1.0f };
+    for (const auto& [queueFamily, queueCount] : queueCounts)
     {
         VkDeviceQueueCreateInfo queueCreateInfo{};
         queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queueCreateInfo.queueFamilyIndex = queueFamily;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfo.queueCount = queueCount;
+        queueCreateInfo.pQueuePriorities = queuePriorities;
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
 
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_PhysicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const char* optionalExtension : m_OptionalDeviceExtensions)
+    {
+        for (const auto& extension : availableExtensions)
+        {
+            if (std::string(extension.extensionName) == optionalExtension)
+            {
+                m_DeviceExtensions.push_back(optionalExtension);
+                m_EnabledOptionalExtensions.insert(optionalExtension);
+                break;
+            }
+        }
+    }
+
+    VkBool32 descriptorBufferPushDescriptors = VK_FALSE;
+    if (m_DescriptorBackend == DescriptorBackend::DescriptorBuffer)
+    {
+        if (SupportsDescriptorBuffers(availableExtensions, descriptorBufferPushDescriptors))
+            m_DeviceExtensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+        else
+            m_DescriptorBackend = DescriptorBackend::Pools;
+    }
+    const bool useDescriptorBuffers = m_DescriptorBackend == DescriptorBackend::DescriptorBuffer;
+    const bool usePushDescriptors = IsExtensionEnabled(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) &&
+        (!useDescriptorBuffers || descriptorBufferPushDescriptors);
+
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures{ VK_FALSE };
     deviceFeatures.samplerAnisotropy = VK_TRUE;
+    // Profiling only, statistics queries must stay active across secondary command buffers as well
+    if (supportedFeatures.pipelineStatisticsQuery && supportedFeatures.inheritedQueries)
+    {
+        deviceFeatures.pipelineStatisticsQuery = VK_TRUE;
+        deviceFeatures.inheritedQueries = VK_TRUE;
+    }
+    m_EnabledFeatures = deviceFeatures;
 
 	VkPhysicalDeviceVulkan11Features vulkan11Features{};
 	vulkan11Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
@@ -304,6 +592,16 @@ void RUBY::Device::CreateLogicalDevice()
     vulkan12Features.descriptorBindingVariableDescriptorCount = VK_TRUE;
     vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
     vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    // BindlessHeap
+    vulkan12Features.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+    vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    vulkan12Features.shaderStorageImageArrayNonUniformIndexing = VK_TRUE;
+    vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+    vulkan12Features.hostQueryReset = VK_TRUE;
+    // Descriptor buffers hold buffer descriptors as device addresses
+    vulkan12Features.bufferDeviceAddress = useDescriptorBuffers ? VK_TRUE : VK_FALSE;
 	vulkan12Features.pNext = &vulkan11Features;
 
 	VkPhysicalDeviceVulkan13Features vulkan13Features{};
@@ -312,10 +610,26 @@ void RUBY::Device::CreateLogicalDevice()
 	vulkan13Features.synchronization2 = VK_TRUE;
 	vulkan13Features.dynamicRendering = VK_TRUE;
 
+	// Lets pipelines take SPIR-V directly instead of a VkShaderModule (ShaderCache)
+	VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features{};
+	maintenance5Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+	maintenance5Features.maintenance5 = VK_TRUE;
+	maintenance5Features.pNext = &vulkan13Features;
+
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+	descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+	descriptorBufferFeatures.descriptorBuffer = VK_TRUE;
+	descriptorBufferFeatures.descriptorBufferPushDescriptors = usePushDescriptors ? VK_TRUE : VK_FALSE;
+
 	VkPhysicalDeviceFeatures2 features2{};
 	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
 	features2.features = deviceFeatures;
-	features2.pNext = &vulkan13Features;
+	features2.pNext = IsExtensionEnabled(VK_KHR_MAINTENANCE_5_EXTENSION_NAME) ? static_cast<void*>(&maintenance5Features) : &vulkan13Features;
+	if (useDescriptorBuffers)
+	{
+		descriptorBufferFeatures.pNext = features2.pNext;
+		features2.pNext = &descriptorBufferFeatures;
+	}
 
 
     VkDeviceCreateInfo createInfo{};
@@ -345,6 +659,28 @@ void RUBY::Device::CreateLogicalDevice()
 
     vkGetDeviceQueue(m_LogicalDevice, indices.graphicsFamily.value(), 0, &m_GraphicsQueue);
     vkGetDeviceQueue(m_LogicalDevice, indices.presentFamily.value(), 0, &m_PresentQueue);
+    vkGetDeviceQueue(m_LogicalDevice, indices.computeFamily.value(), computeQueueIndex, &m_ComputeQueue);
+    vkGetDeviceQueue(m_LogicalDevice, indices.transferFamily.value(), transferQueueIndex, &m_TransferQueue);
+
+    if (usePushDescriptors)
+    {
+        m_vkCmdPushDescriptorSet = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(
+            vkGetDeviceProcAddr(m_LogicalDevice, "vkCmdPushDescriptorSetKHR"));
+        m_vkCmdPushDescriptorSetWithTemplate = reinterpret_cast<PFN_vkCmdPushDescriptorSetWithTemplateKHR>(
+            vkGetDeviceProcAddr(m_LogicalDevice, "vkCmdPushDescriptorSetWithTemplateKHR"));
+        if (m_vkCmdPushDescriptorSetWithTemplate == nullptr)
+            m_vkCmdPushDescriptorSet = nullptr;
+    }
+    if (SupportsPushDescriptors())
+    {
+        VkPhysicalDevicePushDescriptorPropertiesKHR pushDescriptorProperties{};
+        pushDescriptorProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &pushDescriptorProperties;
+        vkGetPhysicalDeviceProperties2(m_PhysicalDevice, &properties);
+        m_MaxPushDescriptors = pushDescriptorProperties.maxPushDescriptors;
+    }
 }
 
 void RUBY::Device::SetupVMA()
@@ -354,8 +690,67 @@ void RUBY::Device::SetupVMA()
 	allocatorInfo.physicalDevice = m_PhysicalDevice;
 	allocatorInfo.device = m_LogicalDevice;
 	allocatorInfo.instance = m_Instance.GetInstance();
+	if (m_DescriptorBackend == DescriptorBackend::DescriptorBuffer)
+		allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+	// Without it VMA estimates the budget as 80% of each heap
+	if (IsExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+		allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
 	if (vmaCreateAllocator(&allocatorInfo, &m_Allocator) != VK_SUCCESS)
 	{
 		throw std::runtime_error("failed to create VMA allocator!");
 	}
 }
+
+VkDescriptorSetLayoutCreateFlags RUBY::Device::GetDescriptorSetLayoutFlags() const
+{
+    return m_DescriptorBackend == DescriptorBackend::DescriptorBuffer ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+}
+
+VkPipelineCreateFlags RUBY::Device::GetPipelineCreateFlags() const
+{
+    return m_DescriptorBackend == DescriptorBackend::DescriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+}
+
+void RUBY::Device::CmdPushDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout layout, uint32_t set,
+    uint32_t writeCount, const VkWriteDescriptorSet* pWrites) const
+{
+    if (!SupportsPushDescriptors())
+        throw std::runtime_error("Push descriptors are not supported by this device!");
+    m_vkCmdPushDescriptorSet(commandBuffer, bindPoint, layout, set, writeCount, pWrites);
+}
+
+void RUBY::Device::CmdPushDescriptorSetWithTemplate(VkCommandBuffer commandBuffer, VkDescriptorUpdateTemplate updateTemplate, VkPipelineLayout layout,
+    uint32_t set, const void* pData) const
+{
+    if (!SupportsPushDescriptors())
+        throw std::runtime_error("Push descriptors are not supported by this device!");
+    m_vkCmdPushDescriptorSetWithTemplate(commandBuffer, updateTemplate, layout, set, pData);
+}
+
+bool RUBY::Device::SupportsDescriptorBuffers(const std::vector<VkExtensionProperties>& availableExtensions, VkBool32& outPushDescriptors) const
+{
+    const bool hasExtension = std::any_of(availableExtensions.begin(), availableExtensions.end(), [](const VkExtensionProperties& extension)
+    {
+        return std::string(extension.extensionName) == VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME;
+    });
+    if (!hasExtension)
+        return false;
+
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeatures{};
+    descriptorBufferFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.pNext = &descriptorBufferFeatures;
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &vulkan12Features;
+    vkGetPhysicalDeviceFeatures2(m_PhysicalDevice, &features);
+
+    outPushDescriptors = descriptorBufferFeatures.descriptorBufferPushDescriptors;
+    if (!descriptorBufferFeatures.descriptorBuffer || !vulkan12Features.bufferDeviceAddress)
+        return false;
+
+    // Devices that can't address the default regions keep using pools
+    const VkDeviceSize requiredSize = DescriptorBuffer::DEFAULT_PERSISTENT_SIZE + DescriptorBuffer::DEFAULT_FRAME_SIZE * FrameContext::MAX_FRAMES_IN_FLIGHT;
+    return DescriptorBuffer::GetMaxSize(m_PhysicalDevice) >= requiredSize;
+}
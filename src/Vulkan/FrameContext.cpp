@@ -0,0 +1,99 @@
+#include "Vulkan/FrameContext.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "Vulkan/TimelineSemaphore.h"
+
+RUBY::FrameContext::FrameContext(Device* pDevice, uint32_t frameIndex, uint32_t workerCount)
+	: m_pDevice(pDevice), m_FrameIndex(frameIndex)
+{
+	// Transient pool reset as a whole every frame instead of resetting individual command buffers
+	m_pCommandPool = std::make_unique<CommandPool>(pDevice, 1,
+		VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		"Frame " + std::to_string(frameIndex) + " Command Pool");
+	m_pComputeCommandPool = std::make_unique<CommandPool>(pDevice, 0,
+		VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		"Frame " + std::to_string(frameIndex) + " Compute Command Pool",
+		QueueType::Compute);
+
+	m_WorkerCommandPools.reserve(workerCount);
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		m_WorkerCommandPools.emplace_back(std::make_unique<CommandPool>(pDevice, 0,
+			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			"Frame " + std::to_string(frameIndex) + " Worker " + std::to_string(i) + " Command Pool"));
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	if (vkCreateSemaphore(m_pDevice->GetLogicalDevice(), &semaphoreInfo, nullptr, &m_ImageAvailableSemaphore) != VK_SUCCESS ||
+		vkCreateSemaphore(m_pDevice->GetLogicalDevice(), &semaphoreInfo, nullptr, &m_RenderFinishedSemaphore) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create synchronization objects for a frame!");
+	}
+}
+
+RUBY::FrameContext::~FrameContext()
+{
+	m_pDevice->GetTimeline().Wait(m_TimelineValue);
+	m_pDevice->GetComputeTimeline().Wait(m_ComputeTimelineValue);
+	Release();
+
+	vkDestroySemaphore(m_pDevice->GetLogicalDevice(), m_ImageAvailableSemaphore, nullptr);
+	vkDestroySemaphore(m_pDevice->GetLogicalDevice(), m_RenderFinishedSemaphore, nullptr);
+}
+
+void RUBY::FrameContext::Begin()
+{
+	m_pDevice->GetTimeline().Wait(m_TimelineValue);
+	m_pDevice->GetComputeTimeline().Wait(m_ComputeTimelineValue);
+
+	Release();
+	m_pCommandPool->Reset();
+	m_pComputeCommandPool->Reset();
+	for (auto& pool : m_WorkerCommandPools)
+		pool->Reset();
+}
+
+VkCommandBuffer RUBY::FrameContext::AcquireCommandBuffer(QueueType queueType)
+{
+	return queueType == QueueType::Compute ? m_pComputeCommandPool->AcquirePrimaryCommandBuffer() : m_pCommandPool->AcquirePrimaryCommandBuffer();
+}
+
+VkCommandBuffer RUBY::FrameContext::AcquireSecondaryCommandBuffer(uint32_t workerIndex)
+{
+	if (workerIndex >= m_WorkerCommandPools.size())
+	{
+		throw std::out_of_range("Frame has no command pool for worker " + std::to_string(workerIndex));
+	}
+	return m_WorkerCommandPools[workerIndex]->AcquireSecondaryCommandBuffer();
+}
+
+RUBY::Buffer& RUBY::FrameContext::AllocateStaging(VkDeviceSize size)
+{
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	return m_StagingBuffers.emplace_back(m_pDevice, m_pCommandPool.get(), bufferInfo,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		HostAccess::Sequential);
+}
+
+void RUBY::FrameContext::DeferRelease(std::function<void()>&& releaseFn)
+{
+	m_DeferredReleases.emplace_back(std::move(releaseFn));
+}
+
+void RUBY::FrameContext::Release()
+{
+	for (auto& releaseFn : m_DeferredReleases)
+		releaseFn();
+	m_DeferredReleases.clear();
+
+	m_StagingBuffers.clear();
+}
@@ -0,0 +1,84 @@
+#include "Vulkan/FrameRingBuffer.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "vulkan/vulkan.h"
+#include "vk_mem_alloc.h"
+
+RUBY::FrameRingBuffer::FrameRingBuffer(Device* pDevice, uint32_t frameCount, VkDeviceSize frameSize)
+	: m_pDevice(pDevice), m_FrameCount(frameCount)
+{
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(pDevice->GetPhysicalDevice(), &properties);
+	m_DefaultAlignment = std::max({ m_DefaultAlignment,
+		properties.limits.minUniformBufferOffsetAlignment,
+		properties.limits.minStorageBufferOffsetAlignment });
+
+	// Segments start aligned so offsets inside them only depend on the head
+	m_FrameSize = (frameSize + m_DefaultAlignment - 1) / m_DefaultAlignment * m_DefaultAlignment;
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = m_FrameSize * frameCount;
+	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+	m_pBuffer = std::make_unique<Buffer>(pDevice, nullptr, bufferInfo, allocInfo);
+	m_pBuffer->SetName("Frame Ring Buffer");
+
+	BeginFrame(0);
+}
+
+void RUBY::FrameRingBuffer::BeginFrame(uint32_t frameIndex)
+{
+	if (frameIndex >= m_FrameCount)
+	{
+		throw std::out_of_range("Frame ring buffer has no segment for frame " + std::to_string(frameIndex));
+	}
+
+	m_FrameBegin = m_FrameSize * frameIndex;
+	m_FrameEnd = m_FrameBegin + m_FrameSize;
+	m_Head.store(m_FrameBegin, std::memory_order_relaxed);
+}
+
+void RUBY::FrameRingBuffer::Flush()
+{
+	const VkDeviceSize used = GetFrameUsage();
+	if (used == 0 || (m_pBuffer->GetMemoryProperties() & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		return;
+
+	vmaFlushAllocation(m_pDevice->GetAllocator(), m_pBuffer->GetBufferAllocation(), m_FrameBegin, used);
+}
+
+RUBY::RingAllocation RUBY::FrameRingBuffer::Allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	if (alignment == 0)
+		alignment = m_DefaultAlignment;
+
+	VkDeviceSize head = m_Head.load(std::memory_order_relaxed);
+	VkDeviceSize offset;
+	do
+	{
+		offset = (head + alignment - 1) / alignment * alignment;
+		if (offset + size > m_FrameEnd)
+		{
+			throw std::runtime_error("Frame ring buffer out of space (" + std::to_string(size) + " bytes requested, " +
+				std::to_string(m_FrameSize) + " per frame)");
+		}
+	} while (!m_Head.compare_exchange_weak(head, offset + size, std::memory_order_relaxed));
+
+	RingAllocation allocation{};
+	allocation.buffer = m_pBuffer->GetBuffer();
+	allocation.offset = offset;
+	allocation.size = size;
+	allocation.pData = static_cast<char*>(m_pBuffer->GetMappedData()) + offset;
+	return allocation;
+}
@@ -0,0 +1,374 @@
+#include "Vulkan/GpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+#include "Vulkan/TimelineSemaphore.h"
+
+namespace
+{
+	// Matches the bit order of GpuProfiler::PIPELINE_STATISTICS, results are written lowest bit first
+	constexpr uint32_t PIPELINE_STATISTIC_COUNT = 6;
+
+#ifdef _WIN32
+	constexpr VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+	constexpr VkTimeDomainEXT HOST_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+	// Host time domain value to steady_clock nanoseconds
+	int64_t HostTimeToNanoseconds(uint64_t hostTime)
+	{
+#ifdef _WIN32
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return static_cast<int64_t>(static_cast<double>(hostTime) * 1e9 / static_cast<double>(frequency.QuadPart));
+#else
+		return static_cast<int64_t>(hostTime);
+#endif
+	}
+}
+
+RUBY::GpuProfiler::GpuProfiler(Device* pDevice, uint32_t slotCount)
+	: m_pDevice(pDevice)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_pDevice->GetPhysicalDevice(), &properties);
+	m_TimestampPeriod = properties.limits.timestampPeriod;
+
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(m_pDevice->GetPhysicalDevice(), &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(m_pDevice->GetPhysicalDevice(), &queueFamilyCount, queueFamilies.data());
+	m_TimestampValidBits = queueFamilies[m_pDevice->FindQueueFamilies().graphicsFamily.value()].timestampValidBits;
+
+	if (!IsSupported())
+		return;
+
+	m_HasPipelineStatistics = m_pDevice->GetEnabledFeatures().pipelineStatisticsQuery == VK_TRUE;
+
+	if (m_pDevice->IsExtensionEnabled(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+	{
+		auto vkGetPhysicalDeviceCalibrateableTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+			vkGetInstanceProcAddr(m_pDevice->GetInstance()->GetInstance(), "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+		m_vkGetCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+			vkGetDeviceProcAddr(m_pDevice->GetLogicalDevice(), "vkGetCalibratedTimestampsEXT"));
+
+		if (vkGetPhysicalDeviceCalibrateableTimeDomains != nullptr && m_vkGetCalibratedTimestamps != nullptr)
+		{
+			uint32_t domainCount = 0;
+			vkGetPhysicalDeviceCalibrateableTimeDomains(m_pDevice->GetPhysicalDevice(), &domainCount, nullptr);
+			std::vector<VkTimeDomainEXT> domains(domainCount);
+			vkGetPhysicalDeviceCalibrateableTimeDomains(m_pDevice->GetPhysicalDevice(), &domainCount, domains.data());
+
+			const bool hasDevice = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+			const bool hasHost = std::find(domains.begin(), domains.end(), HOST_TIME_DOMAIN) != domains.end();
+			if (hasDevice && hasHost)
+				m_HostTimeDomain = HOST_TIME_DOMAIN;
+			else
+				m_vkGetCalibratedTimestamps = nullptr;
+		}
+		else
+		{
+			m_vkGetCalibratedTimestamps = nullptr;
+		}
+	}
+
+	m_Slots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; ++i)
+	{
+		FrameSlot& slot = m_Slots[i];
+
+		VkQueryPoolCreateInfo timestampInfo{};
+		timestampInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		timestampInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		timestampInfo.queryCount = MAX_SCOPES_PER_FRAME * 2;
+
+		if (vkCreateQueryPool(m_pDevice->GetLogicalDevice(), &timestampInfo, nullptr, &slot.timestampPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+		vkResetQueryPool(m_pDevice->GetLogicalDevice(), slot.timestampPool, 0, timestampInfo.queryCount);
+		m_pDevice->GetDebugger().SetDebugName(reinterpret_cast<uint64_t>(slot.timestampPool),
+			"GpuProfiler Timestamps " + std::to_string(i), VK_OBJECT_TYPE_QUERY_POOL);
+
+		if (!m_HasPipelineStatistics)
+			continue;
+
+		VkQueryPoolCreateInfo statisticsInfo{};
+		statisticsInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		statisticsInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		statisticsInfo.queryCount = MAX_SCOPES_PER_FRAME;
+		statisticsInfo.pipelineStatistics = PIPELINE_STATISTICS;
+
+		if (vkCreateQueryPool(m_pDevice->GetLogicalDevice(), &statisticsInfo, nullptr, &slot.statisticsPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline statistics query pool!");
+		}
+		vkResetQueryPool(m_pDevice->GetLogicalDevice(), slot.statisticsPool, 0, statisticsInfo.queryCount);
+		m_pDevice->GetDebugger().SetDebugName(reinterpret_cast<uint64_t>(slot.statisticsPool),
+			"GpuProfiler Statistics " + std::to_string(i), VK_OBJECT_TYPE_QUERY_POOL);
+	}
+}
+
+RUBY::GpuProfiler::~GpuProfiler()
+{
+	for (auto& slot : m_Slots)
+	{
+		m_pDevice->GetTimeline().Wait(slot.timelineValue);
+		vkDestroyQueryPool(m_pDevice->GetLogicalDevice(), slot.timestampPool, nullptr);
+		if (slot.statisticsPool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(m_pDevice->GetLogicalDevice(), slot.statisticsPool, nullptr);
+	}
+}
+
+void RUBY::GpuProfiler::BeginFrame(uint32_t slot)
+{
+	if (!IsSupported())
+		return;
+
+	if (slot >= m_Slots.size())
+	{
+		throw std::out_of_range("GpuProfiler slot " + std::to_string(slot) + " does not exist");
+	}
+
+	FrameSlot& frameSlot = m_Slots[slot];
+	Resolve(frameSlot);
+
+	frameSlot.scopes.clear();
+	frameSlot.timestampCount = 0;
+	frameSlot.statisticsCount = 0;
+	m_pCurrentSlot = &frameSlot;
+	m_OpenScopes.clear();
+	m_OpenStatisticsScope = ~0u;
+}
+
+void RUBY::GpuProfiler::EndFrame(uint64_t timelineValue)
+{
+	if (m_pCurrentSlot == nullptr)
+		return;
+
+	m_pCurrentSlot->timelineValue = timelineValue;
+	m_pCurrentSlot->hasPendingResults = m_pCurrentSlot->timestampCount > 0;
+	m_pCurrentSlot = nullptr;
+	m_OpenScopes.clear();
+}
+
+void RUBY::GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, const std::string& name, bool collectStatistics)
+{
+	// Ignored scopes still push a marker so EndScope stays balanced
+	if (!m_IsEnabled || m_pCurrentSlot == nullptr || m_pCurrentSlot->timestampCount + 2 > MAX_SCOPES_PER_FRAME * 2)
+	{
+		m_OpenScopes.push_back(~0u);
+		return;
+	}
+
+	FrameSlot& slot = *m_pCurrentSlot;
+
+	Scope scope{};
+	scope.name = name;
+	scope.depth = static_cast<uint32_t>(m_OpenScopes.size());
+	scope.firstTimestamp = slot.timestampCount;
+	scope.statisticsQuery = ~0u;
+	scope.isClosed = false;
+	slot.timestampCount += 2;
+
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, slot.timestampPool, scope.firstTimestamp);
+
+	// Statistics queries of one pool can't nest
+	if (collectStatistics && m_HasPipelineStatistics && m_OpenStatisticsScope == ~0u)
+	{
+		scope.statisticsQuery = slot.statisticsCount++;
+		vkCmdBeginQuery(commandBuffer, slot.statisticsPool, scope.statisticsQuery, 0);
+		m_OpenStatisticsScope = static_cast<uint32_t>(slot.scopes.size());
+	}
+
+	m_OpenScopes.push_back(static_cast<uint32_t>(slot.scopes.size()));
+	slot.scopes.push_back(std::move(scope));
+}
+
+void RUBY::GpuProfiler::EndScope(VkCommandBuffer commandBuffer)
+{
+	if (m_OpenScopes.empty())
+		return;
+
+	const uint32_t scopeIndex = m_OpenScopes.back();
+	m_OpenScopes.pop_back();
+	if (scopeIndex == ~0u || m_pCurrentSlot == nullptr)
+		return;
+
+	FrameSlot& slot = *m_pCurrentSlot;
+	Scope& scope = slot.scopes[scopeIndex];
+
+	if (scope.statisticsQuery != ~0u)
+	{
+		vkCmdEndQuery(commandBuffer, slot.statisticsPool, scope.statisticsQuery);
+		m_OpenStatisticsScope = ~0u;
+	}
+
+	vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, slot.timestampPool, scope.firstTimestamp + 1);
+	scope.isClosed = true;
+}
+
+double RUBY::GpuProfiler::GetScopeMilliseconds(const std::string& name) const
+{
+	for (const auto& result : m_LatestResults)
+	{
+		if (result.name == name)
+			return result.gpuMilliseconds;
+	}
+	return 0.0;
+}
+
+RUBY::GpuScopeSummary RUBY::GpuProfiler::GetScopeSummary(const std::string& name) const
+{
+	GpuScopeSummary summary{};
+
+	auto it = m_History.find(name);
+	if (it == m_History.end() || it->second.empty())
+		return summary;
+
+	std::vector<double> samples(it->second.begin(), it->second.end());
+	std::sort(samples.begin(), samples.end());
+
+	double total = 0.0;
+	for (double sample : samples)
+		total += sample;
+
+	// Nearest-rank percentiles
+	auto percentile = [&samples](double fraction)
+	{
+		const size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(samples.size())));
+		return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+	};
+
+	summary.sampleCount = static_cast<uint32_t>(samples.size());
+	summary.averageMilliseconds = total / static_cast<double>(samples.size());
+	summary.minMilliseconds = samples.front();
+	summary.maxMilliseconds = samples.back();
+	summary.p50Milliseconds = percentile(0.50);
+	summary.p95Milliseconds = percentile(0.95);
+	summary.p99Milliseconds = percentile(0.99);
+	return summary;
+}
+
+void RUBY::GpuProfiler::Resolve(FrameSlot& slot)
+{
+	if (!slot.hasPendingResults)
+		return;
+
+	// Normally a no-op, FrameContext::Begin already waited for this value
+	m_pDevice->GetTimeline().Wait(slot.timelineValue);
+	slot.hasPendingResults = false;
+
+	const VkDevice device = m_pDevice->GetLogicalDevice();
+
+	std::vector<uint64_t> timestamps(slot.timestampCount);
+	VkResult result = vkGetQueryPoolResults(device, slot.timestampPool, 0, slot.timestampCount,
+		timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	std::vector<uint64_t> statistics(static_cast<size_t>(slot.statisticsCount) * PIPELINE_STATISTIC_COUNT);
+	VkResult statisticsResult = VK_SUCCESS;
+	if (slot.statisticsCount > 0)
+	{
+		statisticsResult = vkGetQueryPoolResults(device, slot.statisticsPool, 0, slot.statisticsCount,
+			statistics.size() * sizeof(uint64_t), statistics.data(), PIPELINE_STATISTIC_COUNT * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	}
+
+	vkResetQueryPool(device, slot.timestampPool, 0, slot.timestampCount);
+	if (slot.statisticsCount > 0)
+		vkResetQueryPool(device, slot.statisticsPool, 0, slot.statisticsCount);
+
+	if (result != VK_SUCCESS)
+		return;
+
+	Calibrate();
+
+	const uint64_t mask = m_TimestampValidBits >= 64 ? ~0ull : (1ull << m_TimestampValidBits) - 1;
+
+	m_LatestResults.clear();
+	for (const auto& scope : slot.scopes)
+	{
+		if (!scope.isClosed)
+			continue;
+
+		const uint64_t begin = timestamps[scope.firstTimestamp] & mask;
+		const uint64_t end = timestamps[scope.firstTimestamp + 1] & mask;
+		const uint64_t ticks = (end - begin) & mask;
+
+		GpuScopeResult scopeResult{};
+		scopeResult.name = scope.name;
+		scopeResult.depth = scope.depth;
+		scopeResult.gpuMilliseconds = static_cast<double>(ticks) * m_TimestampPeriod * 1e-6;
+
+		if (m_HasCalibration)
+		{
+			scopeResult.cpuBeginNanoseconds = ToCpuNanoseconds(begin);
+			scopeResult.cpuEndNanoseconds = ToCpuNanoseconds(end);
+		}
+
+		if (scope.statisticsQuery != ~0u && statisticsResult == VK_SUCCESS)
+		{
+			const uint64_t* pValues = &statistics[static_cast<size_t>(scope.statisticsQuery) * PIPELINE_STATISTIC_COUNT];
+			scopeResult.hasStatistics = true;
+			scopeResult.statistics.inputAssemblyVertices = pValues[0];
+			scopeResult.statistics.inputAssemblyPrimitives = pValues[1];
+			scopeResult.statistics.vertexShaderInvocations = pValues[2];
+			scopeResult.statistics.clippingPrimitives = pValues[3];
+			scopeResult.statistics.fragmentShaderInvocations = pValues[4];
+			scopeResult.statistics.computeShaderInvocations = pValues[5];
+		}
+
+		auto& history = m_History[scope.name];
+		history.push_back(scopeResult.gpuMilliseconds);
+		if (history.size() > HISTORY_SIZE)
+			history.pop_front();
+
+		m_LatestResults.push_back(std::move(scopeResult));
+	}
+}
+
+void RUBY::GpuProfiler::Calibrate()
+{
+	if (m_vkGetCalibratedTimestamps == nullptr)
+		return;
+
+	VkCalibratedTimestampInfoEXT infos[2]{};
+	infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	infos[1].timeDomain = m_HostTimeDomain;
+
+	uint64_t values[2]{};
+	uint64_t maxDeviation = 0;
+	if (m_vkGetCalibratedTimestamps(m_pDevice->GetLogicalDevice(), 2, infos, values, &maxDeviation) != VK_SUCCESS)
+		return;
+
+	m_CalibrationGpuTicks = values[0];
+	m_CalibrationCpuNanoseconds = HostTimeToNanoseconds(values[1]);
+	m_HasCalibration = true;
+}
+
+int64_t RUBY::GpuProfiler::ToCpuNanoseconds(uint64_t gpuTicks) const
+{
+	const uint64_t mask = m_TimestampValidBits >= 64 ? ~0ull : (1ull << m_TimestampValidBits) - 1;
+
+	// Signed distance in ticks, the calibration point is usually a little after the measured scope
+	int64_t deltaTicks = static_cast<int64_t>((gpuTicks - m_CalibrationGpuTicks) & mask);
+	if (m_TimestampValidBits < 64 && deltaTicks > static_cast<int64_t>(mask >> 1))
+		deltaTicks -= static_cast<int64_t>(mask) + 1;
+
+	return m_CalibrationCpuNanoseconds + static_cast<int64_t>(static_cast<double>(deltaTicks) * m_TimestampPeriod);
+}
@@ -0,0 +1,71 @@
+#include "Vulkan/HeadlessWindow.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "Vulkan/Instance.h"
+
+RUBY::HeadlessWindow::HeadlessWindow(const std::string& name, int width, int height, bool useHeadlessSurface)
+	: m_Name(name), m_Width(width), m_Height(height), m_UseHeadlessSurface(useHeadlessSurface && IsHeadlessSurfaceSupported())
+{
+}
+
+void RUBY::HeadlessWindow::Resize(int width, int height)
+{
+	m_Width = width;
+	m_Height = height;
+	m_Resized = true;
+}
+
+void RUBY::HeadlessWindow::GetFramebufferSize(int* width, int* height) const
+{
+	*width = m_Width;
+	*height = m_Height;
+}
+
+std::vector<const char*> RUBY::HeadlessWindow::GetRequiredInstanceExtensions() const
+{
+	if (!m_UseHeadlessSurface)
+		return {};
+
+	return { VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+}
+
+void RUBY::HeadlessWindow::CreateVkSurface(Instance& instance, VkSurfaceKHR* vkSurface) const
+{
+	*vkSurface = VK_NULL_HANDLE;
+	if (!m_UseHeadlessSurface)
+		return;
+
+	auto vkCreateHeadlessSurfaceEXT = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+		vkGetInstanceProcAddr(instance.GetInstance(), "vkCreateHeadlessSurfaceEXT"));
+	if (vkCreateHeadlessSurfaceEXT == nullptr)
+		return;
+
+	VkHeadlessSurfaceCreateInfoEXT createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+	if (vkCreateHeadlessSurfaceEXT(instance.GetInstance(), &createInfo, nullptr, vkSurface) != VK_SUCCESS)
+	{
+		// Not fatal, the swapchain renders offscreen without a surface
+		std::cout << "Failed to create headless surface, rendering offscreen" << std::endl;
+		*vkSurface = VK_NULL_HANDLE;
+	}
+}
+
+bool RUBY::HeadlessWindow::IsHeadlessSurfaceSupported()
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+	for (const auto& extension : extensions)
+	{
+		if (strcmp(extension.extensionName, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME) == 0)
+			return true;
+	}
+
+	return false;
+}
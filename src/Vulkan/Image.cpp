@@ -1,16 +1,20 @@
 #include "Vulkan/Image.h"
 
 #include <stdexcept>
+#include <utility>
 
 //#define VMA_IMPLEMENTATION
 #include "vulkan/vulkan.h"
 #include "vk_mem_alloc.h"
 
+#include "Vulkan/BindlessHeap.h"
 #include "Vulkan/CommandPool.h"
+#include "Vulkan/Defragmenter.h"
+#include "Vulkan/MemoryTracker.h"
 
 RUBY::Image::Image(const Device* pDevice, const CommandPool* pCommandPool, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
                   VkImageUsageFlags usage, VkImageAspectFlags aspectFlags, VkMemoryPropertyFlags properties)
-	: m_pDevice(pDevice), m_pCommandPool(pCommandPool), m_Format(format)
+	: m_pDevice(pDevice), m_pCommandPool(pCommandPool), m_Format(format), m_ImageAspectFlags(aspectFlags)
 {
 	ImageCreateInfo imageCreateInfo{};
 	imageCreateInfo.width = width;
@@ -48,11 +52,35 @@ RUBY::Image::Image(const Device* pDevice, const CommandPool* pCommandPool, VkIma
     CreateImageView(format, aspectFlags);
 }
 
+RUBY::Image::Image(const Device* pDevice, const CommandPool* pCommandPool, const VkImageCreateInfo& vkImageCreateInfo,
+	VmaAllocation aliasedMemory, const VkImageAspectFlags& aspectFlags)
+	: m_pDevice(pDevice), m_pCommandPool(pCommandPool), m_Format(vkImageCreateInfo.format), m_ImageAspectFlags(aspectFlags), m_IsAliased(true)
+{
+	m_ImageLayout = vkImageCreateInfo.initialLayout;
+	m_CreateInfo = vkImageCreateInfo;
+	m_CreateInfo.pNext = nullptr;
+	if (vmaCreateAliasingImage(m_pDevice->GetAllocator(), aliasedMemory, &vkImageCreateInfo, &m_Image) != VK_SUCCESS)
+	{
+		throw std::runtime_error("failed to create aliasing image!");
+	}
+    CreateImageView(m_Format, aspectFlags);
+}
+
 RUBY::Image::~Image()
 {
     CleanupImageView();
-	if (m_Image != VK_NULL_HANDLE && m_ImageAllocation != VK_NULL_HANDLE)
-		vmaDestroyImage(m_pDevice->GetAllocator(), m_Image, m_ImageAllocation);
+	if (m_Image != VK_NULL_HANDLE && m_IsAliased)
+		vkDestroyImage(m_pDevice->GetLogicalDevice(), m_Image, nullptr);
+	else if (m_Image != VK_NULL_HANDLE && m_ImageAllocation != VK_NULL_HANDLE)
+	{
+		m_pDevice->GetMemoryTracker().Untrack(m_ImageAllocation);
+
+		// An allocation the running defragmentation pass is moving is freed by the Defragmenter once the pass ends
+		VkDevice device = m_pDevice->GetLogicalDevice();
+		VkImage image = m_Image;
+		if (!m_pDevice->GetDefragmenter().ReleaseAllocation(m_ImageAllocation, [device, image]() { vkDestroyImage(device, image, nullptr); }))
+			vmaDestroyImage(m_pDevice->GetAllocator(), m_Image, m_ImageAllocation);
+	}
 }
 
 RUBY::Image::Image(Image&& other) noexcept
@@ -64,14 +92,26 @@ RUBY::Image::Image(Image&& other) noexcept
 	m_pCommandPool = other.m_pCommandPool;
 	m_Format = other.m_Format;
 	m_ImageAspectFlags = other.m_ImageAspectFlags;
+	m_ImageLayout = other.m_ImageLayout;
+	m_IsAliased = other.m_IsAliased;
+	m_SampledIndex = std::exchange(other.m_SampledIndex, BindlessHeap::INVALID_INDEX);
+	m_StorageIndex = std::exchange(other.m_StorageIndex, BindlessHeap::INVALID_INDEX);
+	m_CreateInfo = other.m_CreateInfo;
+	m_IsRelocatable = std::exchange(other.m_IsRelocatable, false);
 
 	other.m_Image = VK_NULL_HANDLE;
 	other.m_ImageAllocation = VK_NULL_HANDLE;
 	other.m_ImageView = VK_NULL_HANDLE;
+
+	if (m_IsRelocatable)
+		m_pDevice->GetDefragmenter().Register(m_ImageAllocation, this);
 }
 
 RUBY::Image& RUBY::Image::operator=(Image&& other) noexcept
 {
+	ReleaseBindless();
+	if (m_IsRelocatable)
+		m_pDevice->GetDefragmenter().Unregister(m_ImageAllocation);
     m_Image = other.m_Image;
     m_ImageAllocation = other.m_ImageAllocation;
     m_ImageView = other.m_ImageView;
@@ -79,18 +119,73 @@ RUBY::Image& RUBY::Image::operator=(Image&& other) noexcept
     m_pCommandPool = other.m_pCommandPool;
 	m_Format = other.m_Format;
 	m_ImageAspectFlags = other.m_ImageAspectFlags;
+	m_ImageLayout = other.m_ImageLayout;
+	m_IsAliased = other.m_IsAliased;
+	m_SampledIndex = std::exchange(other.m_SampledIndex, BindlessHeap::INVALID_INDEX);
+	m_StorageIndex = std::exchange(other.m_StorageIndex, BindlessHeap::INVALID_INDEX);
+	m_CreateInfo = other.m_CreateInfo;
+	m_IsRelocatable = std::exchange(other.m_IsRelocatable, false);
 
     other.m_Image = VK_NULL_HANDLE;
     other.m_ImageAllocation = VK_NULL_HANDLE;
     other.m_ImageView = VK_NULL_HANDLE;
 
+	if (m_IsRelocatable)
+		m_pDevice->GetDefragmenter().Register(m_ImageAllocation, this);
+
 
 	return *this;
 }
 
 
+void RUBY::Image::SetName(const std::string& name) const
+{
+	m_pDevice->GetDebugger().SetDebugName(reinterpret_cast<uint64_t>(m_Image), name, VK_OBJECT_TYPE_IMAGE);
+	if (!m_IsAliased)
+		m_pDevice->GetMemoryTracker().SetName(m_ImageAllocation, name);
+}
+
+void RUBY::Image::SetRelocatable(bool relocatable)
+{
+	if (relocatable == m_IsRelocatable)
+		return;
+
+	if (relocatable)
+	{
+		constexpr VkImageUsageFlags transferUsage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if (m_IsAliased || m_ImageAllocation == VK_NULL_HANDLE || (m_CreateInfo.usage & transferUsage) != transferUsage ||
+			m_CreateInfo.sharingMode != VK_SHARING_MODE_EXCLUSIVE)
+		{
+			throw std::logic_error("Relocatable images need their own memory, TRANSFER_SRC/DST usage and exclusive sharing");
+		}
+		m_pDevice->GetDefragmenter().Register(m_ImageAllocation, this);
+	}
+	else
+	{
+		m_pDevice->GetDefragmenter().Unregister(m_ImageAllocation);
+	}
+	m_IsRelocatable = relocatable;
+}
+
+void RUBY::Image::Relocate(VkImage newImage, VkImage& outOldImage, VkImageView& outOldView)
+{
+	// The old image and view are destroyed by the Defragmenter once the copy retired
+	outOldImage = std::exchange(m_Image, newImage);
+	outOldView = std::exchange(m_ImageView, VK_NULL_HANDLE);
+	CreateImageView(m_Format, m_ImageAspectFlags);
+
+	// Shaders keep the indices, the Defragmenter drained every command buffer that could read the slots
+	BindlessHeap& heap = m_pDevice->GetBindlessHeap();
+	if (m_SampledIndex != BindlessHeap::INVALID_INDEX)
+		heap.UpdateSampledImage(m_SampledIndex, m_ImageView);
+	if (m_StorageIndex != BindlessHeap::INVALID_INDEX)
+		heap.UpdateStorageImage(m_StorageIndex, m_ImageView);
+}
+
 void RUBY::Image::CleanupImageView()
 {
+	// The descriptors reference the view
+	ReleaseBindless();
     if (m_ImageView == VK_NULL_HANDLE) return;
 
 	vkDestroyImageView(m_pDevice->GetLogicalDevice(), m_ImageView, nullptr);
@@ -163,10 +258,60 @@ void RUBY::Image::TransitionImageLayout(VkCommandBuffer& commandBuffer, VkFormat
 
 }
 
+void RUBY::Image::ReleaseOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkImageLayout newLayout,
+    VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess) const
+{
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = srcStage;
+    barrier.srcAccessMask = srcAccess;
+    barrier.oldLayout = m_ImageLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = srcQueueFamily;
+    barrier.dstQueueFamilyIndex = dstQueueFamily;
+    barrier.image = m_Image;
+    barrier.subresourceRange = { m_ImageAspectFlags, 0, 1, 0, 1 };
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+void RUBY::Image::AcquireOwnership(VkCommandBuffer commandBuffer, uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkImageLayout oldLayout, VkImageLayout newLayout,
+    VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.dstStageMask = dstStage;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = srcQueueFamily;
+    barrier.dstQueueFamilyIndex = dstQueueFamily;
+    barrier.image = m_Image;
+    barrier.subresourceRange = { m_ImageAspectFlags, 0, 1, 0, 1 };
+
+    VkDependencyInfo dependencyInfo{};
+    dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependencyInfo.imageMemoryBarrierCount = 1;
+    dependencyInfo.pImageMemoryBarriers = &barrier;
+
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    m_ImageLayout = newLayout;
+}
+
 void RUBY::Image::CopyBufferToImage(VkBuffer buffer, uint32_t width, uint32_t height) const
 {
     VkCommandBuffer commandBuffer = m_pCommandPool->BeginSingleTimeCommands();
+    CopyBufferToImage(commandBuffer, buffer, width, height);
+    m_pCommandPool->EndSingleTimeCommands(commandBuffer);
+}
 
+void RUBY::Image::CopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, uint32_t width, uint32_t height) const
+{
     VkBufferImageCopy region{};
     region.bufferOffset = 0;
     region.bufferRowLength = 0;
@@ -192,8 +337,6 @@ void RUBY::Image::CopyBufferToImage(VkBuffer buffer, uint32_t width, uint32_t he
         1,
         &region
     );
-
-    m_pCommandPool->EndSingleTimeCommands(commandBuffer);
 }
 
 void RUBY::Image::CreateImage(const ImageCreateInfo& imageCreateInfo)
@@ -220,12 +363,24 @@ void RUBY::Image::CreateImage(const ImageCreateInfo& imageCreateInfo)
 void RUBY::Image::CreateImage(const VkImageCreateInfo& imageCreateInfo, const VkMemoryPropertyFlags& properties)
 {
 
+	m_CreateInfo = imageCreateInfo;
+	m_CreateInfo.pNext = nullptr;
+
     VmaAllocationCreateInfo allocInfo{};
     allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
     allocInfo.requiredFlags = properties;
+	// Transient attachments asking for lazy memory fall back to plain device memory on desktop GPUs
+	if (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT && !m_pDevice->SupportsLazilyAllocatedMemory())
+		allocInfo.requiredFlags = (properties & ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 	m_ImageLayout = imageCreateInfo.initialLayout;
 
     vmaCreateImage(m_pDevice->GetAllocator(), &imageCreateInfo, &allocInfo, &m_Image, &m_ImageAllocation, nullptr);
+
+	constexpr VkImageUsageFlags attachmentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (imageCreateInfo.usage & attachmentUsage)
+		m_pDevice->GetMemoryTracker().Track(m_ImageAllocation, MemoryCategory::RenderTarget, "Render Target");
+	else
+		m_pDevice->GetMemoryTracker().Track(m_ImageAllocation, MemoryCategory::Image, "Image");
 }
 
 void RUBY::Image::CreateImageView(VkFormat format, VkImageAspectFlags aspectFlags)
@@ -249,6 +404,32 @@ void RUBY::Image::CreateImageView(VkFormat format, VkImageAspectFlags aspectFlag
     }
 }
 
+void RUBY::Image::RegisterBindless()
+{
+	// Depth/stencil views with both aspects cannot be sampled
+	if (m_ImageView == VK_NULL_HANDLE || (m_ImageAspectFlags & VK_IMAGE_ASPECT_DEPTH_BIT && m_ImageAspectFlags & VK_IMAGE_ASPECT_STENCIL_BIT))
+		return;
+
+	BindlessHeap& heap = m_pDevice->GetBindlessHeap();
+	if (m_CreateInfo.usage & VK_IMAGE_USAGE_SAMPLED_BIT && m_SampledIndex == BindlessHeap::INVALID_INDEX)
+		m_SampledIndex = heap.RegisterSampledImage(m_ImageView);
+	if (m_CreateInfo.usage & VK_IMAGE_USAGE_STORAGE_BIT && m_StorageIndex == BindlessHeap::INVALID_INDEX)
+		m_StorageIndex = heap.RegisterStorageImage(m_ImageView);
+}
+
+void RUBY::Image::ReleaseBindless()
+{
+	// Checked first, m_pDevice is not initialized on default constructed images
+	if (m_SampledIndex == BindlessHeap::INVALID_INDEX && m_StorageIndex == BindlessHeap::INVALID_INDEX)
+		return;
+
+	BindlessHeap& heap = m_pDevice->GetBindlessHeap();
+	heap.Release(BindlessType::SampledImage, m_SampledIndex);
+	heap.Release(BindlessType::StorageImage, m_StorageIndex);
+	m_SampledIndex = BindlessHeap::INVALID_INDEX;
+	m_StorageIndex = BindlessHeap::INVALID_INDEX;
+}
+
 RUBY::Image::TransitionInfo RUBY::Image::GetTransitionInfo(VkImageLayout oldLayout, VkImageLayout newLayout, VkFormat /*format*/)
 {
     TransitionInfo info{};
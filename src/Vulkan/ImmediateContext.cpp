@@ -0,0 +1,83 @@
+#include "Vulkan/ImmediateContext.h"
+
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+#include "Vulkan/Buffer.h"
+#include "Vulkan/Image.h"
+
+RUBY::ImmediateContext::ImmediateContext(CommandPool* pCommandPool)
+	: m_pCommandPool(pCommandPool), m_CommandBuffer(pCommandPool->BeginImmediate())
+{
+}
+
+RUBY::ImmediateContext::~ImmediateContext() noexcept
+{
+	if (m_IsSubmitted)
+		return;
+
+	std::cerr << "Immediate context destroyed without Submit, submitting its commands now\n";
+	try
+	{
+		Submit(true);
+	}
+	catch (const std::exception& exception)
+	{
+		std::cerr << "Immediate context submit failed: " << exception.what() << std::endl;
+	}
+}
+
+RUBY::Buffer& RUBY::ImmediateContext::AllocateStaging(VkDeviceSize size)
+{
+	if (m_IsSubmitted)
+	{
+		throw std::logic_error("Immediate context was already submitted");
+	}
+	return m_pCommandPool->AllocateImmediateStaging(size);
+}
+
+RUBY::Buffer& RUBY::ImmediateContext::Adopt(std::unique_ptr<Buffer> pSource)
+{
+	if (m_IsSubmitted)
+	{
+		throw std::logic_error("Immediate context was already submitted");
+	}
+	return m_pCommandPool->AdoptImmediateStaging(std::move(pSource));
+}
+
+void RUBY::ImmediateContext::CopyBuffer(const Buffer& source, const Buffer& destination, VkDeviceSize size) const
+{
+	CheckSource(source);
+	destination.CopyBuffer(m_CommandBuffer, source.GetBuffer(), size);
+}
+
+void RUBY::ImmediateContext::CopyBufferToImage(const Buffer& source, const Image& destination, uint32_t width, uint32_t height) const
+{
+	CheckSource(source);
+	destination.CopyBufferToImage(m_CommandBuffer, source.GetBuffer(), width, height);
+}
+
+uint64_t RUBY::ImmediateContext::Submit(bool wait)
+{
+	if (m_IsSubmitted)
+	{
+		throw std::logic_error("Immediate context was already submitted");
+	}
+
+	m_IsSubmitted = true;
+	return m_pCommandPool->EndImmediate(wait);
+}
+
+void RUBY::ImmediateContext::CheckSource(const Buffer& source) const
+{
+	if (m_IsSubmitted)
+	{
+		throw std::logic_error("Immediate context was already submitted");
+	}
+	// Anything else could be destroyed before the deferred copy ran
+	if (!m_pCommandPool->OwnsImmediateStaging(source))
+	{
+		throw std::invalid_argument("Immediate copies need a source from AllocateStaging or Adopt");
+	}
+}
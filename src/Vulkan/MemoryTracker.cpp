@@ -0,0 +1,144 @@
+#include "Vulkan/MemoryTracker.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "vulkan/vulkan.h"
+#include "vk_mem_alloc.h"
+
+#include "Vulkan/Device.h"
+
+RUBY::MemoryTracker::MemoryTracker(const Device* pDevice)
+	: m_pDevice(pDevice)
+{
+}
+
+void RUBY::MemoryTracker::Track(VmaAllocation allocation, MemoryCategory category, const std::string& name)
+{
+	if (allocation == nullptr)
+		return;
+
+	VmaAllocationInfo info{};
+	vmaGetAllocationInfo(m_pDevice->GetAllocator(), allocation, &info);
+	vmaSetAllocationName(m_pDevice->GetAllocator(), allocation, name.c_str());
+
+	std::lock_guard lock{ m_Mutex };
+	m_Allocations[allocation] = { category, name, info.size };
+}
+
+void RUBY::MemoryTracker::SetName(VmaAllocation allocation, const std::string& name)
+{
+	if (allocation == nullptr)
+		return;
+
+	vmaSetAllocationName(m_pDevice->GetAllocator(), allocation, name.c_str());
+
+	std::lock_guard lock{ m_Mutex };
+	auto it = m_Allocations.find(allocation);
+	if (it != m_Allocations.end())
+		it->second.name = name;
+}
+
+void RUBY::MemoryTracker::Untrack(VmaAllocation allocation)
+{
+	if (allocation == nullptr)
+		return;
+
+	std::lock_guard lock{ m_Mutex };
+	m_Allocations.erase(allocation);
+}
+
+std::vector<RUBY::HeapBudget> RUBY::MemoryTracker::GetHeapBudgets() const
+{
+	const VkPhysicalDeviceMemoryProperties* pMemoryProperties = nullptr;
+	vmaGetMemoryProperties(m_pDevice->GetAllocator(), &pMemoryProperties);
+
+	VmaBudget vmaBudgets[VK_MAX_MEMORY_HEAPS]{};
+	vmaGetHeapBudgets(m_pDevice->GetAllocator(), vmaBudgets);
+
+	std::vector<HeapBudget> budgets(pMemoryProperties->memoryHeapCount);
+	for (uint32_t i = 0; i < pMemoryProperties->memoryHeapCount; ++i)
+	{
+		budgets[i].flags = pMemoryProperties->memoryHeaps[i].flags;
+		budgets[i].size = pMemoryProperties->memoryHeaps[i].size;
+		budgets[i].budget = vmaBudgets[i].budget;
+		budgets[i].usage = vmaBudgets[i].usage;
+		budgets[i].blockBytes = vmaBudgets[i].statistics.blockBytes;
+		budgets[i].allocationBytes = vmaBudgets[i].statistics.allocationBytes;
+		budgets[i].allocationCount = vmaBudgets[i].statistics.allocationCount;
+	}
+	return budgets;
+}
+
+std::array<RUBY::CategoryUsage, RUBY::MemoryTracker::CATEGORY_COUNT> RUBY::MemoryTracker::GetCategoryUsage() const
+{
+	std::array<CategoryUsage, CATEGORY_COUNT> usage{};
+
+	std::lock_guard lock{ m_Mutex };
+	for (const auto& [allocation, entry] : m_Allocations)
+	{
+		CategoryUsage& category = usage[static_cast<size_t>(entry.category)];
+		category.bytes += entry.size;
+		++category.allocationCount;
+	}
+	return usage;
+}
+
+bool RUBY::MemoryTracker::IsOverBudget(float fraction) const
+{
+	for (const HeapBudget& heap : GetHeapBudgets())
+	{
+		if (heap.budget != 0 && static_cast<double>(heap.usage) > static_cast<double>(heap.budget) * fraction)
+			return true;
+	}
+	return false;
+}
+
+std::string RUBY::MemoryTracker::BuildStatsJson(bool detailedMap) const
+{
+	char* pStats = nullptr;
+	vmaBuildStatsString(m_pDevice->GetAllocator(), &pStats, detailedMap ? VK_TRUE : VK_FALSE);
+	std::string stats{ pStats };
+	vmaFreeStatsString(m_pDevice->GetAllocator(), pStats);
+	return stats;
+}
+
+bool RUBY::MemoryTracker::WriteStatsJson(const std::filesystem::path& path, bool detailedMap) const
+{
+	std::ofstream file{ path };
+	if (!file)
+	{
+		std::cout << "Failed to write memory stats " << path.string() << std::endl;
+		return false;
+	}
+	file << BuildStatsJson(detailedMap);
+	return true;
+}
+
+size_t RUBY::MemoryTracker::ReportLeaks() const
+{
+	std::lock_guard lock{ m_Mutex };
+	if (m_Allocations.empty())
+		return 0;
+
+	VkDeviceSize leakedBytes = 0;
+	for (const auto& [allocation, entry] : m_Allocations)
+	{
+		std::cerr << "Leaked " << GetCategoryName(entry.category) << " allocation '" << entry.name << "' (" << entry.size << " bytes)\n";
+		leakedBytes += entry.size;
+	}
+	std::cerr << m_Allocations.size() << " GPU allocations leaked, " << leakedBytes << " bytes" << std::endl;
+	return m_Allocations.size();
+}
+
+const char* RUBY::MemoryTracker::GetCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::Buffer:		return "Buffer";
+	case MemoryCategory::Staging:		return "Staging";
+	case MemoryCategory::Image:			return "Image";
+	case MemoryCategory::RenderTarget:	return "RenderTarget";
+	default:							return "Unknown";
+	}
+}
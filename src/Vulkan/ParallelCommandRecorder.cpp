@@ -0,0 +1,69 @@
+#include "Vulkan/ParallelCommandRecorder.h"
+
+#include <stdexcept>
+
+#include "Core/CpuProfiler.h"
+#include "Vulkan/DescriptorBuffer.h"
+#include "Vulkan/GpuProfiler.h"
+
+void RUBY::ParallelCommandRecorder::RecordRendering(VkCommandBuffer primaryCommandBuffer, FrameContext& frame,
+	const VkRenderingInfo& renderingInfo, const SecondaryRenderingState& state,
+	uint32_t chunkCount, const RecordFn& recordFn)
+{
+	if (frame.GetWorkerCount() < m_pThreadPool->GetWorkerCount())
+	{
+		throw std::runtime_error("Frame context has fewer worker command pools than the thread pool has workers!");
+	}
+
+	std::vector<VkCommandBuffer> secondaries(chunkCount, VK_NULL_HANDLE);
+
+	m_pThreadPool->ParallelFor(chunkCount, [&](uint32_t chunkIndex, uint32_t workerIndex)
+	{
+		RUBY_PROFILE_SCOPE("Record Secondary");
+		VkCommandBuffer commandBuffer = frame.AcquireSecondaryCommandBuffer(workerIndex);
+
+		VkCommandBufferInheritanceRenderingInfo renderingInheritance{};
+		renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+		renderingInheritance.viewMask = renderingInfo.viewMask;
+		renderingInheritance.colorAttachmentCount = static_cast<uint32_t>(state.colorFormats.size());
+		renderingInheritance.pColorAttachmentFormats = state.colorFormats.data();
+		renderingInheritance.depthAttachmentFormat = state.depthFormat;
+		renderingInheritance.stencilAttachmentFormat = state.stencilFormat;
+		renderingInheritance.rasterizationSamples = state.samples;
+
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.pNext = &renderingInheritance;
+		// Lets a GpuProfiler statistics scope stay active around vkCmdExecuteCommands
+		if (m_pDevice->GetEnabledFeatures().inheritedQueries)
+			inheritanceInfo.pipelineStatistics = GpuProfiler::PIPELINE_STATISTICS;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to begin secondary command buffer!");
+		}
+		// Secondaries inherit no descriptor state
+		if (const DescriptorBuffer* pDescriptorBuffer = m_pDevice->GetDescriptorBuffer())
+			pDescriptorBuffer->BindBuffer(commandBuffer);
+
+		recordFn(commandBuffer, chunkIndex);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to record secondary command buffer!");
+		}
+
+		secondaries[chunkIndex] = commandBuffer;
+	});
+
+	VkRenderingInfo secondaryRenderingInfo = renderingInfo;
+	secondaryRenderingInfo.flags |= VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+	vkCmdBeginRendering(primaryCommandBuffer, &secondaryRenderingInfo);
+	if (chunkCount > 0)
+		vkCmdExecuteCommands(primaryCommandBuffer, chunkCount, secondaries.data());
+	vkCmdEndRendering(primaryCommandBuffer);
+}
@@ -1,4 +1,6 @@
 #include "Vulkan/Passes/DemoPass.h"
+#include "Vulkan/RenderGraph.h"
+#include "Vulkan/ShaderCache.h"
 
 #include <stdexcept>
 #include <array>
@@ -13,14 +15,17 @@ namespace RUBY
 
     DemoPass::~DemoPass()
     {
-        auto dev = m_Device->GetLogicalDevice();
-        vkDestroyPipeline(dev, m_Pipeline, nullptr);
-        vkDestroyPipelineLayout(dev, m_PipelineLayout, nullptr);
+        DestroyGraphicsPipeline();
     }
 
-    void DemoPass::Record(VkCommandBuffer cmd, uint32_t imageIndex)
+    void DemoPass::Setup(RenderGraphBuilder& builder)
     {
-		Image& currentImage = m_SwapChain->GetImages()[imageIndex];
+        builder.Write(RenderGraph::BACKBUFFER, ResourceUsage::ColorAttachment);
+    }
+
+    void DemoPass::RecordCommandBuffer(VkCommandBuffer cmd, uint32_t, PassContext& passContext)
+    {
+		Image& currentImage = passContext.pRenderGraph->GetImage(RenderGraph::BACKBUFFER);
 
         VkRenderingAttachmentInfoKHR colorAttachment{};
         colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
@@ -39,43 +44,46 @@ namespace RUBY
         renderingInfo.colorAttachmentCount = 1;
         renderingInfo.pColorAttachments = &colorAttachment;
 
-		currentImage.TransitionImageLayout(cmd, currentImage.GetFormat(), currentImage.GetImageLayout(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_2_NONE, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_2_NONE, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT);
 
         vkCmdBeginRendering(cmd, &renderingInfo);
         vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline);
+        SetViewportAndScissor(cmd, renderingInfo.renderArea.extent);
         vkCmdDraw(cmd, 3, 1, 0, 0);
         vkCmdEndRendering(cmd);
+    }
+
+    void DemoPass::OnResize()
+    {
+        // A new extent only changes dynamic state, recompiling is needed when the surface format changed
+        if (m_SwapChain->GetImageFormat() == m_ColorFormat)
+            return;
 
-		//currentImage.TransitionImageLayout(cmd, currentImage.GetFormat(), currentImage.GetImageLayout(), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_2_NONE);
+        DestroyGraphicsPipeline();
+        CreateGraphicsPipeline();
     }
 
-    void DemoPass::Recreate(SwapChain* swapchain)
+    void DemoPass::DestroyGraphicsPipeline()
     {
-        m_SwapChain = swapchain;
         auto dev = m_Device->GetLogicalDevice();
         vkDestroyPipeline(dev, m_Pipeline, nullptr);
         vkDestroyPipelineLayout(dev, m_PipelineLayout, nullptr);
-        CreateGraphicsPipeline();
+        m_Pipeline = VK_NULL_HANDLE;
+        m_PipelineLayout = VK_NULL_HANDLE;
     }
 
     void DemoPass::CreateGraphicsPipeline()
     {
-	    auto vertCode = Shader::ReadFile("shaders/demo_vert.spv");
-	    auto fragCode = Shader::ReadFile("shaders/demo_frag.spv");
-
-	    VkShaderModule vertShaderModule = Shader::CreateShaderModule(m_Device->GetLogicalDevice(), vertCode);
-	    VkShaderModule fragShaderModule = Shader::CreateShaderModule(m_Device->GetLogicalDevice(), fragCode);
-
-	    VkPipelineShaderStageCreateInfo shaderStages[2]{};
-	    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	    shaderStages[0].module = vertShaderModule;
-	    shaderStages[0].pName = "main";
-
-	    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	    shaderStages[1].module = fragShaderModule;
-	    shaderStages[1].pName = "main";
+	    // Kept across recreates, the cache maps each file once
+	    if (!m_pVertexShader)
+	    {
+	        m_pVertexShader = m_Device->GetShaderCache().Load("shaders/demo_vert.spv");
+	        m_pFragmentShader = m_Device->GetShaderCache().Load("shaders/demo_frag.spv");
+	    }
+
+	    VkPipelineShaderStageCreateInfo shaderStages[2]{
+	        m_pVertexShader->GetStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT),
+	        m_pFragmentShader->GetStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT)
+	    };
 
 	    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 	    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -84,21 +92,17 @@ namespace RUBY
 	    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 	    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-	    VkViewport viewport{};
-	    viewport.width = (float)m_SwapChain->GetExtent().width;
-	    viewport.height = (float)m_SwapChain->GetExtent().height;
-	    viewport.minDepth = 0.0f;
-	    viewport.maxDepth = 1.0f;
-
-	    VkRect2D scissor{};
-	    scissor.extent = m_SwapChain->GetExtent();
-
+	    // Viewport and scissor are set while recording, so resizing doesn't invalidate the pipeline
 	    VkPipelineViewportStateCreateInfo viewportState{};
 	    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	    viewportState.viewportCount = 1;
-	    viewportState.pViewports = &viewport;
 	    viewportState.scissorCount = 1;
-	    viewportState.pScissors = &scissor;
+
+	    const std::array<VkDynamicState, 2> dynamicStates{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	    VkPipelineDynamicStateCreateInfo dynamicState{};
+	    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	    dynamicState.pDynamicStates = dynamicStates.data();
 
 	    VkPipelineRasterizationStateCreateInfo rasterizer{};
 	    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -128,9 +132,9 @@ namespace RUBY
 	    // Dynamic rendering info
 	    VkPipelineRenderingCreateInfoKHR renderingInfo{};
 	    renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
-	    VkFormat colorFormat = m_SwapChain->GetImageFormat();
+	    m_ColorFormat = m_SwapChain->GetImageFormat();
 	    renderingInfo.colorAttachmentCount = 1;
-	    renderingInfo.pColorAttachmentFormats = &colorFormat;
+	    renderingInfo.pColorAttachmentFormats = &m_ColorFormat;
 
 	    VkGraphicsPipelineCreateInfo pipelineInfo{};
 	    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -142,14 +146,12 @@ namespace RUBY
 	    pipelineInfo.pRasterizationState = &rasterizer;
 	    pipelineInfo.pMultisampleState = &multisampling;
 	    pipelineInfo.pColorBlendState = &colorBlending;
+	    pipelineInfo.pDynamicState = &dynamicState;
 	    pipelineInfo.layout = m_PipelineLayout;
 	    pipelineInfo.pNext = &renderingInfo;
 
-	    if (vkCreateGraphicsPipelines(m_Device->GetLogicalDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS)
+	    if (vkCreateGraphicsPipelines(m_Device->GetLogicalDevice(), m_Device->GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS)
 	        throw std::runtime_error("failed to create graphics pipeline!");
-
-	    vkDestroyShaderModule(m_Device->GetLogicalDevice(), vertShaderModule, nullptr);
-	    vkDestroyShaderModule(m_Device->GetLogicalDevice(), fragShaderModule, nullptr);
     }
 
 }
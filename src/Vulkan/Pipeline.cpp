@@ -1,10 +1,50 @@
 #include "Vulkan/Pipeline.h"
 
+#include <algorithm>
+#include <chrono>
 #include <stdexcept>
+#include <string>
 #include <utility>
 
+#include "Core/CpuProfiler.h"
+#include "Core/ThreadPool.h"
+
 namespace RUBY
 {
+    namespace
+    {
+        // Uses ALL descriptor set layouts from the DescriptorPool
+        VkPipelineLayout CreatePipelineLayout(Device* device, DescriptorPool* descriptorPool, const std::vector<VkPushConstantRange>& pushConstants)
+        {
+            VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+            pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+
+            const auto& setLayouts = descriptorPool->GetDescriptorSetLayouts();
+            pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+            pipelineLayoutInfo.pSetLayouts = setLayouts.empty() ? nullptr : setLayouts.data();
+
+            pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+            pipelineLayoutInfo.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data();
+
+            VkPipelineLayout layout;
+            if (vkCreatePipelineLayout(device->GetLogicalDevice(), &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create pipeline layout!");
+            }
+            return layout;
+        }
+    }
+
+    // ---------------- PipelineLayout Implementation ---------------- //
+
+    PipelineLayout::~PipelineLayout()
+    {
+        if (m_Layout != VK_NULL_HANDLE && m_Device)
+        {
+            vkDestroyPipelineLayout(m_Device->GetLogicalDevice(), m_Layout, nullptr);
+        }
+    }
+
     // ---------------- Pipeline Implementation ---------------- //
 
     Pipeline::Pipeline(Device* device,
@@ -23,25 +63,12 @@ namespace RUBY
         const std::vector<VkPushConstantRange>& pushConstants)
         : m_Device(device), m_SwapChain(swapChain), m_DescriptorPool(descriptorPool)
     {
-        // Create pipeline layout (use ALL descriptor set layouts from the DescriptorPool)
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-
-        const auto& setLayouts = descriptorPool->GetDescriptorSetLayouts();
-        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
-        pipelineLayoutInfo.pSetLayouts = setLayouts.empty() ? nullptr : setLayouts.data();
-
-        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
-        pipelineLayoutInfo.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data();
-
-        if (vkCreatePipelineLayout(device->GetLogicalDevice(), &pipelineLayoutInfo, nullptr, &m_Layout) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to create pipeline layout!");
-        }
+        m_Layout = CreatePipelineLayout(device, descriptorPool, pushConstants);
 
         // Build graphics pipeline create info (using dynamic rendering via pNext)
         VkGraphicsPipelineCreateInfo pipelineInfo{};
         pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.flags = device->GetPipelineCreateFlags();
         pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
         pipelineInfo.pStages = shaderStages.empty() ? nullptr : shaderStages.data();
         pipelineInfo.pVertexInputState = &vertexInput;
@@ -63,13 +90,23 @@ namespace RUBY
         // Hook up rendering info via pNext
         pipelineInfo.pNext = &renderingInfo;
 
-        VkPipelineCache pipelineCache = VK_NULL_HANDLE; // optional: supply a cache if you have one
-        if (vkCreateGraphicsPipelines(device->GetLogicalDevice(), pipelineCache, 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS)
+        if (vkCreateGraphicsPipelines(device->GetLogicalDevice(), device->GetPipelineCache(), 1, &pipelineInfo, nullptr, &m_Pipeline) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create graphics pipeline!");
         }
     }
 
+    Pipeline::Pipeline(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, VkPipeline pipeline, VkPipelineLayout layout)
+        : m_Device(device), m_SwapChain(swapChain), m_DescriptorPool(descriptorPool), m_Pipeline(pipeline), m_Layout(layout)
+    {
+    }
+
+    Pipeline::Pipeline(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, VkPipeline pipeline, std::shared_ptr<const PipelineLayout> layout)
+        : m_Device(device), m_SwapChain(swapChain), m_DescriptorPool(descriptorPool), m_Pipeline(pipeline),
+        m_Layout(layout->GetLayout()), m_pSharedLayout(std::move(layout))
+    {
+    }
+
     Pipeline::Pipeline(Pipeline&& other) noexcept
     {
         *this = std::move(other);
@@ -80,7 +117,7 @@ namespace RUBY
         if (this != &other)
         {
             // Destroy existing
-            if (m_Layout != VK_NULL_HANDLE && m_Device)
+            if (m_Layout != VK_NULL_HANDLE && m_Device && !m_pSharedLayout)
             {
                 vkDestroyPipelineLayout(m_Device->GetLogicalDevice(), m_Layout, nullptr);
                 m_Layout = VK_NULL_HANDLE;
@@ -96,13 +133,14 @@ namespace RUBY
             m_DescriptorPool = other.m_DescriptorPool;
             m_Pipeline = std::exchange(other.m_Pipeline, VK_NULL_HANDLE);
             m_Layout = std::exchange(other.m_Layout, VK_NULL_HANDLE);
+            m_pSharedLayout = std::move(other.m_pSharedLayout);
         }
         return *this;
     }
 
     Pipeline::~Pipeline()
     {
-        if (m_Layout != VK_NULL_HANDLE && m_Device)
+        if (m_Layout != VK_NULL_HANDLE && m_Device && !m_pSharedLayout)
         {
             vkDestroyPipelineLayout(m_Device->GetLogicalDevice(), m_Layout, nullptr);
             m_Layout = VK_NULL_HANDLE;
@@ -114,11 +152,97 @@ namespace RUBY
         }
     }
 
+    // ---------------- AsyncPipeline Implementation ---------------- //
+
+    bool AsyncPipeline::IsReady() const
+    {
+        return m_Future.valid() && m_Future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    const Pipeline* AsyncPipeline::Get() const
+    {
+        return IsReady() ? &(*m_Future.get())[m_Index] : m_pFallback;
+    }
+
+    const Pipeline& AsyncPipeline::Wait() const
+    {
+        if (!m_Future.valid())
+        {
+            throw std::logic_error("AsyncPipeline was never started");
+        }
+        return (*m_Future.get())[m_Index];
+    }
+
     // ---------------- PipelineBuilder Implementation ---------------- //
 
-    PipelineBuilder& PipelineBuilder::AddShader(const Shader& shader)
+    PipelineBuilder::PipelineBuilder(const PipelineBuilder& other)
+        : m_ShaderStages(other.m_ShaderStages)
+        , m_Specializations(other.m_Specializations)
+        , m_ShaderHashes(other.m_ShaderHashes)
+        , m_VertexInput(other.m_VertexInput)
+        , m_InputAssembly(other.m_InputAssembly)
+        , m_ViewportState(other.m_ViewportState)
+        , m_Rasterizer(other.m_Rasterizer)
+        , m_Multisampling(other.m_Multisampling)
+        , m_DepthStencil(other.m_DepthStencil)
+        , m_ColorBlending(other.m_ColorBlending)
+        , m_DynamicState(other.m_DynamicState)
+        , m_RenderingInfo(other.m_RenderingInfo)
+        , m_PushConstants(other.m_PushConstants)
+        , m_Reflection(other.m_Reflection)
+        , m_Viewports(other.m_Viewports)
+        , m_Scissors(other.m_Scissors)
+        , m_ColorBlendAttachments(other.m_ColorBlendAttachments)
+        , m_DynamicStates(other.m_DynamicStates)
+        , m_ColorAttachmentFormats(other.m_ColorAttachmentFormats)
+        , m_ColorFormats(other.m_ColorFormats)
     {
-        m_ShaderStages.push_back(shader.GetStageCreateInfo());
+        RebindOwnedPointers(other);
+    }
+
+    PipelineBuilder& PipelineBuilder::operator=(const PipelineBuilder& other)
+    {
+        if (this != &other)
+            *this = PipelineBuilder(other);
+        return *this;
+    }
+
+    void PipelineBuilder::RebindOwnedPointers(const PipelineBuilder& source)
+    {
+        // Pointers into the caller's memory stay as they are, only those into source's storage move over
+        const auto rebind = [](auto& pointer, const auto& sourceStorage, const auto& ownStorage)
+        {
+            if (pointer != nullptr && pointer == sourceStorage.data())
+                pointer = ownStorage.data();
+        };
+        rebind(m_ViewportState.pViewports, source.m_Viewports, m_Viewports);
+        rebind(m_ViewportState.pScissors, source.m_Scissors, m_Scissors);
+        rebind(m_ColorBlending.pAttachments, source.m_ColorBlendAttachments, m_ColorBlendAttachments);
+        rebind(m_DynamicState.pDynamicStates, source.m_DynamicStates, m_DynamicStates);
+        rebind(m_RenderingInfo.pColorAttachmentFormats, source.m_ColorAttachmentFormats, m_ColorAttachmentFormats);
+    }
+
+    PipelineBuilder& PipelineBuilder::AddShader(const Shader& shader, SpecializationConstants specialization)
+    {
+        VkPipelineShaderStageCreateInfo stageInfo = shader.GetStageCreateInfo();
+        stageInfo.pSpecializationInfo = specialization.Get();
+        m_ShaderStages.push_back(stageInfo);
+        m_Specializations.push_back(std::move(specialization));
+        m_ShaderHashes.push_back(shader.GetCodeHash());
+        if (shader.HasReflection())
+            m_Reflection.Merge(shader.GetReflection());
+        return *this;
+    }
+
+    PipelineBuilder& PipelineBuilder::SetSpecialization(VkShaderStageFlags stages, SpecializationConstants specialization)
+    {
+        for (size_t i = 0; i < m_ShaderStages.size(); ++i)
+        {
+            if (!(m_ShaderStages[i].stage & stages))
+                continue;
+            m_ShaderStages[i].pSpecializationInfo = specialization.Get();
+            m_Specializations[i] = specialization;
+        }
         return *this;
     }
 
@@ -176,6 +300,12 @@ namespace RUBY
         return *this;
     }
 
+    PipelineBuilder& PipelineBuilder::SetPushDescriptorSet(uint32_t set)
+    {
+        m_Reflection.pushDescriptorSet = set;
+        return *this;
+    }
+
     PipelineBuilder& PipelineBuilder::AddPushConstant(const VkPushConstantRange& pushConstant)
     {
         m_PushConstants.push_back(pushConstant);
@@ -188,7 +318,12 @@ namespace RUBY
         return *this;
     }
 
-    Pipeline PipelineBuilder::Build(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool)
+    const std::vector<VkPushConstantRange>& PipelineBuilder::GetPushConstantRanges() const
+    {
+        return m_PushConstants.empty() ? m_Reflection.pushConstants : m_PushConstants;
+    }
+
+    void PipelineBuilder::PrepareRenderingInfo(SwapChain* swapChain)
     {
         // Ensure rendering info has correct attachment formats from swapchain
         m_ColorAttachmentFormats.clear();
@@ -199,6 +334,33 @@ namespace RUBY
         // If depth is enabled in depthStencil, set depthAttachmentFormat accordingly (optional)
         // VkFormat depthFmt = device->FindDepthFormat();
         // m_RenderingInfo.depthAttachmentFormat = depthFmt;
+    }
+
+    VkGraphicsPipelineCreateInfo PipelineBuilder::GetCreateInfo(VkPipelineLayout layout) const
+    {
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.pNext = &m_RenderingInfo;
+        pipelineInfo.stageCount = static_cast<uint32_t>(m_ShaderStages.size());
+        pipelineInfo.pStages = m_ShaderStages.empty() ? nullptr : m_ShaderStages.data();
+        pipelineInfo.pVertexInputState = &m_VertexInput;
+        pipelineInfo.pInputAssemblyState = &m_InputAssembly;
+        pipelineInfo.pViewportState = &m_ViewportState;
+        pipelineInfo.pRasterizationState = &m_Rasterizer;
+        pipelineInfo.pMultisampleState = &m_Multisampling;
+        pipelineInfo.pDepthStencilState = &m_DepthStencil;
+        pipelineInfo.pColorBlendState = &m_ColorBlending;
+        pipelineInfo.pDynamicState = &m_DynamicState;
+        pipelineInfo.layout = layout;
+        pipelineInfo.renderPass = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+        return pipelineInfo;
+    }
+
+    Pipeline PipelineBuilder::Build(Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool)
+    {
+        PrepareRenderingInfo(swapChain);
 
         return Pipeline(device,
             swapChain,
@@ -213,7 +375,96 @@ namespace RUBY
             m_ColorBlending,
             m_DynamicState,
             m_RenderingInfo,
-            m_PushConstants);
+            GetPushConstantRanges());
+    }
+
+    std::vector<Pipeline> PipelineBuilder::BuildBatch(std::vector<PipelineBuilder>& builders, Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool)
+    {
+        RUBY_PROFILE_FUNCTION();
+        const VkDevice logicalDevice = device->GetLogicalDevice();
+
+        std::vector<VkPipelineLayout> layouts;
+        std::vector<VkGraphicsPipelineCreateInfo> createInfos;
+        layouts.reserve(builders.size());
+        createInfos.reserve(builders.size());
+
+        try
+        {
+            for (auto& builder : builders)
+            {
+                builder.PrepareRenderingInfo(swapChain);
+                layouts.push_back(CreatePipelineLayout(device, descriptorPool, builder.GetPushConstantRanges()));
+                createInfos.push_back(builder.GetCreateInfo(layouts.back()));
+                createInfos.back().flags |= device->GetPipelineCreateFlags();
+            }
+        }
+        catch (...)
+        {
+            for (VkPipelineLayout layout : layouts)
+                vkDestroyPipelineLayout(logicalDevice, layout, nullptr);
+            throw;
+        }
+
+        std::vector<VkPipeline> pipelines(builders.size(), VK_NULL_HANDLE);
+        const VkResult result = vkCreateGraphicsPipelines(logicalDevice, device->GetPipelineCache(),
+            static_cast<uint32_t>(createInfos.size()), createInfos.data(), nullptr, pipelines.data());
+        if (result != VK_SUCCESS)
+        {
+            // Entries that did compile are still valid handles
+            for (size_t i = 0; i < pipelines.size(); ++i)
+            {
+                if (pipelines[i] != VK_NULL_HANDLE)
+                    vkDestroyPipeline(logicalDevice, pipelines[i], nullptr);
+                vkDestroyPipelineLayout(logicalDevice, layouts[i], nullptr);
+            }
+            throw std::runtime_error("Failed to create graphics pipelines (VkResult=" + std::to_string(result) + ")");
+        }
+
+        std::vector<Pipeline> built;
+        built.reserve(pipelines.size());
+        for (size_t i = 0; i < pipelines.size(); ++i)
+            built.emplace_back(device, swapChain, descriptorPool, pipelines[i], layouts[i]);
+        return built;
+    }
+
+    AsyncPipeline PipelineBuilder::BuildAsync(ThreadPool& threadPool, PipelineBuilder&& builder,
+        Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, const Pipeline* pFallback)
+    {
+        std::vector<PipelineBuilder> builders;
+        builders.push_back(std::move(builder));
+        return std::move(BuildAsync(threadPool, std::move(builders), device, swapChain, descriptorPool, 1, pFallback).front());
+    }
+
+    std::vector<AsyncPipeline> PipelineBuilder::BuildAsync(ThreadPool& threadPool, std::vector<PipelineBuilder>&& builders,
+        Device* device, SwapChain* swapChain, DescriptorPool* descriptorPool, uint32_t batchSize, const Pipeline* pFallback)
+    {
+        batchSize = std::max(batchSize, 1u);
+
+        std::vector<AsyncPipeline> handles;
+        handles.reserve(builders.size());
+
+        for (size_t first = 0; first < builders.size(); first += batchSize)
+        {
+            const size_t last = std::min(builders.size(), first + batchSize);
+
+            // Moving a builder keeps the vector storage its create infos point into
+            auto pBatch = std::make_shared<std::vector<PipelineBuilder>>();
+            pBatch->reserve(last - first);
+            for (size_t i = first; i < last; ++i)
+                pBatch->push_back(std::move(builders[i]));
+
+            std::shared_future<std::shared_ptr<AsyncPipeline::Batch>> future = threadPool.Submit([pBatch, device, swapChain, descriptorPool]()
+            {
+                RUBY_PROFILE_SCOPE("Compile Pipelines");
+                return std::make_shared<AsyncPipeline::Batch>(BuildBatch(*pBatch, device, swapChain, descriptorPool));
+            }).share();
+
+            for (size_t i = first; i < last; ++i)
+                handles.push_back(AsyncPipeline{ future, static_cast<uint32_t>(i - first), pFallback });
+        }
+
+        builders.clear();
+        return handles;
     }
 
     PipelineBuilder PipelineBuilder::CreateDefault(uint32_t width, uint32_t height)
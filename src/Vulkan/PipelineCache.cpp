@@ -0,0 +1,149 @@
+#include "Vulkan/PipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Vulkan/Device.h"
+
+namespace
+{
+	// Flushed down to the disk before returning, a rename afterwards then never exposes an empty file
+	bool WriteFileSynced(const std::filesystem::path& path, const std::vector<char>& data)
+	{
+#ifdef _WIN32
+		FILE* pFile = _wfopen(path.c_str(), L"wb");
+#else
+		FILE* pFile = std::fopen(path.c_str(), "wb");
+#endif
+		if (pFile == nullptr)
+			return false;
+
+		bool written = std::fwrite(data.data(), 1, data.size(), pFile) == data.size() && std::fflush(pFile) == 0;
+#ifdef _WIN32
+		written = written && _commit(_fileno(pFile)) == 0;
+#else
+		written = written && fsync(fileno(pFile)) == 0;
+#endif
+		return std::fclose(pFile) == 0 && written;
+	}
+}
+
+RUBY::PipelineCache::PipelineCache(const Device* pDevice, std::filesystem::path path)
+	: m_pDevice(pDevice), m_Path(std::move(path))
+{
+	std::vector<char> data;
+	std::ifstream file{ m_Path, std::ios::binary | std::ios::ate };
+	if (file.is_open())
+	{
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file)
+			data.clear();
+	}
+
+	if (!data.empty() && !IsCompatible(data))
+	{
+		std::cout << "Discarding pipeline cache " << m_Path.string() << ", it was written for another device or driver" << std::endl;
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	VkResult result = vkCreatePipelineCache(m_pDevice->GetLogicalDevice(), &createInfo, nullptr, &m_PipelineCache);
+	if (result != VK_SUCCESS && !data.empty())
+	{
+		// Passed the header check but the driver still refused it, start empty
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		data.clear();
+		result = vkCreatePipelineCache(m_pDevice->GetLogicalDevice(), &createInfo, nullptr, &m_PipelineCache);
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline cache (VkResult=" + std::to_string(result) + ")");
+	}
+
+	m_WasLoaded = !data.empty();
+	m_SavedData = std::move(data);
+
+	m_pDevice->GetDebugger().SetDebugName(reinterpret_cast<uint64_t>(m_PipelineCache), "Pipeline Cache", VK_OBJECT_TYPE_PIPELINE_CACHE);
+}
+
+RUBY::PipelineCache::~PipelineCache()
+{
+	Save();
+	vkDestroyPipelineCache(m_pDevice->GetLogicalDevice(), m_PipelineCache, nullptr);
+}
+
+bool RUBY::PipelineCache::IsCompatible(const std::vector<char>& data) const
+{
+	VkPipelineCacheHeaderVersionOne header{};
+	if (data.size() < sizeof(header))
+		return false;
+	std::memcpy(&header, data.data(), sizeof(header));
+
+	VkPhysicalDeviceProperties properties{};
+	vkGetPhysicalDeviceProperties(m_pDevice->GetPhysicalDevice(), &properties);
+
+	return header.headerSize >= sizeof(header) &&
+		header.headerSize <= data.size() &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == properties.vendorID &&
+		header.deviceID == properties.deviceID &&
+		std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+bool RUBY::PipelineCache::Save()
+{
+	size_t size = 0;
+	if (vkGetPipelineCacheData(m_pDevice->GetLogicalDevice(), m_PipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+		return false;
+
+	std::vector<char> data(size);
+	if (vkGetPipelineCacheData(m_pDevice->GetLogicalDevice(), m_PipelineCache, &size, data.data()) != VK_SUCCESS)
+		return false;
+	data.resize(size);
+
+	// Entries can be replaced without the size changing, only identical data skips the write
+	if (data == m_SavedData)
+		return true;
+
+	std::error_code error;
+	if (m_Path.has_parent_path())
+		std::filesystem::create_directories(m_Path.parent_path(), error);
+
+	std::filesystem::path tempPath = m_Path;
+	tempPath += ".tmp";
+	if (!WriteFileSynced(tempPath, data))
+	{
+		std::cout << "Failed to write pipeline cache " << tempPath.string() << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::filesystem::rename(tempPath, m_Path, error);
+	if (error)
+	{
+		std::cout << "Failed to replace pipeline cache " << m_Path.string() << ": " << error.message() << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	m_SavedData = std::move(data);
+	return true;
+}
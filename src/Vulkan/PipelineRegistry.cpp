@@ -0,0 +1,334 @@
+#include "Vulkan/PipelineRegistry.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "Core/CpuProfiler.h"
+
+namespace
+{
+	class KeyWriter
+	{
+	public:
+		explicit KeyWriter(std::string& key) : m_Key(key) { m_Key.clear(); }
+
+		// Only for types without padding or pointers, create-info structs are written field by field
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			m_Key.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template<typename T>
+		void WriteArray(const T* pValues, uint32_t count)
+		{
+			Write(count);
+			if (pValues != nullptr && count > 0)
+				m_Key.append(reinterpret_cast<const char*>(pValues), sizeof(T) * count);
+		}
+
+		void WriteString(const char* pString)
+		{
+			const size_t length = pString != nullptr ? std::strlen(pString) : 0;
+			Write(length);
+			m_Key.append(pString != nullptr ? pString : "", length);
+		}
+
+		void WriteBytes(const void* pData, size_t size)
+		{
+			Write(size);
+			if (pData != nullptr && size > 0)
+				m_Key.append(static_cast<const char*>(pData), size);
+		}
+
+	private:
+		std::string& m_Key;
+	};
+
+	// Contents instead of handles, a destroyed layout's handle can come back for a different layout.
+	// False for immutable samplers, those are handles again.
+	bool WriteSetLayouts(KeyWriter& writer, const std::vector<RUBY::DescriptorPool::DescriptorSetLayoutData>& layoutDatas)
+	{
+		writer.Write(layoutDatas.size());
+		for (const RUBY::DescriptorPool::DescriptorSetLayoutData& layoutData : layoutDatas)
+		{
+			writer.Write(layoutData.pushDescriptor);
+			writer.Write(layoutData.bindings.size());
+			for (const VkDescriptorSetLayoutBinding& binding : layoutData.bindings)
+			{
+				if (binding.pImmutableSamplers != nullptr)
+					return false;
+				writer.Write(binding.binding);
+				writer.Write(binding.descriptorType);
+				writer.Write(binding.descriptorCount);
+				writer.Write(binding.stageFlags);
+			}
+		}
+		return true;
+	}
+}
+
+RUBY::PipelineRegistry::PipelineRegistry(Device* pDevice)
+	: m_pDevice(pDevice)
+{
+}
+
+template<typename T>
+std::shared_ptr<const T> RUBY::PipelineRegistry::MakeShared(T* pObject) const
+{
+	// Whoever drops the last reference, a frame in flight may still be using the object
+	Device* pDevice = m_pDevice;
+	return std::shared_ptr<const T>(pObject, [pDevice](const T* pReleased)
+	{
+		pDevice->DeferDestroy([pReleased]() { delete pReleased; });
+	});
+}
+
+std::shared_ptr<const RUBY::Pipeline> RUBY::PipelineRegistry::GetPipeline(PipelineBuilder& builder, SwapChain* pSwapChain, DescriptorPool* pDescriptorPool)
+{
+	builder.PrepareRenderingInfo(pSwapChain);
+
+	std::string key;
+	const bool shareable = BuildPipelineKey(builder, *pDescriptorPool, key);
+
+	if (shareable)
+	{
+		std::lock_guard lock{ m_Mutex };
+		auto it = m_Pipelines.find(key);
+		if (it != m_Pipelines.end())
+		{
+			if (std::shared_ptr<const Pipeline> pExisting = it->second.lock())
+			{
+				++m_HitCount;
+				return pExisting;
+			}
+		}
+	}
+
+	// Compiled outside the lock, two threads racing for the same key both compile and one result is dropped
+	std::shared_ptr<const PipelineLayout> pLayout = GetLayout(*pDescriptorPool, builder.GetPushConstantRanges());
+
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	{
+		RUBY_PROFILE_SCOPE("Compile Pipeline");
+		VkGraphicsPipelineCreateInfo createInfo = builder.GetCreateInfo(pLayout->GetLayout());
+		createInfo.flags |= m_pDevice->GetPipelineCreateFlags();
+		if (vkCreateGraphicsPipelines(m_pDevice->GetLogicalDevice(), m_pDevice->GetPipelineCache(), 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create graphics pipeline!");
+		}
+	}
+	++m_MissCount;
+
+	if (!shareable)
+		return MakeShared(new Pipeline(m_pDevice, pSwapChain, pDescriptorPool, pipeline, std::move(pLayout)));
+
+	std::lock_guard lock{ m_Mutex };
+	std::weak_ptr<const Pipeline>& slot = m_Pipelines[key];
+	if (std::shared_ptr<const Pipeline> pExisting = slot.lock())
+	{
+		// Lost the race, ours was never used by the GPU
+		vkDestroyPipeline(m_pDevice->GetLogicalDevice(), pipeline, nullptr);
+		return pExisting;
+	}
+
+	std::shared_ptr<const Pipeline> pPipeline = MakeShared(new Pipeline(m_pDevice, pSwapChain, pDescriptorPool, pipeline, std::move(pLayout)));
+	slot = pPipeline;
+	if (m_Pipelines.size() >= m_PruneThreshold)
+		PruneLocked();
+	return pPipeline;
+}
+
+std::shared_ptr<const RUBY::PipelineLayout> RUBY::PipelineRegistry::GetLayout(const DescriptorPool& descriptorPool,
+	const std::vector<VkPushConstantRange>& pushConstants)
+{
+	const std::vector<VkDescriptorSetLayout>& setLayouts = descriptorPool.GetDescriptorSetLayouts();
+	std::string key;
+	const bool shareable = BuildLayoutKey(descriptorPool, pushConstants, key);
+
+	std::unique_lock lock{ m_Mutex, std::defer_lock };
+	std::weak_ptr<const PipelineLayout>* pSlot = nullptr;
+	if (shareable)
+	{
+		lock.lock();
+		pSlot = &m_Layouts[key];
+		if (std::shared_ptr<const PipelineLayout> pExisting = pSlot->lock())
+			return pExisting;
+	}
+
+	VkPipelineLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	layoutInfo.pSetLayouts = setLayouts.empty() ? nullptr : setLayouts.data();
+	layoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+	layoutInfo.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data();
+
+	VkPipelineLayout layout;
+	if (vkCreatePipelineLayout(m_pDevice->GetLogicalDevice(), &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create pipeline layout!");
+	}
+
+	std::shared_ptr<const PipelineLayout> pLayout = MakeShared(new PipelineLayout(m_pDevice, layout));
+	if (pSlot != nullptr)
+		*pSlot = pLayout;
+	return pLayout;
+}
+
+void RUBY::PipelineRegistry::Prune()
+{
+	std::lock_guard lock{ m_Mutex };
+	PruneLocked();
+}
+
+void RUBY::PipelineRegistry::PruneLocked()
+{
+	std::erase_if(m_Pipelines, [](const auto& entry) { return entry.second.expired(); });
+	std::erase_if(m_Layouts, [](const auto& entry) { return entry.second.expired(); });
+	m_PruneThreshold = std::max<size_t>(64, m_Pipelines.size() * 2);
+}
+
+uint32_t RUBY::PipelineRegistry::GetPipelineCount() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return static_cast<uint32_t>(std::count_if(m_Pipelines.begin(), m_Pipelines.end(),
+		[](const auto& entry) { return !entry.second.expired(); }));
+}
+
+bool RUBY::PipelineRegistry::BuildPipelineKey(const PipelineBuilder& builder, const DescriptorPool& descriptorPool, std::string& outKey)
+{
+	KeyWriter writer{ outKey };
+
+	writer.Write(builder.m_ShaderStages.size());
+	for (size_t i = 0; i < builder.m_ShaderStages.size(); ++i)
+	{
+		const VkPipelineShaderStageCreateInfo& stage = builder.m_ShaderStages[i];
+
+		// Keyed on the SPIR-V content, module handles and code pointers are recycled once freed.
+		// Shaders from outside the ShaderCache have no content hash and are never shared.
+		const uint64_t codeHash = builder.m_ShaderHashes[i];
+		if (codeHash == 0)
+			return false;
+		writer.Write(codeHash);
+
+		// ShaderCache stages without a module carry their code as the only chained struct
+		const auto* pModuleInfo = static_cast<const VkShaderModuleCreateInfo*>(stage.pNext);
+		if (pModuleInfo != nullptr)
+		{
+			if (pModuleInfo->sType != VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO || pModuleInfo->pNext != nullptr)
+				return false;
+			writer.Write(pModuleInfo->codeSize);
+		}
+
+		writer.Write(stage.flags);
+		writer.Write(stage.stage);
+		writer.WriteString(stage.pName);
+
+		const VkSpecializationInfo* pSpecialization = stage.pSpecializationInfo;
+		writer.Write(pSpecialization != nullptr);
+		if (pSpecialization != nullptr)
+		{
+			writer.WriteArray(pSpecialization->pMapEntries, pSpecialization->mapEntryCount);
+			writer.WriteBytes(pSpecialization->pData, pSpecialization->dataSize);
+		}
+	}
+
+	const VkPipelineVertexInputStateCreateInfo& vertexInput = builder.m_VertexInput;
+	writer.Write(vertexInput.flags);
+	writer.WriteArray(vertexInput.pVertexBindingDescriptions, vertexInput.vertexBindingDescriptionCount);
+	writer.WriteArray(vertexInput.pVertexAttributeDescriptions, vertexInput.vertexAttributeDescriptionCount);
+
+	const VkPipelineInputAssemblyStateCreateInfo& inputAssembly = builder.m_InputAssembly;
+	writer.Write(inputAssembly.flags);
+	writer.Write(inputAssembly.topology);
+	writer.Write(inputAssembly.primitiveRestartEnable);
+
+	const VkPipelineDynamicStateCreateInfo& dynamicState = builder.m_DynamicState;
+	writer.Write(dynamicState.flags);
+	writer.WriteArray(dynamicState.pDynamicStates, dynamicState.dynamicStateCount);
+
+	const auto isDynamic = [&dynamicState](VkDynamicState state)
+	{
+		return dynamicState.pDynamicStates != nullptr &&
+			std::find(dynamicState.pDynamicStates, dynamicState.pDynamicStates + dynamicState.dynamicStateCount, state) !=
+			dynamicState.pDynamicStates + dynamicState.dynamicStateCount;
+	};
+
+	// Dynamic viewports and scissors don't end up in the pipeline, so their values don't split entries
+	const VkPipelineViewportStateCreateInfo& viewportState = builder.m_ViewportState;
+	writer.Write(viewportState.flags);
+	writer.Write(viewportState.viewportCount);
+	writer.Write(viewportState.scissorCount);
+	if (!isDynamic(VK_DYNAMIC_STATE_VIEWPORT))
+		writer.WriteArray(viewportState.pViewports, viewportState.pViewports != nullptr ? viewportState.viewportCount : 0);
+	if (!isDynamic(VK_DYNAMIC_STATE_SCISSOR))
+		writer.WriteArray(viewportState.pScissors, viewportState.pScissors != nullptr ? viewportState.scissorCount : 0);
+
+	const VkPipelineRasterizationStateCreateInfo& rasterizer = builder.m_Rasterizer;
+	writer.Write(rasterizer.flags);
+	writer.Write(rasterizer.depthClampEnable);
+	writer.Write(rasterizer.rasterizerDiscardEnable);
+	writer.Write(rasterizer.polygonMode);
+	writer.Write(rasterizer.cullMode);
+	writer.Write(rasterizer.frontFace);
+	writer.Write(rasterizer.depthBiasEnable);
+	writer.Write(rasterizer.depthBiasConstantFactor);
+	writer.Write(rasterizer.depthBiasClamp);
+	writer.Write(rasterizer.depthBiasSlopeFactor);
+	writer.Write(rasterizer.lineWidth);
+
+	const VkPipelineMultisampleStateCreateInfo& multisampling = builder.m_Multisampling;
+	writer.Write(multisampling.flags);
+	writer.Write(multisampling.rasterizationSamples);
+	writer.Write(multisampling.sampleShadingEnable);
+	writer.Write(multisampling.minSampleShading);
+	writer.WriteArray(multisampling.pSampleMask, multisampling.pSampleMask != nullptr ? (multisampling.rasterizationSamples + 31) / 32 : 0);
+	writer.Write(multisampling.alphaToCoverageEnable);
+	writer.Write(multisampling.alphaToOneEnable);
+
+	const VkPipelineDepthStencilStateCreateInfo& depthStencil = builder.m_DepthStencil;
+	writer.Write(depthStencil.flags);
+	writer.Write(depthStencil.depthTestEnable);
+	writer.Write(depthStencil.depthWriteEnable);
+	writer.Write(depthStencil.depthCompareOp);
+	writer.Write(depthStencil.depthBoundsTestEnable);
+	writer.Write(depthStencil.stencilTestEnable);
+	writer.Write(depthStencil.front);
+	writer.Write(depthStencil.back);
+	writer.Write(depthStencil.minDepthBounds);
+	writer.Write(depthStencil.maxDepthBounds);
+
+	const VkPipelineColorBlendStateCreateInfo& colorBlending = builder.m_ColorBlending;
+	writer.Write(colorBlending.flags);
+	writer.Write(colorBlending.logicOpEnable);
+	writer.Write(colorBlending.logicOp);
+	writer.WriteArray(colorBlending.pAttachments, colorBlending.attachmentCount);
+	writer.Write(colorBlending.blendConstants);
+
+	const VkPipelineRenderingCreateInfo& renderingInfo = builder.m_RenderingInfo;
+	writer.Write(renderingInfo.viewMask);
+	writer.WriteArray(renderingInfo.pColorAttachmentFormats, renderingInfo.colorAttachmentCount);
+	writer.Write(renderingInfo.depthAttachmentFormat);
+	writer.Write(renderingInfo.stencilAttachmentFormat);
+
+	if (!WriteSetLayouts(writer, descriptorPool.GetSetLayoutData()))
+		return false;
+	const std::vector<VkPushConstantRange>& pushConstants = builder.GetPushConstantRanges();
+	writer.WriteArray(pushConstants.data(), static_cast<uint32_t>(pushConstants.size()));
+
+	return vertexInput.pNext == nullptr && inputAssembly.pNext == nullptr && dynamicState.pNext == nullptr &&
+		viewportState.pNext == nullptr && rasterizer.pNext == nullptr && multisampling.pNext == nullptr &&
+		depthStencil.pNext == nullptr && colorBlending.pNext == nullptr && renderingInfo.pNext == nullptr;
+}
+
+bool RUBY::PipelineRegistry::BuildLayoutKey(const DescriptorPool& descriptorPool, const std::vector<VkPushConstantRange>& pushConstants, std::string& outKey)
+{
+	KeyWriter writer{ outKey };
+	if (!WriteSetLayouts(writer, descriptorPool.GetSetLayoutData()))
+		return false;
+	writer.WriteArray(pushConstants.data(), static_cast<uint32_t>(pushConstants.size()));
+	return true;
+}
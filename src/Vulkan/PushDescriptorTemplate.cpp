@@ -0,0 +1,94 @@
+#include "Vulkan/PushDescriptorTemplate.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "Vulkan/Device.h"
+
+RUBY::PushDescriptorTemplate::PushDescriptorTemplate(Device* pDevice, VkDescriptorSetLayout setLayout, VkPipelineLayout pipelineLayout, uint32_t set,
+	VkPipelineBindPoint bindPoint, const std::vector<Entry>& entries)
+	: m_pDevice(pDevice), m_PipelineLayout(pipelineLayout), m_Set(set)
+{
+	if (!pDevice->SupportsPushDescriptors())
+	{
+		throw std::runtime_error("Push descriptors are not supported by this device!");
+	}
+
+	std::vector<VkDescriptorUpdateTemplateEntry> templateEntries;
+	templateEntries.reserve(entries.size());
+	for (const Entry& entry : entries)
+	{
+		VkDescriptorUpdateTemplateEntry templateEntry{};
+		templateEntry.dstBinding = entry.binding;
+		templateEntry.dstArrayElement = 0;
+		templateEntry.descriptorCount = entry.count;
+		templateEntry.descriptorType = entry.type;
+		templateEntry.offset = m_DescriptorCount * sizeof(PushDescriptorInfo);
+		templateEntry.stride = sizeof(PushDescriptorInfo);
+		templateEntries.push_back(templateEntry);
+		m_DescriptorCount += entry.count;
+	}
+	if (m_DescriptorCount > pDevice->GetMaxPushDescriptors())
+	{
+		throw std::runtime_error("Push descriptor set " + std::to_string(set) + " holds " + std::to_string(m_DescriptorCount) +
+			" descriptors, the device allows " + std::to_string(pDevice->GetMaxPushDescriptors()));
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	createInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(templateEntries.size());
+	createInfo.pDescriptorUpdateEntries = templateEntries.data();
+	createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+	createInfo.descriptorSetLayout = setLayout;
+	createInfo.pipelineBindPoint = bindPoint;
+	createInfo.pipelineLayout = pipelineLayout;
+	createInfo.set = set;
+
+	if (vkCreateDescriptorUpdateTemplate(pDevice->GetLogicalDevice(), &createInfo, nullptr, &m_Template) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create push descriptor update template!");
+	}
+}
+
+RUBY::PushDescriptorTemplate::PushDescriptorTemplate(Device* pDevice, VkDescriptorSetLayout setLayout, VkPipelineLayout pipelineLayout, uint32_t set,
+	VkPipelineBindPoint bindPoint, const ShaderReflection& reflection)
+	: PushDescriptorTemplate(pDevice, setLayout, pipelineLayout, set, bindPoint, GetEntries(reflection, set))
+{
+}
+
+RUBY::PushDescriptorTemplate::~PushDescriptorTemplate()
+{
+	vkDestroyDescriptorUpdateTemplate(m_pDevice->GetLogicalDevice(), m_Template, nullptr);
+}
+
+void RUBY::PushDescriptorTemplate::Push(VkCommandBuffer commandBuffer, const PushDescriptorInfo* pInfos) const
+{
+	m_pDevice->CmdPushDescriptorSetWithTemplate(commandBuffer, m_Template, m_PipelineLayout, m_Set, pInfos);
+}
+
+void RUBY::PushDescriptorTemplate::Push(VkCommandBuffer commandBuffer, std::initializer_list<PushDescriptorInfo> infos) const
+{
+	if (infos.size() != m_DescriptorCount)
+	{
+		throw std::invalid_argument("Push descriptor template expects " + std::to_string(m_DescriptorCount) + " descriptors, got " +
+			std::to_string(infos.size()));
+	}
+	Push(commandBuffer, infos.begin());
+}
+
+std::vector<RUBY::PushDescriptorTemplate::Entry> RUBY::PushDescriptorTemplate::GetEntries(const ShaderReflection& reflection, uint32_t set)
+{
+	std::vector<Entry> entries;
+	for (const ShaderReflection::Binding& binding : reflection.bindings)
+	{
+		if (binding.set != set)
+			continue;
+		if (binding.count == 0)
+		{
+			throw std::runtime_error("Set " + std::to_string(set) + " binding " + std::to_string(binding.binding) +
+				" is runtime sized, push descriptors need a fixed count");
+		}
+		entries.push_back({ binding.binding, binding.type, binding.count });
+	}
+	return entries;
+}
@@ -0,0 +1,1104 @@
+#include "Vulkan/RenderGraph.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+#include "vulkan/vulkan.h"
+#include "vk_mem_alloc.h"
+
+#include "Core/CpuProfiler.h"
+#include "Vulkan/CommandPool.h"
+#include "Vulkan/Defragmenter.h"
+#include "Vulkan/DescriptorBuffer.h"
+#include "Vulkan/FrameContext.h"
+#include "Vulkan/GpuProfiler.h"
+#include "Vulkan/MemoryTracker.h"
+#include "Vulkan/Passes/IBasePass.h"
+#include "Vulkan/TimelineSemaphore.h"
+
+namespace RUBY
+{
+    namespace
+    {
+        constexpr VkAccessFlags2 WRITE_ACCESS_MASK =
+            VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+            VK_ACCESS_2_TRANSFER_WRITE_BIT |
+            VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+        // The only usages TRANSIENT_ATTACHMENT may be combined with
+        constexpr VkImageUsageFlags TRANSIENT_ATTACHMENT_USAGE =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+            VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+        // What a barrier recorded on the compute queue may name, graphics stages are covered by the semaphore
+        constexpr VkPipelineStageFlags2 COMPUTE_QUEUE_STAGES =
+            VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+            VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT |
+            VK_PIPELINE_STAGE_2_HOST_BIT |
+            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        constexpr VkAccessFlags2 COMPUTE_QUEUE_ACCESS =
+            VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+            VK_ACCESS_2_UNIFORM_READ_BIT |
+            VK_ACCESS_2_SHADER_READ_BIT |
+            VK_ACCESS_2_SHADER_WRITE_BIT |
+            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+            VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+            VK_ACCESS_2_TRANSFER_READ_BIT |
+            VK_ACCESS_2_TRANSFER_WRITE_BIT |
+            VK_ACCESS_2_HOST_READ_BIT |
+            VK_ACCESS_2_HOST_WRITE_BIT |
+            VK_ACCESS_2_MEMORY_READ_BIT |
+            VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+        bool IsGraphicsOnlyUsage(ResourceUsage usage)
+        {
+            return usage == ResourceUsage::ColorAttachment ||
+                usage == ResourceUsage::DepthAttachmentWrite ||
+                usage == ResourceUsage::DepthAttachmentRead ||
+                usage == ResourceUsage::SampledFragment;
+        }
+
+        uint32_t QueueBit(QueueType queue)
+        {
+            return 1u << static_cast<uint32_t>(queue);
+        }
+
+        void RestrictToQueue(QueueType queue, VkPipelineStageFlags2& stage, VkAccessFlags2& access)
+        {
+            if (queue != QueueType::Compute)
+                return;
+
+            stage &= COMPUTE_QUEUE_STAGES;
+            access &= COMPUTE_QUEUE_ACCESS;
+        }
+
+        struct UsageInfo
+        {
+            VkPipelineStageFlags2 stage;
+            VkAccessFlags2 access;
+            VkImageLayout layout;
+            VkImageUsageFlags imageUsage;
+        };
+
+        UsageInfo GetUsageInfo(ResourceUsage usage)
+        {
+            switch (usage)
+            {
+            case ResourceUsage::ColorAttachment:
+                return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT };
+            case ResourceUsage::DepthAttachmentWrite:
+                return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+            case ResourceUsage::DepthAttachmentRead:
+                return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT };
+            case ResourceUsage::SampledFragment:
+                return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+            case ResourceUsage::SampledCompute:
+                return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT };
+            case ResourceUsage::StorageReadCompute:
+                return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+            case ResourceUsage::StorageWriteCompute:
+                return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT };
+            case ResourceUsage::TransferSrc:
+                return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT };
+            case ResourceUsage::TransferDst:
+                return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT };
+            }
+
+            throw std::invalid_argument("Unknown render graph resource usage!");
+        }
+    }
+
+    // ---------------- RenderGraphBuilder Implementation ---------------- //
+
+    void RenderGraphBuilder::CreateImage(const std::string& name, const TransientImageDesc& desc)
+    {
+        uint32_t index = m_Graph.GetOrAddResource(name);
+        auto& resource = m_Graph.m_Resources[index];
+        if (resource.isImported || resource.creatorPass >= 0)
+        {
+            throw std::runtime_error("Render graph resource declared twice: " + name);
+        }
+
+        resource.desc = desc;
+        resource.creatorPass = static_cast<int>(m_PassIndex);
+    }
+
+    void RenderGraphBuilder::Read(const std::string& name, ResourceUsage usage)
+    {
+        m_Graph.m_Passes[m_PassIndex].accesses.push_back({ name, usage, false });
+    }
+
+    void RenderGraphBuilder::Write(const std::string& name, ResourceUsage usage)
+    {
+        m_Graph.m_Passes[m_PassIndex].accesses.push_back({ name, usage, true });
+    }
+
+    void RenderGraphBuilder::SetSideEffects()
+    {
+        m_Graph.m_Passes[m_PassIndex].hasSideEffects = true;
+    }
+
+    // ---------------- RenderGraph Implementation ---------------- //
+
+    RenderGraph::RenderGraph(Device* pDevice, CommandPool* pCommandPool)
+        : m_pDevice(pDevice), m_pCommandPool(pCommandPool)
+    {
+    }
+
+    RenderGraph::~RenderGraph()
+    {
+        ReleaseTransients();
+    }
+
+    void RenderGraph::AddPass(const std::string& name, IBasePass* pPass)
+    {
+        PassNode node{};
+        node.name = name;
+        node.profileName = RUBY_PROFILE_INTERN(name);
+        node.pPass = pPass;
+        m_Passes.push_back(std::move(node));
+        m_IsCompiled = false;
+    }
+
+    void RenderGraph::ImportImage(const std::string& name, VkImageLayout finalLayout)
+    {
+        uint32_t index = GetOrAddResource(name);
+        m_Resources[index].isImported = true;
+        m_Resources[index].finalLayout = finalLayout;
+        m_IsCompiled = false;
+    }
+
+    void RenderGraph::BindImage(const std::string& name, Image* pImage)
+    {
+        auto it = m_ResourceLookup.find(name);
+        if (it == m_ResourceLookup.end() || !m_Resources[it->second].isImported)
+        {
+            throw std::runtime_error("Render graph image was not imported: " + name);
+        }
+        m_Resources[it->second].pImage = pImage;
+    }
+
+    Image& RenderGraph::GetImage(const std::string& name)
+    {
+        auto it = m_ResourceLookup.find(name);
+        if (it == m_ResourceLookup.end() || m_Resources[it->second].pImage == nullptr)
+        {
+            throw std::runtime_error("Render graph image is not available: " + name);
+        }
+        return *m_Resources[it->second].pImage;
+    }
+
+    uint32_t RenderGraph::GetOrAddResource(const std::string& name)
+    {
+        auto it = m_ResourceLookup.find(name);
+        if (it != m_ResourceLookup.end())
+            return it->second;
+
+        uint32_t index = static_cast<uint32_t>(m_Resources.size());
+        ResourceNode node{};
+        node.name = name;
+        m_Resources.push_back(std::move(node));
+        m_ResourceLookup.emplace(name, index);
+        return index;
+    }
+
+    void RenderGraph::Compile(VkExtent2D extent)
+    {
+        RUBY_PROFILE_FUNCTION();
+
+        // Batch layout changes, so compute work of the previous layout can't be tracked per batch anymore
+        TimelineSemaphore& computeTimeline = m_pDevice->GetComputeTimeline();
+        computeTimeline.Wait(computeTimeline.GetPendingValue());
+
+        ReleaseTransients();
+
+        // Imported resources survive a recompile, everything the passes declare is rebuilt from Setup
+        std::vector<ResourceNode> imported;
+        for (auto& resource : m_Resources)
+        {
+            if (!resource.isImported)
+                continue;
+
+            ResourceNode node{};
+            node.name = resource.name;
+            node.isImported = true;
+            node.finalLayout = resource.finalLayout;
+            node.pImage = resource.pImage;
+            imported.push_back(std::move(node));
+        }
+
+        m_Resources = std::move(imported);
+        m_ResourceLookup.clear();
+        for (uint32_t i = 0; i < m_Resources.size(); ++i)
+            m_ResourceLookup.emplace(m_Resources[i].name, i);
+
+        for (uint32_t i = 0; i < m_Passes.size(); ++i)
+        {
+            auto& pass = m_Passes[i];
+            pass.accesses.clear();
+            pass.hasSideEffects = false;
+            pass.producers.clear();
+            pass.dependencies.clear();
+            pass.queue = pass.pPass->GetQueueType();
+            if (pass.queue == QueueType::Transfer)
+            {
+                throw std::runtime_error("Pass '" + pass.name + "' runs on the transfer queue, use the UploadManager for copies instead");
+            }
+
+            RenderGraphBuilder builder{ *this, i };
+            pass.pPass->Setup(builder);
+        }
+
+        ResolveAccesses();
+        BuildDependencies();
+        SortAndCull();
+        AllocateTransients(extent);
+        PlanBarriers();
+
+        m_IsCompiled = true;
+    }
+
+    void RenderGraph::ResolveAccesses()
+    {
+        for (auto& pass : m_Passes)
+        {
+            std::vector<ResourceAccess> merged;
+            for (auto& access : pass.accesses)
+            {
+                auto it = m_ResourceLookup.find(access.name);
+                if (it == m_ResourceLookup.end())
+                {
+                    throw std::runtime_error("Pass '" + pass.name + "' uses undeclared resource: " + access.name);
+                }
+
+                if (pass.queue == QueueType::Compute && IsGraphicsOnlyUsage(access.usage))
+                {
+                    throw std::runtime_error("Compute pass '" + pass.name + "' uses " + access.name + " as an attachment or in a fragment shader");
+                }
+
+                UsageInfo info = GetUsageInfo(access.usage);
+                access.resource = it->second;
+                access.stage = info.stage;
+                access.access = info.access;
+                access.layout = info.layout;
+
+                // One access per resource per pass, a read + write of the same image becomes a single write
+                auto existing = std::find_if(merged.begin(), merged.end(),
+                    [&](const ResourceAccess& other) { return other.resource == access.resource; });
+                if (existing == merged.end())
+                {
+                    merged.push_back(access);
+                    continue;
+                }
+
+                existing->stage |= access.stage;
+                existing->access |= access.access;
+                if (access.isWrite)
+                {
+                    existing->isWrite = true;
+                    existing->usage = access.usage;
+                    existing->layout = access.layout;
+                }
+            }
+            pass.accesses = std::move(merged);
+        }
+    }
+
+    void RenderGraph::BuildDependencies()
+    {
+        auto addUnique = [](std::vector<uint32_t>& list, uint32_t value)
+        {
+            if (std::find(list.begin(), list.end(), value) == list.end())
+                list.push_back(value);
+        };
+
+        for (uint32_t resource = 0; resource < m_Resources.size(); ++resource)
+        {
+            // Users of this resource in insertion order
+            std::vector<std::pair<uint32_t, bool>> users;
+            int firstWriter = -1;
+            for (uint32_t pass = 0; pass < m_Passes.size(); ++pass)
+            {
+                for (const auto& access : m_Passes[pass].accesses)
+                {
+                    if (access.resource != resource)
+                        continue;
+
+                    users.emplace_back(pass, access.isWrite);
+                    if (access.isWrite && firstWriter < 0)
+                        firstWriter = static_cast<int>(pass);
+                }
+            }
+
+            // A reader consumes the latest earlier write, or the first write if it was added before any producer.
+            // Readers of one write have to finish before the next write to the same resource.
+            int lastWriter = -1;
+            std::vector<uint32_t> pendingReaders;
+            for (const auto& [pass, isWrite] : users)
+            {
+                if (!isWrite)
+                {
+                    int producer = lastWriter >= 0 ? lastWriter : firstWriter;
+                    if (producer >= 0 && producer != static_cast<int>(pass))
+                    {
+                        addUnique(m_Passes[pass].producers, producer);
+                        addUnique(m_Passes[pass].dependencies, producer);
+                    }
+                    pendingReaders.push_back(pass);
+                    continue;
+                }
+
+                if (lastWriter >= 0)
+                {
+                    addUnique(m_Passes[pass].producers, lastWriter);
+                    addUnique(m_Passes[pass].dependencies, lastWriter);
+                }
+
+                std::vector<uint32_t> stillPending;
+                for (uint32_t reader : pendingReaders)
+                {
+                    // Readers that were waiting on this very write run after it instead
+                    if (lastWriter < 0 && static_cast<int>(pass) == firstWriter)
+                        stillPending.push_back(reader);
+                    else if (reader != pass)
+                        addUnique(m_Passes[pass].dependencies, reader);
+                }
+                pendingReaders = std::move(stillPending);
+                lastWriter = static_cast<int>(pass);
+            }
+        }
+    }
+
+    void RenderGraph::SortAndCull()
+    {
+        const uint32_t passCount = static_cast<uint32_t>(m_Passes.size());
+
+        // Kahn's algorithm, ties broken by insertion order so the result is deterministic
+        std::vector<uint32_t> inDegree(passCount, 0);
+        std::vector<std::vector<uint32_t>> dependents(passCount);
+        for (uint32_t pass = 0; pass < passCount; ++pass)
+        {
+            for (uint32_t dependency : m_Passes[pass].dependencies)
+            {
+                dependents[dependency].push_back(pass);
+                ++inDegree[pass];
+            }
+        }
+
+        std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+        for (uint32_t pass = 0; pass < passCount; ++pass)
+        {
+            if (inDegree[pass] == 0)
+                ready.push(pass);
+        }
+
+        std::vector<uint32_t> sorted;
+        sorted.reserve(passCount);
+        while (!ready.empty())
+        {
+            uint32_t pass = ready.top();
+            ready.pop();
+            sorted.push_back(pass);
+
+            for (uint32_t dependent : dependents[pass])
+            {
+                if (--inDegree[dependent] == 0)
+                    ready.push(dependent);
+            }
+        }
+
+        if (sorted.size() != passCount)
+        {
+            throw std::runtime_error("Render graph has a dependency cycle!");
+        }
+
+        // Only passes that (transitively) feed an imported image or have side effects survive
+        std::vector<bool> alive(passCount, false);
+        std::vector<uint32_t> stack;
+        for (uint32_t pass = 0; pass < passCount; ++pass)
+        {
+            bool isRoot = m_Passes[pass].hasSideEffects;
+            for (const auto& access : m_Passes[pass].accesses)
+            {
+                if (access.isWrite && m_Resources[access.resource].isImported)
+                    isRoot = true;
+            }
+
+            if (isRoot)
+            {
+                alive[pass] = true;
+                stack.push_back(pass);
+            }
+        }
+
+        while (!stack.empty())
+        {
+            uint32_t pass = stack.back();
+            stack.pop_back();
+            for (uint32_t producer : m_Passes[pass].producers)
+            {
+                if (!alive[producer])
+                {
+                    alive[producer] = true;
+                    stack.push_back(producer);
+                }
+            }
+        }
+
+        m_ExecutionOrder.clear();
+        for (uint32_t pass : sorted)
+        {
+            if (alive[pass])
+                m_ExecutionOrder.push_back(pass);
+        }
+
+        BuildBatches();
+
+        for (uint32_t position = 0; position < m_ExecutionOrder.size(); ++position)
+        {
+            const PassNode& pass = m_Passes[m_ExecutionOrder[position]];
+            for (const auto& access : pass.accesses)
+            {
+                auto& resource = m_Resources[access.resource];
+                resource.firstUse = std::min(resource.firstUse, position);
+                resource.lastUse = std::max(resource.lastUse, position);
+                resource.firstBatch = std::min(resource.firstBatch, m_PositionBatch[position]);
+                resource.lastBatch = std::max(resource.lastBatch, m_PositionBatch[position]);
+                resource.queueMask |= QueueBit(pass.queue);
+                resource.usage |= GetUsageInfo(access.usage).imageUsage;
+                resource.stages |= access.stage;
+                if (access.isWrite)
+                    resource.writeAccess |= access.access & WRITE_ACCESS_MASK;
+            }
+        }
+    }
+
+    void RenderGraph::BuildBatches()
+    {
+        m_Batches.clear();
+        m_PositionBatch.assign(m_ExecutionOrder.size(), 0);
+
+        for (uint32_t position = 0; position < m_ExecutionOrder.size(); ++position)
+        {
+            const QueueType queue = m_Passes[m_ExecutionOrder[position]].queue;
+            if (m_Batches.empty() || m_Batches.back().queue != queue)
+            {
+                Batch batch{};
+                batch.queue = queue;
+                batch.firstPosition = position;
+                m_Batches.push_back(std::move(batch));
+            }
+
+            m_Batches.back().endPosition = position + 1;
+            m_PositionBatch[position] = static_cast<uint32_t>(m_Batches.size()) - 1;
+        }
+
+        // The caller's command buffer always belongs to a graphics batch, even if only final barriers go in it
+        auto lastGraphics = std::find_if(m_Batches.rbegin(), m_Batches.rend(),
+            [](const Batch& batch) { return batch.queue == QueueType::Graphics; });
+        if (lastGraphics == m_Batches.rend())
+        {
+            Batch batch{};
+            batch.queue = QueueType::Graphics;
+            batch.firstPosition = static_cast<uint32_t>(m_ExecutionOrder.size());
+            batch.endPosition = batch.firstPosition;
+            m_Batches.push_back(std::move(batch));
+            m_FinalBatch = static_cast<uint32_t>(m_Batches.size()) - 1;
+        }
+        else
+        {
+            m_FinalBatch = static_cast<uint32_t>(std::distance(lastGraphics, m_Batches.rend())) - 1;
+        }
+    }
+
+    void RenderGraph::AllocateTransients(VkExtent2D extent)
+    {
+        std::vector<uint32_t> transients;
+        for (uint32_t i = 0; i < m_Resources.size(); ++i)
+        {
+            const auto& resource = m_Resources[i];
+            if (resource.isImported || resource.firstUse == ~0u)
+                continue;
+
+            if (resource.creatorPass < 0)
+            {
+                throw std::runtime_error("Render graph resource is never created: " + resource.name);
+            }
+            transients.push_back(i);
+        }
+
+        std::sort(transients.begin(), transients.end(),
+            [this](uint32_t a, uint32_t b) { return m_Resources[a].firstUse < m_Resources[b].firstUse; });
+
+        const bool hasLazyMemory = m_pDevice->SupportsLazilyAllocatedMemory();
+
+        // Greedy interval packing: a resource moves into the first slot whose previous occupant is already dead
+        std::vector<VkImageCreateInfo> createInfos(m_Resources.size());
+        m_AliasSlots.clear();
+        for (uint32_t index : transients)
+        {
+            auto& resource = m_Resources[index];
+            const VkImageUsageFlags usage = resource.usage | resource.desc.extraUsage;
+
+            // Contents never outlive the pass, so tilers can keep it in tile memory without committing any
+            resource.isLazy = hasLazyMemory && resource.firstUse == resource.lastUse && (usage & ~TRANSIENT_ATTACHMENT_USAGE) == 0;
+
+            VkImageCreateInfo& imageInfo = createInfos[index];
+            imageInfo = {};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent.width = resource.desc.width != 0 ? resource.desc.width : extent.width;
+            imageInfo.extent.height = resource.desc.height != 0 ? resource.desc.height : extent.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = resource.desc.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = resource.isLazy ? usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : usage;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkDeviceImageMemoryRequirements requirementsInfo{};
+            requirementsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS;
+            requirementsInfo.pCreateInfo = &imageInfo;
+
+            VkMemoryRequirements2 requirements{};
+            requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+            vkGetDeviceImageMemoryRequirements(m_pDevice->GetLogicalDevice(), &requirementsInfo, &requirements);
+            const VkMemoryRequirements& reqs = requirements.memoryRequirements;
+
+            uint32_t slotIndex = ~0u;
+            for (uint32_t i = 0; i < m_AliasSlots.size(); ++i)
+            {
+                const auto& slot = m_AliasSlots[i];
+                // Only single-queue resources of the same queue share memory, anything else would need semaphores
+                // between unrelated passes
+                const bool sameQueue = slot.queueMask == resource.queueMask && (resource.queueMask & (resource.queueMask - 1)) == 0;
+                if (sameQueue && slot.isLazy == resource.isLazy && slot.lastUse < resource.firstUse &&
+                    (slot.requirements.memoryTypeBits & reqs.memoryTypeBits) != 0)
+                {
+                    slotIndex = i;
+                    break;
+                }
+            }
+
+            if (slotIndex == ~0u)
+            {
+                slotIndex = static_cast<uint32_t>(m_AliasSlots.size());
+                AliasSlot slot{};
+                slot.requirements = reqs;
+                slot.queueMask = resource.queueMask;
+                slot.isLazy = resource.isLazy;
+                m_AliasSlots.push_back(slot);
+            }
+
+            auto& slot = m_AliasSlots[slotIndex];
+            slot.requirements.size = std::max(slot.requirements.size, reqs.size);
+            slot.requirements.alignment = std::max(slot.requirements.alignment, reqs.alignment);
+            slot.requirements.memoryTypeBits &= reqs.memoryTypeBits;
+            slot.lastUse = resource.lastUse;
+            slot.stages |= resource.stages;
+            slot.writeAccess |= resource.writeAccess;
+            resource.aliasSlot = slotIndex;
+        }
+
+        m_TransientMemorySize = 0;
+        m_LazyMemorySize = 0;
+        for (auto& slot : m_AliasSlots)
+        {
+            VmaAllocationCreateInfo allocInfo{};
+            allocInfo.requiredFlags = slot.isLazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            if (vmaAllocateMemory(m_pDevice->GetAllocator(), &slot.requirements, &allocInfo, &slot.memory, nullptr) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to allocate render graph transient memory!");
+            }
+            m_pDevice->GetMemoryTracker().Track(slot.memory, MemoryCategory::RenderTarget,
+                slot.isLazy ? "RenderGraph Lazy Transient" : "RenderGraph Transient");
+            if (slot.isLazy)
+                m_LazyMemorySize += slot.requirements.size;
+            else
+                m_TransientMemorySize += slot.requirements.size;
+        }
+
+        for (uint32_t index : transients)
+        {
+            auto& resource = m_Resources[index];
+            resource.pTransientImage = std::make_unique<Image>(m_pDevice, m_pCommandPool, createInfos[index],
+                m_AliasSlots[resource.aliasSlot].memory, resource.desc.aspectFlags);
+            resource.pImage = resource.pTransientImage.get();
+
+            resource.pImage->SetName(resource.name);
+        }
+    }
+
+    void RenderGraph::PlanBarriers()
+    {
+        struct State
+        {
+            VkImageLayout layout;
+            VkPipelineStageFlags2 writeStage;	// last write (or layout transition)
+            VkAccessFlags2 writeAccess;
+            VkPipelineStageFlags2 readStages;	// reads since that write
+            VkPipelineStageFlags2 visibleStages;	// stages the write was already made visible to
+            bool touched;
+            QueueType queue;	// owner, the queue of the last access
+            uint32_t batch;	// batch of the last access
+        };
+
+        std::vector<State> states(m_Resources.size());
+        for (uint32_t i = 0; i < m_Resources.size(); ++i)
+        {
+            const auto& resource = m_Resources[i];
+            State& state = states[i];
+            state = { VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_NONE, VK_PIPELINE_STAGE_2_NONE, false, QueueType::Graphics, 0 };
+
+            if (resource.isImported)
+            {
+                // Unknown history, wait for anything that came before
+                state.writeStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                state.writeAccess = VK_ACCESS_2_MEMORY_WRITE_BIT;
+            }
+            else if (resource.aliasSlot != ~0u)
+            {
+                // Covers both the previous occupant of the memory and the same image in the previous frame
+                state.writeStage = m_AliasSlots[resource.aliasSlot].stages;
+                state.writeAccess = m_AliasSlots[resource.aliasSlot].writeAccess;
+            }
+        }
+
+        for (uint32_t i = 0; i < m_Resources.size(); ++i)
+        {
+            const auto& resource = m_Resources[i];
+            if (resource.firstUse == ~0u)
+                continue;
+
+            const QueueType firstQueue = m_Batches[resource.firstBatch].queue;
+            const QueueType lastQueue = m_Batches[resource.lastBatch].queue;
+
+            if (resource.name == BACKBUFFER && (resource.firstBatch != m_FinalBatch || resource.lastBatch != m_FinalBatch))
+            {
+                throw std::runtime_error("Backbuffer can only be used by the last graphics passes of the graph");
+            }
+
+            if (resource.isImported && firstQueue != lastQueue &&
+                m_pDevice->GetQueueFamily(firstQueue) != m_pDevice->GetQueueFamily(lastQueue))
+            {
+                throw std::runtime_error("Imported image " + resource.name + " has to be left on the queue family that first uses it");
+            }
+
+            if (resource.isImported && resource.finalLayout != VK_IMAGE_LAYOUT_UNDEFINED && lastQueue != QueueType::Graphics)
+            {
+                throw std::runtime_error("Imported image " + resource.name + " with a final layout has to be last used on the graphics queue");
+            }
+
+            // The next frame's first access must not overlap this frame's last access on the other queue
+            if (firstQueue != lastQueue && resource.firstBatch < resource.lastBatch)
+            {
+                auto& waits = m_Batches[resource.firstBatch].previousFrameWaitBatches;
+                if (std::find(waits.begin(), waits.end(), resource.lastBatch) == waits.end())
+                    waits.push_back(resource.lastBatch);
+            }
+        }
+
+        m_PassBarriers.assign(m_ExecutionOrder.size(), {});
+        for (uint32_t position = 0; position < m_ExecutionOrder.size(); ++position)
+        {
+            const QueueType queue = m_Passes[m_ExecutionOrder[position]].queue;
+            const uint32_t batch = m_PositionBatch[position];
+
+            for (const auto& access : m_Passes[m_ExecutionOrder[position]].accesses)
+            {
+                const auto& resource = m_Resources[access.resource];
+                State& state = states[access.resource];
+
+                if (state.touched && state.queue != queue)
+                {
+                    // The semaphore between the batches already carries the memory dependency, only ownership
+                    // and layout are left to handle
+                    auto& waits = m_Batches[batch].waitBatches;
+                    if (std::find(waits.begin(), waits.end(), state.batch) == waits.end())
+                        waits.push_back(state.batch);
+
+                    const uint32_t srcFamily = m_pDevice->GetQueueFamily(state.queue);
+                    const uint32_t dstFamily = m_pDevice->GetQueueFamily(queue);
+
+                    Barrier acquire{};
+                    acquire.resource = access.resource;
+                    acquire.srcStage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                    acquire.srcAccess = VK_ACCESS_2_NONE;
+                    acquire.dstStage = access.stage;
+                    acquire.dstAccess = access.access;
+                    acquire.oldLayout = state.layout;
+                    acquire.newLayout = access.layout;
+                    acquire.fromCurrentLayout = false;
+
+                    if (srcFamily != dstFamily)
+                    {
+                        Barrier release = acquire;
+                        release.srcStage = state.writeStage | state.readStages;
+                        release.srcAccess = state.writeAccess;
+                        RestrictToQueue(state.queue, release.srcStage, release.srcAccess);
+                        release.dstStage = VK_PIPELINE_STAGE_2_NONE;
+                        release.dstAccess = VK_ACCESS_2_NONE;
+                        release.srcQueueFamily = srcFamily;
+                        release.dstQueueFamily = dstFamily;
+                        m_Batches[state.batch].releaseBarriers.push_back(release);
+
+                        acquire.srcQueueFamily = srcFamily;
+                        acquire.dstQueueFamily = dstFamily;
+                        m_PassBarriers[position].push_back(acquire);
+                    }
+                    else if (state.layout != access.layout)
+                    {
+                        m_PassBarriers[position].push_back(acquire);
+                    }
+
+                    state.writeStage = access.stage;
+                    state.writeAccess = access.isWrite ? access.access & WRITE_ACCESS_MASK : VK_ACCESS_2_NONE;
+                    state.readStages = access.isWrite ? VK_PIPELINE_STAGE_2_NONE : access.stage;
+                    state.visibleStages = access.isWrite ? VK_PIPELINE_STAGE_2_NONE : access.stage;
+                    state.layout = access.layout;
+                    state.queue = queue;
+                    state.batch = batch;
+                    continue;
+                }
+
+                const bool fromCurrentLayout = resource.isImported && !state.touched;
+                const bool layoutChange = fromCurrentLayout || state.layout != access.layout;
+                const bool needsVisibility = state.writeStage != VK_PIPELINE_STAGE_2_NONE && (state.visibleStages & access.stage) != access.stage;
+
+                if (layoutChange || access.isWrite || needsVisibility)
+                {
+                    Barrier barrier{};
+                    barrier.resource = access.resource;
+                    barrier.srcStage = state.writeStage;
+                    if (layoutChange || access.isWrite)
+                        barrier.srcStage |= state.readStages;
+                    barrier.srcAccess = state.writeAccess;
+                    barrier.dstStage = access.stage;
+                    barrier.dstAccess = access.access;
+                    barrier.oldLayout = state.layout;
+                    barrier.newLayout = access.layout;
+                    barrier.fromCurrentLayout = fromCurrentLayout;
+                    RestrictToQueue(queue, barrier.srcStage, barrier.srcAccess);
+
+                    // Writes with nothing to wait for and no transition don't need a barrier at all
+                    if (layoutChange || barrier.srcStage != VK_PIPELINE_STAGE_2_NONE)
+                        m_PassBarriers[position].push_back(barrier);
+                }
+
+                if (access.isWrite)
+                {
+                    state.writeStage = access.stage;
+                    state.writeAccess = access.access & WRITE_ACCESS_MASK;
+                    state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                    state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+                }
+                else if (layoutChange)
+                {
+                    // The transition itself is a write that later readers in other stages must wait for
+                    state.writeStage = access.stage;
+                    state.writeAccess = VK_ACCESS_2_NONE;
+                    state.readStages = access.stage;
+                    state.visibleStages = access.stage;
+                }
+                else
+                {
+                    state.readStages |= access.stage;
+                    state.visibleStages |= access.stage;
+                }
+
+                state.layout = access.layout;
+                state.touched = true;
+                state.queue = queue;
+                state.batch = batch;
+            }
+        }
+
+        m_FinalBarriers.clear();
+        for (uint32_t i = 0; i < m_Resources.size(); ++i)
+        {
+            const auto& resource = m_Resources[i];
+            const State& state = states[i];
+            if (!resource.isImported || !state.touched ||
+                resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout)
+                continue;
+
+            Barrier barrier{};
+            barrier.resource = i;
+            barrier.srcStage = state.writeStage | state.readStages;
+            barrier.srcAccess = state.writeAccess;
+            barrier.dstStage = VK_PIPELINE_STAGE_2_NONE;
+            barrier.dstAccess = VK_ACCESS_2_NONE;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = resource.finalLayout;
+            barrier.fromCurrentLayout = false;
+            m_FinalBarriers.push_back(barrier);
+        }
+    }
+
+    void RenderGraph::Execute(VkCommandBuffer commandBuffer, uint32_t imageIndex, PassContext& passContext)
+    {
+        const auto& debugger = m_pDevice->GetDebugger();
+        passContext.pRenderGraph = this;
+
+        m_pFrame = passContext.pFrame;
+        if (m_pFrame == nullptr && m_Batches.size() > 1)
+        {
+            throw std::runtime_error("Render graph with multiple queue batches needs a FrameContext to record into");
+        }
+
+        for (uint32_t batchIndex = 0; batchIndex < m_Batches.size(); ++batchIndex)
+        {
+            Batch& batch = m_Batches[batchIndex];
+            if (batchIndex == m_FinalBatch)
+            {
+                batch.commandBuffer = commandBuffer;
+            }
+            else
+            {
+                batch.commandBuffer = m_pFrame->AcquireCommandBuffer(batch.queue);
+
+                VkCommandBufferBeginInfo beginInfo{};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                if (vkBeginCommandBuffer(batch.commandBuffer, &beginInfo) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to begin recording render graph batch!");
+                }
+                if (const DescriptorBuffer* pDescriptorBuffer = m_pDevice->GetDescriptorBuffer())
+                    pDescriptorBuffer->BindBuffer(batch.commandBuffer);
+            }
+
+            // Timestamp queries live on the graphics queue only
+            GpuProfiler* pGpuProfiler = batch.queue == QueueType::Graphics ? passContext.pGpuProfiler : nullptr;
+
+            for (uint32_t position = batch.firstPosition; position < batch.endPosition; ++position)
+            {
+                const PassNode& pass = m_Passes[m_ExecutionOrder[position]];
+
+                RUBY_PROFILE_SCOPE(pass.profileName);
+                RecordBarriers(batch.commandBuffer, m_PassBarriers[position]);
+
+                debugger.BeginLabel(batch.commandBuffer, pass.name, glm::vec4{ 0.4f, 0.7f, 1.0f, 1.0f });
+                if (pGpuProfiler)
+                    pGpuProfiler->BeginScope(batch.commandBuffer, pass.name);
+
+                pass.pPass->RecordCommandBuffer(batch.commandBuffer, imageIndex, passContext);
+
+                if (pGpuProfiler)
+                    pGpuProfiler->EndScope(batch.commandBuffer);
+                debugger.EndLabel(batch.commandBuffer);
+            }
+
+            RecordBarriers(batch.commandBuffer, batch.releaseBarriers);
+            if (batchIndex == m_FinalBatch)
+            {
+                RecordBarriers(batch.commandBuffer, m_FinalBarriers);
+                continue;
+            }
+
+            if (vkEndCommandBuffer(batch.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to record render graph batch!");
+            }
+
+            // Batches after the final one wait on it, they go out from OnFrameSubmitted
+            if (batchIndex < m_FinalBatch)
+                SubmitBatch(batchIndex);
+        }
+
+        m_FinalWaits.clear();
+        GatherWaits(m_FinalBatch, m_FinalWaits);
+        m_HasPendingSubmission = true;
+    }
+
+    void RenderGraph::OnFrameSubmitted(uint64_t frameValue)
+    {
+        if (!m_HasPendingSubmission)
+            return;
+
+        m_Batches[m_FinalBatch].submittedValue = frameValue;
+        for (uint32_t batchIndex = m_FinalBatch + 1; batchIndex < m_Batches.size(); ++batchIndex)
+            SubmitBatch(batchIndex);
+
+        m_FinalWaits.clear();
+        m_HasPendingSubmission = false;
+    }
+
+    void RenderGraph::GatherWaits(uint32_t batchIndex, std::vector<VkSemaphoreSubmitInfo>& outWaits) const
+    {
+        // Later values on a timeline imply the earlier ones, so one wait per queue is enough
+        uint64_t waitValues[2]{};
+        const Batch& batch = m_Batches[batchIndex];
+
+        for (uint32_t waitBatch : batch.waitBatches)
+        {
+            const Batch& other = m_Batches[waitBatch];
+            uint64_t& value = waitValues[static_cast<uint32_t>(other.queue)];
+            value = std::max(value, other.submittedValue);
+        }
+        for (uint32_t waitBatch : batch.previousFrameWaitBatches)
+        {
+            // Still zero on the first frame
+            const Batch& other = m_Batches[waitBatch];
+            uint64_t& value = waitValues[static_cast<uint32_t>(other.queue)];
+            value = std::max(value, other.submittedValue);
+        }
+
+        for (QueueType queue : { QueueType::Graphics, QueueType::Compute })
+        {
+            const uint64_t value = waitValues[static_cast<uint32_t>(queue)];
+            if (queue == batch.queue || value == 0)
+                continue;
+
+            outWaits.push_back(m_pDevice->GetTimeline(queue).GetSubmitInfo(value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+        }
+    }
+
+    void RenderGraph::SubmitBatch(uint32_t batchIndex)
+    {
+        RUBY_PROFILE_FUNCTION();
+        Batch& batch = m_Batches[batchIndex];
+
+        std::vector<VkSemaphoreSubmitInfo> waits;
+        GatherWaits(batchIndex, waits);
+
+        VkCommandBufferSubmitInfo commandBufferInfo{};
+        commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        commandBufferInfo.commandBuffer = batch.commandBuffer;
+
+        VkSubmitInfo2 submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.waitSemaphoreInfoCount = static_cast<uint32_t>(waits.size());
+        submitInfo.pWaitSemaphoreInfos = waits.data();
+        submitInfo.commandBufferInfoCount = 1;
+        submitInfo.pCommandBufferInfos = &commandBufferInfo;
+
+        uint64_t signalValue = 0;
+        if (m_pDevice->Submit(batch.queue, submitInfo, signalValue) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to submit render graph batch!");
+        }
+
+        batch.submittedValue = signalValue;
+        if (batch.queue == QueueType::Compute)
+            m_pFrame->SetComputeTimelineValue(signalValue);
+        else
+            m_pFrame->SetTimelineValue(signalValue);
+    }
+
+    void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers)
+    {
+        if (barriers.empty())
+            return;
+
+        std::vector<VkImageMemoryBarrier2> imageBarriers;
+        imageBarriers.reserve(barriers.size());
+
+        for (const auto& barrier : barriers)
+        {
+            const auto& resource = m_Resources[barrier.resource];
+            if (resource.pImage == nullptr)
+            {
+                throw std::runtime_error("Render graph image was never bound: " + resource.name);
+            }
+
+            Image& image = *resource.pImage;
+
+            VkImageMemoryBarrier2 imageBarrier{};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+            imageBarrier.srcStageMask = barrier.srcStage;
+            imageBarrier.srcAccessMask = barrier.srcAccess;
+            imageBarrier.dstStageMask = barrier.dstStage;
+            imageBarrier.dstAccessMask = barrier.dstAccess;
+            imageBarrier.oldLayout = barrier.fromCurrentLayout ? image.GetImageLayout() : barrier.oldLayout;
+            imageBarrier.newLayout = barrier.newLayout;
+            imageBarrier.srcQueueFamilyIndex = barrier.srcQueueFamily;
+            imageBarrier.dstQueueFamilyIndex = barrier.dstQueueFamily;
+            imageBarrier.image = image.GetImage();
+            imageBarrier.subresourceRange.aspectMask = image.GetAspectFlags();
+            imageBarrier.subresourceRange.baseMipLevel = 0;
+            imageBarrier.subresourceRange.levelCount = 1;
+            imageBarrier.subresourceRange.baseArrayLayer = 0;
+            imageBarrier.subresourceRange.layerCount = 1;
+            imageBarriers.push_back(imageBarrier);
+
+            image.SetImageLayout(barrier.newLayout);
+        }
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+    }
+
+    void RenderGraph::ReleaseTransients()
+    {
+        struct Retired
+        {
+            std::vector<std::unique_ptr<Image>> images;
+            std::vector<VmaAllocation> memory;
+        };
+        auto retired = std::make_shared<Retired>();
+
+        for (auto& resource : m_Resources)
+        {
+            if (resource.pTransientImage)
+            {
+                retired->images.push_back(std::move(resource.pTransientImage));
+                resource.pImage = nullptr;
+            }
+        }
+        for (auto& slot : m_AliasSlots)
+        {
+            if (slot.memory != nullptr)
+                retired->memory.push_back(slot.memory);
+        }
+        m_AliasSlots.clear();
+        m_TransientMemorySize = 0;
+        m_LazyMemorySize = 0;
+
+        if (retired->images.empty() && retired->memory.empty())
+            return;
+
+        // Frames in flight may still be using them
+        VmaAllocator allocator = m_pDevice->GetAllocator();
+        MemoryTracker* pMemoryTracker = &m_pDevice->GetMemoryTracker();
+        Defragmenter* pDefragmenter = &m_pDevice->GetDefragmenter();
+        m_pDevice->DeferDestroy([retired, allocator, pMemoryTracker, pDefragmenter]()
+        {
+            retired->images.clear();
+            for (VmaAllocation memory : retired->memory)
+            {
+                pMemoryTracker->Untrack(memory);
+                if (!pDefragmenter->ReleaseAllocation(memory, []() {}))
+                    vmaFreeMemory(allocator, memory);
+            }
+        });
+    }
+}
@@ -3,11 +3,17 @@
 #include <fstream>
 #include <stdexcept>
 
+#include "Vulkan/ShaderCache.h"
+
 
 RUBY::Shader::Shader(Device* pDevice, const std::string& filePath, VkShaderStageFlagBits stage)
-    : m_pDevice(pDevice), m_Stage(stage)
+    : Shader(pDevice->GetShaderCache().Load(filePath), stage)
+{
+}
+
+RUBY::Shader::Shader(std::shared_ptr<const ShaderModule> pModule, VkShaderStageFlagBits stage)
+    : m_ShaderModule(pModule->GetShaderModule()), m_Stage(stage), m_pModule(std::move(pModule))
 {
-    m_ShaderModule = CreateShaderModule(pDevice->GetLogicalDevice(), ReadFile(filePath));
 }
 
 
@@ -15,6 +21,7 @@ RUBY::Shader::Shader(Shader&& other) noexcept
 {
     m_pDevice = other.m_pDevice;
     m_Stage = other.m_Stage;
+    m_pModule = std::move(other.m_pModule);
 
     m_ShaderModule = other.m_ShaderModule;
     other.m_ShaderModule = VK_NULL_HANDLE;
@@ -23,8 +30,15 @@ RUBY::Shader::Shader(Shader&& other) noexcept
 
 RUBY::Shader& RUBY::Shader::operator=(Shader&& other) noexcept
 {
+    if (this == &other)
+        return *this;
+
+    if (m_ShaderModule != VK_NULL_HANDLE && m_pDevice != nullptr && !m_pModule)
+        vkDestroyShaderModule(m_pDevice->GetLogicalDevice(), m_ShaderModule, nullptr);
+
     m_pDevice = other.m_pDevice;
     m_Stage = other.m_Stage;
+    m_pModule = std::move(other.m_pModule);
 
     m_ShaderModule = other.m_ShaderModule;
     other.m_ShaderModule = VK_NULL_HANDLE;
@@ -35,12 +49,16 @@ RUBY::Shader& RUBY::Shader::operator=(Shader&& other) noexcept
 
 RUBY::Shader::~Shader()
 {
-    if (m_ShaderModule != VK_NULL_HANDLE && m_pDevice != nullptr)
+    // Shared modules are owned by the ShaderCache entry
+    if (m_ShaderModule != VK_NULL_HANDLE && m_pDevice != nullptr && !m_pModule)
 		vkDestroyShaderModule(m_pDevice->GetLogicalDevice(), m_ShaderModule, nullptr);
 }
 
 VkPipelineShaderStageCreateInfo RUBY::Shader::GetStageCreateInfo() const
 {
+    if (m_pModule)
+        return m_pModule->GetStageCreateInfo(m_Stage);
+
     VkPipelineShaderStageCreateInfo stageInfo{};
     stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     stageInfo.stage = m_Stage;
@@ -49,6 +67,21 @@ VkPipelineShaderStageCreateInfo RUBY::Shader::GetStageCreateInfo() const
     return stageInfo;
 }
 
+uint64_t RUBY::Shader::GetCodeHash() const
+{
+    return m_pModule ? m_pModule->GetHash() : 0;
+}
+
+RUBY::ShaderReflection RUBY::Shader::GetReflection() const
+{
+    if (!m_pModule)
+        throw std::runtime_error("Shader has no reflection data, it was not loaded through the ShaderCache");
+
+    ShaderReflection reflection = m_pModule->GetReflection();
+    reflection.SetStages(m_Stage);
+    return reflection;
+}
+
 VkShaderModule RUBY::Shader::CreateShaderModule(const VkDevice& logicalDevice, const std::vector<char>& code)
 {
     VkShaderModuleCreateInfo createInfo{};
@@ -0,0 +1,198 @@
+#include "Vulkan/ShaderCache.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Core/CpuProfiler.h"
+#include "Vulkan/Device.h"
+
+namespace
+{
+	constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+}
+
+// ---------------- MappedFile ---------------- //
+
+RUBY::MappedFile::MappedFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Failed to open file: " + path.string());
+
+	LARGE_INTEGER size{};
+	GetFileSizeEx(file, &size);
+	m_Size = static_cast<size_t>(size.QuadPart);
+
+	HANDLE mapping = m_Size > 0 ? CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	CloseHandle(file);
+	if (mapping == nullptr)
+		throw std::runtime_error("Failed to map file: " + path.string());
+
+	// The view keeps the mapping alive
+	m_pData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (m_pData == nullptr)
+		throw std::runtime_error("Failed to map file: " + path.string());
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		throw std::runtime_error("Failed to open file: " + path.string());
+
+	struct stat fileStat{};
+	fstat(file, &fileStat);
+	m_Size = static_cast<size_t>(fileStat.st_size);
+
+	void* pData = m_Size > 0 ? mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	close(file);
+	if (pData == MAP_FAILED)
+		throw std::runtime_error("Failed to map file: " + path.string());
+	m_pData = pData;
+#endif
+}
+
+RUBY::MappedFile::~MappedFile()
+{
+	if (m_pData == nullptr)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_pData);
+#else
+	munmap(m_pData, m_Size);
+#endif
+}
+
+// ---------------- ShaderModule ---------------- //
+
+RUBY::ShaderModule::ShaderModule(Device* pDevice, uint64_t hash, std::vector<uint32_t> code, bool skipModuleCreation)
+	: m_pDevice(pDevice), m_Hash(hash), m_Reflection(ShaderReflection::Reflect(code.data(), code.size() * sizeof(uint32_t)))
+	, m_Code(std::move(code))
+{
+	m_CreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	m_CreateInfo.codeSize = m_Code.size() * sizeof(uint32_t);
+	m_CreateInfo.pCode = m_Code.data();
+
+	if (!skipModuleCreation)
+	{
+		if (vkCreateShaderModule(pDevice->GetLogicalDevice(), &m_CreateInfo, nullptr, &m_ShaderModule) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create shader module!");
+		}
+	}
+}
+
+bool RUBY::ShaderModule::HasCode(const uint32_t* pCode, size_t codeSize) const
+{
+	return codeSize == m_Code.size() * sizeof(uint32_t) && std::memcmp(pCode, m_Code.data(), codeSize) == 0;
+}
+
+RUBY::ShaderModule::~ShaderModule()
+{
+	if (m_ShaderModule != VK_NULL_HANDLE)
+		vkDestroyShaderModule(m_pDevice->GetLogicalDevice(), m_ShaderModule, nullptr);
+}
+
+VkPipelineShaderStageCreateInfo RUBY::ShaderModule::GetStageCreateInfo(VkShaderStageFlagBits stage, const char* pEntryPoint) const
+{
+	VkPipelineShaderStageCreateInfo stageInfo{};
+	stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stageInfo.stage = stage;
+	stageInfo.module = m_ShaderModule;
+	stageInfo.pName = pEntryPoint;
+	if (m_ShaderModule == VK_NULL_HANDLE)
+		stageInfo.pNext = &m_CreateInfo;
+	return stageInfo;
+}
+
+// ---------------- ShaderCache ---------------- //
+
+RUBY::ShaderCache::ShaderCache(Device* pDevice)
+	: m_pDevice(pDevice)
+	, m_SkipModuleCreation(pDevice->IsExtensionEnabled(VK_KHR_MAINTENANCE_5_EXTENSION_NAME))
+{
+}
+
+uint64_t RUBY::ShaderCache::HashCode(const uint32_t* pCode, size_t codeSize)
+{
+	// FNV-1a over words, SPIR-V is always a multiple of 4 bytes
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < codeSize / sizeof(uint32_t); ++i)
+	{
+		hash ^= pCode[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::shared_ptr<const RUBY::ShaderModule> RUBY::ShaderCache::Load(const std::filesystem::path& path)
+{
+	RUBY_PROFILE_FUNCTION();
+	std::error_code error;
+	const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, error);
+	if (error)
+		throw std::runtime_error("Failed to open shader file: " + path.string());
+
+	std::lock_guard lock{ m_Mutex };
+
+	FileEntry& entry = m_Files[path.native()];
+	if (entry.writeTime == writeTime)
+	{
+		if (std::shared_ptr<const ShaderModule> pExisting = entry.pModule.lock())
+			return pExisting;
+	}
+
+	auto pMappedFile = std::make_unique<MappedFile>(path);
+	const auto* pCode = static_cast<const uint32_t*>(pMappedFile->GetData());
+	const size_t codeSize = pMappedFile->GetSize();
+	if (codeSize < sizeof(uint32_t) || codeSize % sizeof(uint32_t) != 0 || pCode[0] != SPIRV_MAGIC)
+		throw std::runtime_error("Not a SPIR-V file: " + path.string());
+
+	// Released on return, the module keeps a copy so the file can be rewritten in place
+	std::shared_ptr<const ShaderModule> pModule = GetOrCreateLocked(pCode, codeSize);
+	entry = { writeTime, pModule };
+	return pModule;
+}
+
+std::shared_ptr<const RUBY::ShaderModule> RUBY::ShaderCache::Get(const uint32_t* pCode, size_t codeSize)
+{
+	if (codeSize < sizeof(uint32_t) || codeSize % sizeof(uint32_t) != 0 || pCode[0] != SPIRV_MAGIC)
+		throw std::runtime_error("Invalid SPIR-V code");
+
+	std::lock_guard lock{ m_Mutex };
+	return GetOrCreateLocked(pCode, codeSize);
+}
+
+std::shared_ptr<const RUBY::ShaderModule> RUBY::ShaderCache::GetOrCreateLocked(const uint32_t* pCode, size_t codeSize)
+{
+	// Probe past live modules whose content only shares the hash, PipelineRegistry keys on GetHash()
+	uint64_t hash = HashCode(pCode, codeSize);
+	std::weak_ptr<const ShaderModule>* pSlot = &m_Modules[{ hash, codeSize }];
+	while (std::shared_ptr<const ShaderModule> pExisting = pSlot->lock())
+	{
+		if (pExisting->HasCode(pCode, codeSize))
+			return pExisting;
+		pSlot = &m_Modules[{ ++hash, codeSize }];
+	}
+
+	std::shared_ptr<const ShaderModule> pModule{ new ShaderModule(m_pDevice, hash,
+		std::vector<uint32_t>(pCode, pCode + codeSize / sizeof(uint32_t)), m_SkipModuleCreation) };
+	*pSlot = pModule;
+
+	std::erase_if(m_Modules, [](const auto& entry) { return entry.second.expired(); });
+	return pModule;
+}
@@ -0,0 +1,597 @@
+#include "Vulkan/ShaderReflection.h"
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+	// Subset of the SPIR-V unified specification this parser understands
+	namespace spv
+	{
+		constexpr uint32_t MAGIC = 0x07230203;
+		constexpr size_t HEADER_WORDS = 5;
+
+		enum Op : uint32_t
+		{
+			OpEntryPoint = 15,
+			OpTypeBool = 20,
+			OpTypeInt = 21,
+			OpTypeFloat = 22,
+			OpTypeVector = 23,
+			OpTypeMatrix = 24,
+			OpTypeImage = 25,
+			OpTypeSampler = 26,
+			OpTypeSampledImage = 27,
+			OpTypeArray = 28,
+			OpTypeRuntimeArray = 29,
+			OpTypeStruct = 30,
+			OpTypePointer = 32,
+			OpConstant = 43,
+			OpSpecConstant = 50,
+			OpSpecConstantOp = 52,
+			OpVariable = 59,
+			OpDecorate = 71,
+			OpMemberDecorate = 72,
+			OpTypeAccelerationStructureKHR = 5341,
+		};
+
+		enum Decoration : uint32_t
+		{
+			Block = 2,
+			BufferBlock = 3,
+			RowMajor = 4,
+			ArrayStride = 6,
+			MatrixStride = 7,
+			Binding = 33,
+			DescriptorSet = 34,
+			Offset = 35,
+		};
+
+		enum StorageClass : uint32_t
+		{
+			UniformConstant = 0,
+			Uniform = 2,
+			PushConstant = 9,
+			StorageBuffer = 12,
+		};
+
+		// Integer operations OpSpecConstantOp may fold
+		enum SpecOp : uint32_t
+		{
+			OpUConvert = 113,
+			OpSConvert = 114,
+			OpIAdd = 128,
+			OpISub = 130,
+			OpIMul = 132,
+			OpUDiv = 134,
+			OpSDiv = 135,
+			OpUMod = 137,
+			OpShiftRightLogical = 194,
+			OpShiftLeftLogical = 196,
+			OpBitwiseOr = 197,
+			OpBitwiseXor = 198,
+			OpBitwiseAnd = 199,
+		};
+
+		enum Dim : uint32_t
+		{
+			DimBuffer = 5,
+			DimSubpassData = 6,
+		};
+	}
+
+	VkShaderStageFlags ExecutionModelToStage(uint32_t executionModel)
+	{
+		switch (executionModel)
+		{
+		case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+		case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+		case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+		case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+		case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+		case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+		case 5313: return VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+		case 5314: return VK_SHADER_STAGE_INTERSECTION_BIT_KHR;
+		case 5315: return VK_SHADER_STAGE_ANY_HIT_BIT_KHR;
+		case 5316: return VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+		case 5317: return VK_SHADER_STAGE_MISS_BIT_KHR;
+		case 5318: return VK_SHADER_STAGE_CALLABLE_BIT_KHR;
+		case 5364: return VK_SHADER_STAGE_TASK_BIT_EXT;
+		case 5365: return VK_SHADER_STAGE_MESH_BIT_EXT;
+		default: return 0;
+		}
+	}
+
+	struct PushConstantSpan
+	{
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	class SpirvParser
+	{
+	public:
+		SpirvParser(const uint32_t* pCode, size_t wordCount)
+			: m_pCode(pCode), m_WordCount(wordCount)
+		{
+		}
+
+		RUBY::ShaderReflection Parse()
+		{
+			for (size_t offset = spv::HEADER_WORDS; offset < m_WordCount;)
+			{
+				const uint32_t wordCount = m_pCode[offset] >> 16;
+				const uint32_t opcode = m_pCode[offset] & 0xFFFF;
+				if (wordCount == 0 || offset + wordCount > m_WordCount)
+					throw std::runtime_error("Malformed SPIR-V instruction at word " + std::to_string(offset));
+
+				ParseInstruction(opcode, &m_pCode[offset + 1], wordCount - 1);
+				offset += wordCount;
+			}
+
+			RUBY::ShaderReflection reflection{};
+			reflection.stages = m_Stages;
+
+			for (const auto& [variableId, variable] : m_Variables)
+			{
+				if (variable.storageClass == spv::PushConstant)
+				{
+					// VkPushConstantRange offsets and sizes are multiples of 4, blocks may end in smaller members
+					PushConstantSpan span = GetStructSpan(PointeeType(variable.typeId));
+					span.begin &= ~3u;
+					span.end = (span.end + 3) & ~3u;
+					if (span.end > span.begin)
+						reflection.pushConstants.push_back({ m_Stages, span.begin, span.end - span.begin });
+					continue;
+				}
+
+				if (variable.storageClass != spv::UniformConstant && variable.storageClass != spv::Uniform &&
+					variable.storageClass != spv::StorageBuffer)
+					continue;
+
+				const auto decorations = m_Decorations.find(variableId);
+				if (decorations == m_Decorations.end() || !decorations->second.hasBinding)
+					continue;
+
+				RUBY::ShaderReflection::Binding binding{};
+				binding.set = decorations->second.set;
+				binding.binding = decorations->second.binding;
+				binding.stages = m_Stages;
+
+				uint32_t typeId = PointeeType(variable.typeId);
+				const Instruction* pType = GetInstruction(typeId);
+				if (pType->opcode == spv::OpTypeArray)
+				{
+					binding.count = GetConstant(pType->pOperands[2]);
+					typeId = pType->pOperands[1];
+				}
+				else if (pType->opcode == spv::OpTypeRuntimeArray)
+				{
+					binding.count = 0;
+					typeId = pType->pOperands[1];
+				}
+
+				binding.type = GetDescriptorType(typeId, variable.storageClass);
+				if (binding.type != VK_DESCRIPTOR_TYPE_MAX_ENUM)
+					reflection.bindings.push_back(binding);
+			}
+
+			std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const auto& a, const auto& b)
+			{
+				return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+			});
+			return reflection;
+		}
+
+	private:
+		struct Instruction
+		{
+			uint32_t opcode;
+			// Operands after the opcode word, including the result type and id where present
+			const uint32_t* pOperands;
+			uint32_t operandCount;
+		};
+
+		struct Decorations
+		{
+			bool hasBinding{ false };
+			uint32_t binding{ 0 };
+			uint32_t set{ 0 };
+			bool block{ false };
+			bool bufferBlock{ false };
+			uint32_t arrayStride{ 0 };
+		};
+
+		struct MemberDecorations
+		{
+			uint32_t offset{ 0 };
+			uint32_t matrixStride{ 0 };
+			bool rowMajor{ false };
+		};
+
+		struct Variable
+		{
+			uint32_t typeId;
+			uint32_t storageClass;
+		};
+
+		void ParseInstruction(uint32_t opcode, const uint32_t* pOperands, uint32_t operandCount)
+		{
+			switch (opcode)
+			{
+			case spv::OpEntryPoint:
+				if (operandCount >= 2)
+					m_Stages |= ExecutionModelToStage(pOperands[0]);
+				break;
+			case spv::OpDecorate:
+				if (operandCount >= 2)
+					ParseDecoration(m_Decorations[pOperands[0]], pOperands[1], operandCount >= 3 ? pOperands[2] : 0);
+				break;
+			case spv::OpMemberDecorate:
+				if (operandCount >= 3)
+				{
+					MemberDecorations& member = m_MemberDecorations[{ pOperands[0], pOperands[1] }];
+					const uint32_t literal = operandCount >= 4 ? pOperands[3] : 0;
+					if (pOperands[2] == spv::Offset)
+						member.offset = literal;
+					else if (pOperands[2] == spv::MatrixStride)
+						member.matrixStride = literal;
+					else if (pOperands[2] == spv::RowMajor)
+						member.rowMajor = true;
+				}
+				break;
+			case spv::OpTypeBool:
+			case spv::OpTypeInt:
+			case spv::OpTypeFloat:
+			case spv::OpTypeVector:
+			case spv::OpTypeMatrix:
+			case spv::OpTypeImage:
+			case spv::OpTypeSampler:
+			case spv::OpTypeSampledImage:
+			case spv::OpTypeArray:
+			case spv::OpTypeRuntimeArray:
+			case spv::OpTypeStruct:
+			case spv::OpTypePointer:
+			case spv::OpTypeAccelerationStructureKHR:
+				if (operandCount >= 1)
+					m_Instructions[pOperands[0]] = { opcode, pOperands, operandCount };
+				break;
+			case spv::OpConstant:
+			case spv::OpSpecConstant:
+			case spv::OpSpecConstantOp:
+				if (operandCount >= 3)
+					m_Instructions[pOperands[1]] = { opcode, pOperands, operandCount };
+				break;
+			case spv::OpVariable:
+				if (operandCount >= 3)
+					m_Variables[pOperands[1]] = { pOperands[0], pOperands[2] };
+				break;
+			default:
+				break;
+			}
+		}
+
+		static void ParseDecoration(Decorations& decorations, uint32_t decoration, uint32_t literal)
+		{
+			switch (decoration)
+			{
+			case spv::Binding: decorations.hasBinding = true; decorations.binding = literal; break;
+			case spv::DescriptorSet: decorations.set = literal; break;
+			case spv::Block: decorations.block = true; break;
+			case spv::BufferBlock: decorations.bufferBlock = true; break;
+			case spv::ArrayStride: decorations.arrayStride = literal; break;
+			default: break;
+			}
+		}
+
+		const Instruction* GetInstruction(uint32_t id) const
+		{
+			const auto it = m_Instructions.find(id);
+			if (it == m_Instructions.end())
+				throw std::runtime_error("SPIR-V references undeclared type or constant %" + std::to_string(id));
+			return &it->second;
+		}
+
+		uint32_t PointeeType(uint32_t pointerTypeId) const
+		{
+			const Instruction* pPointer = GetInstruction(pointerTypeId);
+			if (pPointer->opcode != spv::OpTypePointer || pPointer->operandCount < 3)
+				throw std::runtime_error("SPIR-V variable is not of pointer type");
+			return pPointer->pOperands[2];
+		}
+
+		// Array lengths, spec constants report their default. OpSpecConstantOp is folded over the defaults,
+		// operations the folder doesn't know count as 1 so reflection never fails on valid SPIR-V.
+		uint32_t GetConstant(uint32_t id) const
+		{
+			const Instruction* pConstant = GetInstruction(id);
+			if (pConstant->opcode != spv::OpSpecConstantOp)
+				return pConstant->pOperands[2];
+
+			const uint32_t* pArgs = pConstant->pOperands + 3;
+			const uint32_t argCount = pConstant->operandCount - 3;
+			const auto arg = [this, pArgs, argCount](uint32_t index)
+			{
+				// Booleans, composites and the like aren't tracked, they fold to 1 as well
+				return index < argCount && m_Instructions.count(pArgs[index]) != 0 ? GetConstant(pArgs[index]) : 1u;
+			};
+			switch (pConstant->pOperands[2])
+			{
+			case spv::OpUConvert:
+			case spv::OpSConvert: return arg(0);
+			case spv::OpIAdd: return arg(0) + arg(1);
+			case spv::OpISub: return arg(0) - arg(1);
+			case spv::OpIMul: return arg(0) * arg(1);
+			case spv::OpUDiv: return arg(1) != 0 ? arg(0) / arg(1) : 1;
+			case spv::OpSDiv: return arg(1) != 0 ? static_cast<uint32_t>(static_cast<int32_t>(arg(0)) / static_cast<int32_t>(arg(1))) : 1;
+			case spv::OpUMod: return arg(1) != 0 ? arg(0) % arg(1) : 1;
+			case spv::OpShiftRightLogical: return arg(0) >> (arg(1) & 31);
+			case spv::OpShiftLeftLogical: return arg(0) << (arg(1) & 31);
+			case spv::OpBitwiseOr: return arg(0) | arg(1);
+			case spv::OpBitwiseXor: return arg(0) ^ arg(1);
+			case spv::OpBitwiseAnd: return arg(0) & arg(1);
+			default: return 1;
+			}
+		}
+
+		VkDescriptorType GetDescriptorType(uint32_t typeId, uint32_t storageClass) const
+		{
+			const Instruction* pType = GetInstruction(typeId);
+			switch (pType->opcode)
+			{
+			case spv::OpTypeSampler:
+				return VK_DESCRIPTOR_TYPE_SAMPLER;
+			case spv::OpTypeSampledImage:
+				return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			case spv::OpTypeAccelerationStructureKHR:
+				return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+			case spv::OpTypeImage:
+			{
+				const uint32_t dim = pType->pOperands[2];
+				const uint32_t sampled = pType->pOperands[6];
+				if (dim == spv::DimSubpassData)
+					return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				if (dim == spv::DimBuffer)
+					return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			}
+			case spv::OpTypeStruct:
+			{
+				if (storageClass == spv::StorageBuffer)
+					return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				const auto decorations = m_Decorations.find(typeId);
+				const bool bufferBlock = decorations != m_Decorations.end() && decorations->second.bufferBlock;
+				return bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			}
+			default:
+				return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+			}
+		}
+
+		// Bytes of the block actually covered by members, push constant ranges start at the first one
+		PushConstantSpan GetStructSpan(uint32_t structId) const
+		{
+			const Instruction* pStruct = GetInstruction(structId);
+			if (pStruct->opcode != spv::OpTypeStruct)
+				throw std::runtime_error("SPIR-V push constant block is not a struct");
+
+			PushConstantSpan span{ UINT32_MAX, 0 };
+			for (uint32_t member = 0; member + 1 < pStruct->operandCount; ++member)
+			{
+				MemberDecorations decorations{};
+				if (const auto it = m_MemberDecorations.find({ structId, member }); it != m_MemberDecorations.end())
+					decorations = it->second;
+
+				const uint32_t size = GetTypeSize(pStruct->pOperands[member + 1], decorations);
+				span.begin = std::min(span.begin, decorations.offset);
+				span.end = std::max(span.end, decorations.offset + size);
+			}
+			if (span.begin > span.end)
+				span.begin = span.end;
+			return span;
+		}
+
+		uint32_t GetTypeSize(uint32_t typeId, const MemberDecorations& member) const
+		{
+			const Instruction* pType = GetInstruction(typeId);
+			switch (pType->opcode)
+			{
+			case spv::OpTypeBool:
+				return 4;
+			case spv::OpTypeInt:
+			case spv::OpTypeFloat:
+				return pType->pOperands[1] / 8;
+			case spv::OpTypeVector:
+				return GetTypeSize(pType->pOperands[1], {}) * pType->pOperands[2];
+			case spv::OpTypeMatrix:
+			{
+				const uint32_t columns = pType->pOperands[2];
+				const Instruction* pColumn = GetInstruction(pType->pOperands[1]);
+				const uint32_t rows = pColumn->pOperands[2];
+				if (member.matrixStride == 0)
+					return GetTypeSize(pType->pOperands[1], {}) * columns;
+				return member.matrixStride * (member.rowMajor ? rows : columns);
+			}
+			case spv::OpTypeArray:
+			{
+				const uint32_t length = GetConstant(pType->pOperands[2]);
+				const auto decorations = m_Decorations.find(typeId);
+				const uint32_t stride = decorations != m_Decorations.end() && decorations->second.arrayStride != 0
+					? decorations->second.arrayStride
+					: GetTypeSize(pType->pOperands[1], member);
+				return stride * length;
+			}
+			case spv::OpTypeStruct:
+				return GetStructSpan(typeId).end;
+			case spv::OpTypePointer:
+				// Only PhysicalStorageBuffer pointers (buffer_reference) can be block members, always 64-bit
+				return 8;
+			default:
+				// Runtime arrays and opaque types take no space in a block
+				return 0;
+			}
+		}
+
+		struct PairHash
+		{
+			size_t operator()(const std::pair<uint32_t, uint32_t>& key) const
+			{
+				return std::hash<uint64_t>{}((static_cast<uint64_t>(key.first) << 32) | key.second);
+			}
+		};
+
+		const uint32_t* m_pCode;
+		size_t m_WordCount;
+
+		VkShaderStageFlags m_Stages{ 0 };
+		std::unordered_map<uint32_t, Instruction> m_Instructions;
+		std::unordered_map<uint32_t, Decorations> m_Decorations;
+		std::unordered_map<std::pair<uint32_t, uint32_t>, MemberDecorations, PairHash> m_MemberDecorations;
+		// Ordered so reflection output doesn't depend on hashing
+		std::map<uint32_t, Variable> m_Variables;
+	};
+
+	// Stage bit -> byte span, the form push constants are merged in
+	std::map<VkShaderStageFlags, PushConstantSpan> SplitByStage(const std::vector<VkPushConstantRange>& ranges)
+	{
+		std::map<VkShaderStageFlags, PushConstantSpan> spans;
+		for (const VkPushConstantRange& range : ranges)
+		{
+			for (VkShaderStageFlags bit = 1; bit != 0 && bit <= range.stageFlags; bit <<= 1)
+			{
+				if (!(range.stageFlags & bit))
+					continue;
+				auto [it, inserted] = spans.try_emplace(bit, PushConstantSpan{ range.offset, range.offset + range.size });
+				if (!inserted)
+				{
+					it->second.begin = std::min(it->second.begin, range.offset);
+					it->second.end = std::max(it->second.end, range.offset + range.size);
+				}
+			}
+		}
+		return spans;
+	}
+
+	std::vector<VkPushConstantRange> GroupByStage(const std::map<VkShaderStageFlags, PushConstantSpan>& spans)
+	{
+		std::vector<VkPushConstantRange> ranges;
+		for (const auto& [stage, span] : spans)
+		{
+			auto it = std::find_if(ranges.begin(), ranges.end(), [&span](const VkPushConstantRange& range)
+			{
+				return range.offset == span.begin && range.size == span.end - span.begin;
+			});
+			if (it != ranges.end())
+				it->stageFlags |= stage;
+			else
+				ranges.push_back({ stage, span.begin, span.end - span.begin });
+		}
+		return ranges;
+	}
+}
+
+RUBY::ShaderReflection RUBY::ShaderReflection::Reflect(const uint32_t* pCode, size_t codeSize)
+{
+	const size_t wordCount = codeSize / sizeof(uint32_t);
+	if (pCode == nullptr || wordCount < spv::HEADER_WORDS || pCode[0] != spv::MAGIC)
+		throw std::runtime_error("Invalid SPIR-V code");
+
+	ShaderReflection reflection = SpirvParser{ pCode, wordCount }.Parse();
+	// A module with several entry points shares its push constant block, group it per stage like merged ones
+	reflection.pushConstants = GroupByStage(SplitByStage(reflection.pushConstants));
+	return reflection;
+}
+
+void RUBY::ShaderReflection::Merge(const ShaderReflection& other)
+{
+	stages |= other.stages;
+	if (other.pushDescriptorSet != NO_PUSH_DESCRIPTOR_SET)
+		pushDescriptorSet = other.pushDescriptorSet;
+
+	for (const Binding& otherBinding : other.bindings)
+	{
+		auto it = std::find_if(bindings.begin(), bindings.end(), [&otherBinding](const Binding& binding)
+		{
+			return binding.set == otherBinding.set && binding.binding == otherBinding.binding;
+		});
+		if (it == bindings.end())
+		{
+			bindings.push_back(otherBinding);
+			continue;
+		}
+
+		if (it->type != otherBinding.type)
+		{
+			throw std::runtime_error("Descriptor set " + std::to_string(otherBinding.set) + " binding " +
+				std::to_string(otherBinding.binding) + " is declared with different types across stages");
+		}
+		it->stages |= otherBinding.stages;
+		// Runtime sized in either stage stays runtime sized
+		it->count = (it->count == 0 || otherBinding.count == 0) ? 0 : std::max(it->count, otherBinding.count);
+	}
+
+	std::sort(bindings.begin(), bindings.end(), [](const Binding& a, const Binding& b)
+	{
+		return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+	});
+
+	std::vector<VkPushConstantRange> allRanges = pushConstants;
+	allRanges.insert(allRanges.end(), other.pushConstants.begin(), other.pushConstants.end());
+	pushConstants = GroupByStage(SplitByStage(allRanges));
+}
+
+void RUBY::ShaderReflection::SetStages(VkShaderStageFlags newStages)
+{
+	stages = newStages;
+	for (Binding& binding : bindings)
+		binding.stages = newStages;
+
+	if (pushConstants.empty())
+		return;
+
+	uint32_t begin = UINT32_MAX;
+	uint32_t end = 0;
+	for (const VkPushConstantRange& range : pushConstants)
+	{
+		begin = std::min(begin, range.offset);
+		end = std::max(end, range.offset + range.size);
+	}
+	pushConstants = { VkPushConstantRange{ newStages, begin, end - begin } };
+}
+
+std::vector<std::vector<VkDescriptorSetLayoutBinding>> RUBY::ShaderReflection::GetSetLayoutBindings() const
+{
+	std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+	for (const Binding& binding : bindings)
+	{
+		if (binding.set >= sets.size())
+			sets.resize(binding.set + 1);
+		sets[binding.set].push_back({ binding.binding, binding.type, binding.count, binding.stages, nullptr });
+	}
+	return sets;
+}
+
+std::vector<VkDescriptorPoolSize> RUBY::ShaderReflection::GetPoolSizes(uint32_t maxSets) const
+{
+	// Per type, the most any single set needs, times the number of sets the pool hands out
+	std::map<VkDescriptorType, uint32_t> perType;
+	std::map<std::pair<uint32_t, VkDescriptorType>, uint32_t> perSetAndType;
+	for (const Binding& binding : bindings)
+	{
+		if (binding.set == pushDescriptorSet)
+			continue;
+		const uint32_t count = perSetAndType[{ binding.set, binding.type }] += binding.count;
+		perType[binding.type] = std::max(perType[binding.type], count);
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const auto& [type, count] : perType)
+	{
+		if (count > 0)
+			poolSizes.push_back({ type, count * maxSets });
+	}
+	return poolSizes;
+}
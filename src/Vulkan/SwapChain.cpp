@@ -107,6 +107,12 @@ namespace RUBY
 
     void SwapChain::CreateSwapChain()
     {
+        if (!m_pDevice->HasSurface())
+        {
+            CreateOffscreenImages();
+            return;
+        }
+
         // Query support
         QuerySwapChainSupport();
 
@@ -184,50 +190,33 @@ namespace RUBY
 
         m_SwapChainImageFormat = surfaceFormat.format;
         m_SwapChainExtent = extent;
-
-        // recreate sync objects (destroy old then create new)
-        CleanupSyncObjects();
-        CreateSyncObjects();
     }
 
-    void SwapChain::CreateSyncObjects()
+    void SwapChain::CreateOffscreenImages()
     {
-        m_ImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        m_RenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-        m_InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+        m_IsOffscreen = true;
+        m_OffscreenImageIndex = OFFSCREEN_IMAGE_COUNT - 1;
 
-        VkSemaphoreCreateInfo semaphoreInfo{};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        int width, height;
+        m_pWindow->GetFramebufferSize(&width, &height);
 
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // start signaled so first frame doesn't wait
-
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-        {
-            if (vkCreateSemaphore(m_pDevice->GetLogicalDevice(), &semaphoreInfo, nullptr, &m_ImageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(m_pDevice->GetLogicalDevice(), &semaphoreInfo, nullptr, &m_RenderFinishedSemaphores[i]) != VK_SUCCESS ||
-                vkCreateFence(m_pDevice->GetLogicalDevice(), &fenceInfo, nullptr, &m_InFlightFences[i]) != VK_SUCCESS)
-            {
-                throw std::runtime_error("Failed to create synchronization objects for a frame!");
-            }
-        }
-    }
+        // Same format the presentable path picks, so passes don't need to care which one they render into
+        m_SwapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+        m_SwapChainExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 
-    void SwapChain::CleanupSyncObjects()
-    {
-        for (size_t i = 0; i < m_ImageAvailableSemaphores.size(); ++i)
+        m_SwapChainImages.clear();
+        m_SwapChainImages.reserve(OFFSCREEN_IMAGE_COUNT);
+        for (uint32_t i = 0; i < OFFSCREEN_IMAGE_COUNT; ++i)
         {
-            if (m_ImageAvailableSemaphores[i] != VK_NULL_HANDLE)
-                vkDestroySemaphore(m_pDevice->GetLogicalDevice(), m_ImageAvailableSemaphores[i], nullptr);
-            if (m_RenderFinishedSemaphores[i] != VK_NULL_HANDLE)
-                vkDestroySemaphore(m_pDevice->GetLogicalDevice(), m_RenderFinishedSemaphores[i], nullptr);
-            if (m_InFlightFences[i] != VK_NULL_HANDLE)
-                vkDestroyFence(m_pDevice->GetLogicalDevice(), m_InFlightFences[i], nullptr);
+            m_SwapChainImages.emplace_back(Image{ m_pDevice, m_pCommandPool,
+                m_SwapChainExtent.width, m_SwapChainExtent.height,
+                m_SwapChainImageFormat,
+                VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT });
+            m_SwapChainImages.back().SetName("Offscreen SwapChain Image");
         }
-        m_ImageAvailableSemaphores.clear();
-        m_RenderFinishedSemaphores.clear();
-        m_InFlightFences.clear();
     }
 
     void SwapChain::CleanupSwapChainInternal()
@@ -235,9 +224,6 @@ namespace RUBY
         // Destroy images (their destructors will free VMA/Views if owned)
         m_SwapChainImages.clear();
 
-        // Sync objects
-        CleanupSyncObjects();
-
         if (m_SwapChain != VK_NULL_HANDLE)
         {
             vkDestroySwapchainKHR(m_pDevice->GetLogicalDevice(), m_SwapChain, nullptr);
@@ -245,8 +231,16 @@ namespace RUBY
         }
     }
 
-    uint32_t SwapChain::AcquireNextImage(uint64_t timeout, uint32_t /*frameIndex*/, VkSemaphore signalSemaphore, VkFence fence, VkResult* outResult) const
+    uint32_t SwapChain::AcquireNextImage(uint64_t timeout, uint32_t /*frameIndex*/, VkSemaphore signalSemaphore, VkFence fence, VkResult* outResult)
     {
+        if (m_IsOffscreen)
+        {
+            // Round robin, the in-flight wait in RUBY::BeginFrame already guarantees the image is free again
+            m_OffscreenImageIndex = (m_OffscreenImageIndex + 1) % static_cast<uint32_t>(m_SwapChainImages.size());
+            if (outResult) *outResult = VK_SUCCESS;
+            return m_OffscreenImageIndex;
+        }
+
         uint32_t imageIndex = 0;
         VkResult result = vkAcquireNextImageKHR(
             m_pDevice->GetLogicalDevice(),
@@ -0,0 +1,81 @@
+#include "Vulkan/TimelineSemaphore.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "Vulkan/Device.h"
+
+RUBY::TimelineSemaphore::TimelineSemaphore(const Device* pDevice, uint64_t initialValue)
+	: m_pDevice(pDevice), m_PendingValue(initialValue), m_CompletedValue(initialValue)
+{
+	VkSemaphoreTypeCreateInfo typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	typeInfo.initialValue = initialValue;
+
+	VkSemaphoreCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	createInfo.pNext = &typeInfo;
+
+	VkResult result = vkCreateSemaphore(m_pDevice->GetLogicalDevice(), &createInfo, nullptr, &m_Semaphore);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create timeline semaphore (VkResult=" + std::to_string(result) + ")");
+	}
+}
+
+RUBY::TimelineSemaphore::~TimelineSemaphore()
+{
+	if (m_Semaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(m_pDevice->GetLogicalDevice(), m_Semaphore, nullptr);
+}
+
+uint64_t RUBY::TimelineSemaphore::GetCompletedValue()
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(m_pDevice->GetLogicalDevice(), m_Semaphore, &value);
+
+	// Keep the cache monotonic when several threads poll at once
+	uint64_t cached = m_CompletedValue.load();
+	while (value > cached && !m_CompletedValue.compare_exchange_weak(cached, value)) {}
+
+	return m_CompletedValue.load();
+}
+
+bool RUBY::TimelineSemaphore::IsComplete(uint64_t value)
+{
+	if (value <= m_CompletedValue.load())
+		return true;
+
+	return value <= GetCompletedValue();
+}
+
+void RUBY::TimelineSemaphore::Wait(uint64_t value, uint64_t timeout)
+{
+	if (IsComplete(value))
+		return;
+
+	VkSemaphoreWaitInfo waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &m_Semaphore;
+	waitInfo.pValues = &value;
+
+	VkResult result = vkWaitSemaphores(m_pDevice->GetLogicalDevice(), &waitInfo, timeout);
+	if (result != VK_SUCCESS && result != VK_TIMEOUT)
+	{
+		throw std::runtime_error("Failed to wait on timeline semaphore (VkResult=" + std::to_string(result) + ")");
+	}
+
+	GetCompletedValue();
+}
+
+VkSemaphoreSubmitInfo RUBY::TimelineSemaphore::GetSubmitInfo(uint64_t value, VkPipelineStageFlags2 stageMask) const
+{
+	VkSemaphoreSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	submitInfo.semaphore = m_Semaphore;
+	submitInfo.value = value;
+	submitInfo.stageMask = stageMask;
+	return submitInfo;
+}
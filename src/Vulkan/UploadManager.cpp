@@ -0,0 +1,571 @@
+#include "Vulkan/UploadManager.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Core/CpuProfiler.h"
+#include "Vulkan/Defragmenter.h"
+#include "Vulkan/TimelineSemaphore.h"
+
+namespace
+{
+	// Covers the texel size of every uncompressed format and the 4 byte rule of vkCmdCopyBufferToImage
+	constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+	// Tightly packed size of width x height texels, 0 for formats UploadImage doesn't know
+	VkDeviceSize GetImageDataSize(VkFormat format, uint32_t width, uint32_t height)
+	{
+		const VkDeviceSize texels = static_cast<VkDeviceSize>(width) * height;
+		const VkDeviceSize blocks = static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4);
+		switch (format)
+		{
+		case VK_FORMAT_R8_UNORM:
+		case VK_FORMAT_R8_SRGB:
+		case VK_FORMAT_R8_UINT:
+		case VK_FORMAT_S8_UINT:
+			return texels;
+		case VK_FORMAT_R8G8_UNORM:
+		case VK_FORMAT_R8G8_SRGB:
+		case VK_FORMAT_R16_UNORM:
+		case VK_FORMAT_R16_SFLOAT:
+		case VK_FORMAT_R16_UINT:
+		case VK_FORMAT_D16_UNORM:
+			return texels * 2;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+		case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+		case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+		case VK_FORMAT_R16G16_UNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_R32_SFLOAT:
+		case VK_FORMAT_R32_UINT:
+		case VK_FORMAT_D32_SFLOAT:
+			return texels * 4;
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R32G32_SFLOAT:
+			return texels * 8;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+		case VK_FORMAT_R32G32B32A32_UINT:
+			return texels * 16;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+			return blocks * 8;
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return blocks * 16;
+		default:
+			return 0;
+		}
+	}
+}
+
+RUBY::UploadManager::UploadManager(Device* pDevice, VkDeviceSize frameBudget)
+	: m_pDevice(pDevice), m_FrameBudget(frameBudget)
+{
+	m_pCommandPool = std::make_unique<CommandPool>(pDevice, 0,
+		VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		"Upload Command Pool", QueueType::Transfer);
+
+	m_TransfersOwnership = pDevice->GetQueueFamily(QueueType::Transfer) != pDevice->GetQueueFamily(QueueType::Graphics);
+}
+
+RUBY::UploadManager::~UploadManager()
+{
+	TimelineSemaphore& timeline = m_pDevice->GetTransferTimeline();
+	timeline.Wait(m_LastSubmittedValue);
+}
+
+RUBY::UploadToken RUBY::UploadManager::UploadBuffer(Buffer& dst, const void* pData, VkDeviceSize size, VkDeviceSize dstOffset, UploadPriority priority)
+{
+	if (dstOffset > dst.GetSize() || size > dst.GetSize() - dstOffset)
+	{
+		throw std::invalid_argument("UploadBuffer of " + std::to_string(size) + " bytes at offset " + std::to_string(dstOffset) +
+			" doesn't fit the " + std::to_string(dst.GetSize()) + " byte buffer");
+	}
+
+	Request request{};
+	request.size = size;
+	request.pBuffer = &dst;
+	request.dstOffset = dstOffset;
+	return Enqueue(std::move(request), pData, priority);
+}
+
+RUBY::UploadToken RUBY::UploadManager::UploadImage(Image& dst, const void* pData, VkDeviceSize size, uint32_t width, uint32_t height, VkImageLayout finalLayout, UploadPriority priority)
+{
+	// The copy goes from UNDEFINED and only writes mip 0 of layer 0, anything else would be left undefined
+	if (dst.GetMipLevels() != 1 || dst.GetArrayLayers() != 1)
+	{
+		throw std::invalid_argument("UploadImage needs an image with one mip level and one array layer, got " +
+			std::to_string(dst.GetMipLevels()) + " levels and " + std::to_string(dst.GetArrayLayers()) + " layers");
+	}
+	const VkExtent3D extent = dst.GetExtent();
+	if (width != extent.width || height != extent.height || extent.depth != 1)
+	{
+		throw std::invalid_argument("UploadImage of " + std::to_string(width) + "x" + std::to_string(height) +
+			" doesn't cover the whole " + std::to_string(extent.width) + "x" + std::to_string(extent.height) + " image");
+	}
+	// The copy reads tightly packed texels, a short pData would have it read past the staged bytes
+	const VkDeviceSize dataSize = GetImageDataSize(dst.GetFormat(), width, height);
+	if (dataSize == 0)
+	{
+		throw std::invalid_argument("UploadImage doesn't know the texel size of format " + std::to_string(dst.GetFormat()));
+	}
+	if (size < dataSize)
+	{
+		throw std::invalid_argument("UploadImage got " + std::to_string(size) + " bytes, the " + std::to_string(width) + "x" +
+			std::to_string(height) + " image needs " + std::to_string(dataSize));
+	}
+
+	Request request{};
+	request.size = size;
+	request.pImage = &dst;
+	request.width = width;
+	request.height = height;
+	request.finalLayout = finalLayout;
+	return Enqueue(std::move(request), pData, priority);
+}
+
+RUBY::UploadToken RUBY::UploadManager::Enqueue(Request&& request, const void* pData, UploadPriority priority)
+{
+	RUBY_PROFILE_FUNCTION();
+	if (request.size == 0)
+		return {};
+
+	std::lock_guard lock{ m_Mutex };
+
+	// Bump allocate from the newest page, a new one is started when it doesn't fit
+	StagingPage* pPage = m_StagingPages.empty() ? nullptr : &m_StagingPages.back();
+	VkDeviceSize offset = pPage ? (pPage->used + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1) : 0;
+	if (pPage == nullptr || offset + request.size > pPage->size)
+	{
+		StagingPage& page = m_StagingPages.emplace_back();
+		page.size = std::max(STAGING_PAGE_SIZE, request.size);
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = page.size;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		page.pBuffer = std::make_unique<Buffer>(m_pDevice, m_pCommandPool.get(), bufferInfo,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			HostAccess::Sequential);
+		page.pBuffer->SetName("Upload Staging Page");
+
+		pPage = &page;
+		offset = 0;
+	}
+
+	pPage->pBuffer->CopyMemory(pData, request.size, static_cast<int>(offset));
+	pPage->used = offset + request.size;
+	++pPage->queuedRequests;
+
+	request.id = m_NextId++;
+	request.pPage = pPage;
+	request.stagingOffset = offset;
+
+	// Moving the destination between the release and the acquire would lose the ownership transfer
+	if (m_TransfersOwnership)
+	{
+		request.allocation = request.pBuffer ? request.pBuffer->GetBufferAllocation() : request.pImage->GetImageAllocation();
+		m_pDevice->GetDefragmenter().AddBusy(request.allocation);
+	}
+
+	m_QueuedBytes += request.size;
+	m_Tokens.emplace(request.id, 0);
+
+	const UploadToken token{ request.id };
+	m_Queued[static_cast<size_t>(priority)].push_back(std::move(request));
+	return token;
+}
+
+bool RUBY::UploadManager::IsComplete(UploadToken token)
+{
+	uint64_t timelineValue;
+	{
+		std::lock_guard lock{ m_Mutex };
+		auto it = m_Tokens.find(token.id);
+		if (it == m_Tokens.end())
+			return true;
+		timelineValue = it->second;
+	}
+
+	return timelineValue != 0 && m_pDevice->GetTransferTimeline().IsComplete(timelineValue);
+}
+
+void RUBY::UploadManager::Wait(UploadToken token)
+{
+	RUBY_PROFILE_FUNCTION();
+	uint64_t timelineValue;
+	{
+		std::lock_guard lock{ m_Mutex };
+		auto it = m_Tokens.find(token.id);
+		if (it == m_Tokens.end())
+			return;
+
+		if (it->second == 0)
+			Submit(m_QueuedBytes);
+		timelineValue = m_Tokens.at(token.id);
+	}
+
+	m_pDevice->GetTransferTimeline().Wait(timelineValue);
+}
+
+void RUBY::UploadManager::Flush()
+{
+	std::lock_guard lock{ m_Mutex };
+	Submit(m_QueuedBytes);
+}
+
+void RUBY::UploadManager::Update()
+{
+	RUBY_PROFILE_FUNCTION();
+	std::lock_guard lock{ m_Mutex };
+	Retire();
+	Submit(m_FrameBudget);
+}
+
+VkDeviceSize RUBY::UploadManager::GetQueuedBytes() const
+{
+	std::lock_guard lock{ m_Mutex };
+	return m_QueuedBytes;
+}
+
+void RUBY::UploadManager::Submit(VkDeviceSize budget)
+{
+	// Always take at least one request, uploads bigger than the budget would never go out otherwise
+	std::vector<Request> requests;
+	VkDeviceSize bytes = 0;
+	for (auto& queue : m_Queued)
+	{
+		while (!queue.empty() && (requests.empty() || bytes + queue.front().size <= budget))
+		{
+			bytes += queue.front().size;
+			requests.push_back(std::move(queue.front()));
+			queue.pop_front();
+		}
+	}
+
+	if (requests.empty())
+		return;
+
+	RUBY_PROFILE_SCOPE("Submit Uploads");
+	m_QueuedBytes -= bytes;
+
+	VkCommandBuffer commandBuffer;
+	if (m_FreeCommandBuffers.empty())
+	{
+		commandBuffer = m_pCommandPool->AcquirePrimaryCommandBuffer();
+	}
+	else
+	{
+		commandBuffer = m_FreeCommandBuffers.back();
+		m_FreeCommandBuffers.pop_back();
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to begin upload command buffer!");
+	}
+
+	const uint32_t transferFamily = m_pDevice->GetQueueFamily(QueueType::Transfer);
+	const uint32_t graphicsFamily = m_pDevice->GetQueueFamily(QueueType::Graphics);
+
+	auto makeImageBarrier = [](const Image& image, VkImageLayout oldLayout, VkImageLayout newLayout)
+	{
+		VkImageMemoryBarrier2 barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image.GetImage();
+		barrier.subresourceRange.aspectMask = image.GetAspectFlags();
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		return barrier;
+	};
+
+	// Several requests of the batch can target the same destination: transitioned and released once, by the last
+	// request, with the copies ordered in between
+	auto getDestination = [](const Request& request) -> const void*
+	{
+		return request.pBuffer ? static_cast<const void*>(request.pBuffer) : request.pImage;
+	};
+	std::unordered_map<const void*, size_t> lastRequests;
+	std::unordered_map<const Buffer*, std::pair<VkDeviceSize, VkDeviceSize>> bufferRanges;
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		const Request& request = requests[i];
+		lastRequests[getDestination(request)] = i;
+		if (request.pBuffer == nullptr)
+			continue;
+
+		auto it = bufferRanges.try_emplace(request.pBuffer, request.dstOffset, request.dstOffset + request.size).first;
+		it->second.first = std::min(it->second.first, request.dstOffset);
+		it->second.second = std::max(it->second.second, request.dstOffset + request.size);
+	}
+
+	// Everything into TRANSFER_DST at once, previous contents are discarded
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+	std::unordered_set<const Image*> transitionedImages;
+	for (const auto& request : requests)
+	{
+		if (request.pImage == nullptr || !transitionedImages.insert(request.pImage).second)
+			continue;
+
+		VkImageMemoryBarrier2 barrier = makeImageBarrier(*request.pImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		imageBarriers.push_back(barrier);
+	}
+
+	if (!imageBarriers.empty())
+	{
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	std::unordered_set<const void*> writtenDestinations;
+	for (const auto& request : requests)
+	{
+		if (!writtenDestinations.insert(getDestination(request)).second)
+		{
+			VkMemoryBarrier2 barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+			VkDependencyInfo dependencyInfo{};
+			dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+			dependencyInfo.memoryBarrierCount = 1;
+			dependencyInfo.pMemoryBarriers = &barrier;
+			vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+		}
+
+		VkBuffer stagingBuffer = request.pPage->pBuffer->GetBuffer();
+		if (request.pBuffer)
+		{
+			VkBufferCopy region{};
+			region.srcOffset = request.stagingOffset;
+			region.dstOffset = request.dstOffset;
+			region.size = request.size;
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, request.pBuffer->GetBuffer(), 1, &region);
+		}
+		else
+		{
+			VkBufferImageCopy region{};
+			region.bufferOffset = request.stagingOffset;
+			region.imageSubresource.aspectMask = request.pImage->GetAspectFlags();
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = { request.width, request.height, 1 };
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, request.pImage->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		}
+	}
+
+	// Releases (and final layouts) go out on the transfer queue, the matching acquires wait for RecordAcquires.
+	// Their source stage chains them to the frame's semaphore wait.
+	std::vector<VkBufferMemoryBarrier2> bufferBarriers;
+	imageBarriers.clear();
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		const Request& request = requests[i];
+		// Every request marked its destination busy, even those whose release is left to a later request
+		if (m_TransfersOwnership)
+			m_PendingAcquireAllocations.push_back(request.allocation);
+		if (lastRequests.at(getDestination(request)) != i)
+			continue;
+
+		if (request.pBuffer)
+		{
+			if (!m_TransfersOwnership)
+				continue;
+
+			VkBufferMemoryBarrier2 barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.buffer = request.pBuffer->GetBuffer();
+			const auto& [rangeBegin, rangeEnd] = bufferRanges.at(request.pBuffer);
+			barrier.offset = rangeBegin;
+			barrier.size = rangeEnd - rangeBegin;
+			bufferBarriers.push_back(barrier);
+
+			barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			barrier.srcAccessMask = VK_ACCESS_2_NONE;
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+			m_PendingBufferAcquires.push_back(barrier);
+			continue;
+		}
+
+		VkImageMemoryBarrier2 barrier = makeImageBarrier(*request.pImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, request.finalLayout);
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		if (m_TransfersOwnership)
+		{
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+
+			VkImageMemoryBarrier2 acquire = barrier;
+			acquire.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			acquire.srcAccessMask = VK_ACCESS_2_NONE;
+			acquire.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			acquire.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+			m_PendingImageAcquires.push_back(acquire);
+		}
+		else
+		{
+			// Same family, the semaphore wait of the frame orders the transition before any use
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		}
+		imageBarriers.push_back(barrier);
+
+		request.pImage->SetImageLayout(request.finalLayout);
+	}
+
+	if (!bufferBarriers.empty() || !imageBarriers.empty())
+	{
+		VkDependencyInfo dependencyInfo{};
+		dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(bufferBarriers.size());
+		dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+		dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+		dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+		vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to record upload command buffer!");
+	}
+
+	VkCommandBufferSubmitInfo commandBufferInfo{};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	commandBufferInfo.commandBuffer = commandBuffer;
+
+	VkSubmitInfo2 submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+
+	uint64_t signalValue = 0;
+	if (m_pDevice->Submit(QueueType::Transfer, submitInfo, signalValue) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit uploads!");
+	}
+
+	for (const auto& request : requests)
+	{
+		m_Tokens[request.id] = signalValue;
+		request.pPage->retireValue = signalValue;
+		--request.pPage->queuedRequests;
+	}
+
+	m_Submissions.push_back({ signalValue, commandBuffer });
+	m_LastSubmittedValue = signalValue;
+}
+
+void RUBY::UploadManager::Retire()
+{
+	TimelineSemaphore& timeline = m_pDevice->GetTransferTimeline();
+	const uint64_t completedValue = timeline.GetCompletedValue();
+
+	while (!m_Submissions.empty() && m_Submissions.front().timelineValue <= completedValue)
+	{
+		m_FreeCommandBuffers.push_back(m_Submissions.front().commandBuffer);
+		m_Submissions.pop_front();
+	}
+
+	std::erase_if(m_Tokens, [completedValue](const auto& token)
+	{
+		return token.second != 0 && token.second <= completedValue;
+	});
+
+	// The newest page is rewound instead of freed, it is the one new uploads go to
+	for (auto it = m_StagingPages.begin(); it != m_StagingPages.end();)
+	{
+		if (it->queuedRequests != 0 || it->retireValue > completedValue)
+		{
+			++it;
+			continue;
+		}
+
+		if (std::next(it) == m_StagingPages.end())
+		{
+			it->used = 0;
+			++it;
+		}
+		else
+		{
+			it = m_StagingPages.erase(it);
+		}
+	}
+}
+
+void RUBY::UploadManager::RecordAcquires(VkCommandBuffer commandBuffer)
+{
+	std::lock_guard lock{ m_Mutex };
+
+	// Only the first frame after a submission has to wait for it, later ones are ordered behind that frame
+	m_FrameWaitValue = m_LastSubmittedValue > m_LastAcquiredValue ? m_LastSubmittedValue : 0;
+	m_LastAcquiredValue = m_LastSubmittedValue;
+
+	if (m_PendingBufferAcquires.empty() && m_PendingImageAcquires.empty())
+		return;
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(m_PendingBufferAcquires.size());
+	dependencyInfo.pBufferMemoryBarriers = m_PendingBufferAcquires.data();
+	dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(m_PendingImageAcquires.size());
+	dependencyInfo.pImageMemoryBarriers = m_PendingImageAcquires.data();
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
+	m_PendingBufferAcquires.clear();
+	m_PendingImageAcquires.clear();
+
+	// The acquires are submitted with this frame, ahead of the next defragmentation pass
+	Defragmenter& defragmenter = m_pDevice->GetDefragmenter();
+	for (VmaAllocation allocation : m_PendingAcquireAllocations)
+		defragmenter.RemoveBusy(allocation);
+	m_PendingAcquireAllocations.clear();
+}
+
+void RUBY::UploadManager::GetFrameWaits(std::vector<VkSemaphoreSubmitInfo>& outWaits) const
+{
+	std::lock_guard lock{ m_Mutex };
+	if (m_FrameWaitValue == 0)
+		return;
+
+	outWaits.push_back(m_pDevice->GetTransferTimeline().GetSubmitInfo(m_FrameWaitValue, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT));
+}